@@ -0,0 +1,49 @@
+// Compares the scalar and runtime-selected batch geo distance kernels.
+// Usage: geo_distance_bench [points] [rounds]
+#include "utils/geohash.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using BatchFn = void (*)(double, double, const double*, size_t, double*, double*, double*);
+
+static double run(BatchFn fn, const std::vector<double>& scores, int rounds, std::vector<double>& dists) {
+    std::vector<double> lats(scores.size()), lons(scores.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        fn(52.52, 13.405, scores.data(), scores.size(), lats.data(), lons.data(), dists.data());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(scores.size()) * rounds / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    size_t points = (argc > 1) ? std::stoul(argv[1]) : (1 << 20);
+    int rounds = (argc > 2) ? std::stoi(argv[2]) : 20;
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> lat_dist(GEO_LAT_MIN, GEO_LAT_MAX);
+    std::uniform_real_distribution<double> lon_dist(GEO_LONG_MIN, GEO_LONG_MAX);
+
+    std::vector<double> scores(points);
+    for (auto& s : scores) s = GeoHash::encode(lat_dist(rng), lon_dist(rng));
+
+    std::vector<double> scalar_dists(points), batch_dists(points);
+    double scalar_rate = run(&GeoHash::distance_batch_scalar, scores, rounds, scalar_dists);
+    double batch_rate = run(&GeoHash::distance_batch, scores, rounds, batch_dists);
+
+    double max_diff = 0;
+    for (size_t i = 0; i < points; ++i) {
+        max_diff = std::max(max_diff, std::fabs(scalar_dists[i] - batch_dists[i]));
+    }
+
+    std::printf("points=%zu rounds=%d\n", points, rounds);
+    std::printf("scalar:          %.2f Mpoints/s\n", scalar_rate / 1e6);
+    std::printf("batch (%s): %.2f Mpoints/s (%.2fx)\n", GeoHash::batch_kernel_name(), batch_rate / 1e6, batch_rate / scalar_rate);
+    std::printf("max |scalar - batch| = %.3e m\n", max_diff);
+    return 0;
+}
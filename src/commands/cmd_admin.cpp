@@ -6,7 +6,7 @@ std::string AdminCommands::handle(std::shared_ptr<Client> client, const std::vec
     std::string command = to_upper(args[0]);
 
     if (command == "PING") {
-        if (!client->subscriptions.empty()) {
+        if (!client->subscriptions.empty() || !client->patterns.empty() || !client->shard_subscriptions.empty()) {
             return "*2\r\n$4\r\npong\r\n$0\r\n\r\n";
         }
         if (args.size() > 1) {
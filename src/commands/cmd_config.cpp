@@ -1,6 +1,77 @@
 #include "cmd_config.hpp"
 #include "../utils/utils.hpp"
+#include "../db/persistence.hpp"
 #include <iostream>
+#include <sstream>
+
+// Parses a memory amount such as "32mb", "8k" or "1048576".
+static bool parse_memory(const std::string& str, size_t& out) {
+    size_t pos = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(str, &pos);
+    } catch (...) {
+        return false;
+    }
+
+    std::string unit = to_lower(str.substr(pos));
+    unsigned long long mul = 1;
+    if (unit == "k") mul = 1000;
+    else if (unit == "kb") mul = 1024;
+    else if (unit == "m") mul = 1000 * 1000;
+    else if (unit == "mb") mul = 1024 * 1024;
+    else if (unit == "g") mul = 1000ULL * 1000 * 1000;
+    else if (unit == "gb") mul = 1024ULL * 1024 * 1024;
+    else if (!unit.empty() && unit != "b") return false;
+
+    out = static_cast<size_t>(value * mul);
+    return true;
+}
+
+static const std::pair<char, uint32_t> NOTIFY_FLAG_CHARS[] = {
+    {'K', NOTIFY_KEYSPACE}, {'E', NOTIFY_KEYEVENT}, {'g', NOTIFY_GENERIC}, {'$', NOTIFY_STRING},
+    {'l', NOTIFY_LIST}, {'s', NOTIFY_SET}, {'h', NOTIFY_HASH}, {'z', NOTIFY_ZSET},
+    {'x', NOTIFY_EXPIRED}, {'e', NOTIFY_EVICTED}, {'t', NOTIFY_STREAM}, {'m', NOTIFY_KEY_MISS},
+    {'n', NOTIFY_NEW},
+};
+
+static bool parse_notify_flags(const std::string& str, uint32_t& out) {
+    uint32_t flags = 0;
+    for (char c : str) {
+        if (c == 'A') {
+            flags |= NOTIFY_ALL;
+            continue;
+        }
+        bool known = false;
+        for (const auto& [flag_char, bit] : NOTIFY_FLAG_CHARS) {
+            if (c == flag_char) {
+                flags |= bit;
+                known = true;
+            }
+        }
+        if (!known) return false;
+    }
+
+    // Without K or E nothing would be published, so store the feature as off.
+    out = (flags & (NOTIFY_KEYSPACE | NOTIFY_KEYEVENT)) ? flags : 0;
+    return true;
+}
+
+static std::string notify_flags_to_string(uint32_t flags) {
+    std::string out;
+    if ((flags & NOTIFY_ALL) == NOTIFY_ALL) {
+        out += 'A';
+        flags &= ~static_cast<uint32_t>(NOTIFY_ALL);
+    }
+    for (const auto& [flag_char, bit] : NOTIFY_FLAG_CHARS) {
+        if (flags & bit) out += flag_char;
+    }
+    return out;
+}
+
+static std::string limit_to_string(const OutputBufferLimit& limit) {
+    return std::to_string(limit.hard) + " " + std::to_string(limit.soft) + " " + std::to_string(limit.soft_seconds);
+}
 
 std::string ConfigCommands::handle(Database& db, const std::vector<std::string>& args) {
     if (args.size() < 3) {
@@ -20,6 +91,50 @@ std::string ConfigCommands::handle(Database& db, const std::vector<std::string>&
         } else if (parameter == "dbfilename") {
             value = db.config.dbfilename;
             found = true;
+        } else if (parameter == "notify-keyspace-events") {
+            value = notify_flags_to_string(db.config.notify_keyspace_events);
+            found = true;
+        } else if (parameter == "client-output-buffer-limit") {
+            value = "replica " + limit_to_string(db.config.replica_limit) +
+                    " pubsub " + limit_to_string(db.config.pubsub_limit);
+            found = true;
+        } else if (parameter == "repl-backlog-size") {
+            std::lock_guard<std::mutex> lock(db.replication_mutex);
+            value = std::to_string(db.config.repl_backlog_size);
+            found = true;
+        } else if (parameter == "save") {
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            value = Persistence::save_params_to_string(db.persistence.save_params);
+            found = true;
+        } else if (parameter == "repl-diskless-sync") {
+            value = db.config.repl_diskless_sync ? "yes" : "no";
+            found = true;
+        } else if (parameter == "repl-diskless-sync-delay") {
+            value = std::to_string(db.config.repl_diskless_sync_delay);
+            found = true;
+        } else if (parameter == "repl-diskless-sync-max-replicas") {
+            value = std::to_string(db.config.repl_diskless_sync_max_replicas);
+            found = true;
+        } else if (parameter == "appendonly") {
+            value = db.config.appendonly ? "yes" : "no";
+            found = true;
+        } else if (parameter == "appendfsync") {
+            value = AppendOnlyFile::fsync_policy_to_string(db.aof.get_fsync_policy());
+            found = true;
+        } else if (parameter == "appendfilename") {
+            value = db.config.appendfilename;
+            found = true;
+        } else if (parameter == "appenddirname") {
+            value = db.config.appenddirname;
+            found = true;
+        } else if (parameter == "auto-aof-rewrite-percentage") {
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            value = std::to_string(db.persistence.auto_aof_rewrite_percentage);
+            found = true;
+        } else if (parameter == "auto-aof-rewrite-min-size") {
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            value = std::to_string(db.persistence.auto_aof_rewrite_min_size);
+            found = true;
         }
 
         if (found) {
@@ -31,6 +146,133 @@ std::string ConfigCommands::handle(Database& db, const std::vector<std::string>&
             return "*0\r\n"; 
         }
     }
+    else if (subcommand == "SET") {
+        if (args.size() != 4) {
+            return "-ERR wrong number of arguments for 'config|set' command\r\n";
+        }
+
+        if (parameter == "dir") {
+            db.config.dir = args[3];
+        } else if (parameter == "dbfilename") {
+            db.config.dbfilename = args[3];
+        } else if (parameter == "notify-keyspace-events") {
+            uint32_t flags = 0;
+            if (!parse_notify_flags(args[3], flags)) {
+                return "-ERR CONFIG SET failed (possibly related to argument 'notify-keyspace-events') - Invalid argument\r\n";
+            }
+            db.config.notify_keyspace_events = flags;
+        } else if (parameter == "client-output-buffer-limit") {
+            // Only the replica and pubsub classes are tracked; see Client::enqueue_limited.
+            std::istringstream in(args[3]);
+            std::string cls, hard, soft, seconds;
+            size_t hard_bytes = 0, soft_bytes = 0;
+            long long soft_seconds = 0;
+
+            while (in >> cls) {
+                cls = to_lower(cls);
+                OutputBufferLimit* limit = nullptr;
+                if (cls == "pubsub") limit = &db.config.pubsub_limit;
+                else if (cls == "replica" || cls == "slave") limit = &db.config.replica_limit;
+
+                if (!(in >> hard >> soft >> seconds) || limit == nullptr ||
+                    !parse_memory(hard, hard_bytes) || !parse_memory(soft, soft_bytes)) {
+                    return "-ERR CONFIG SET failed (possibly related to argument 'client-output-buffer-limit') - Invalid argument\r\n";
+                }
+                try {
+                    soft_seconds = std::stoll(seconds);
+                } catch (...) {
+                    return "-ERR CONFIG SET failed (possibly related to argument 'client-output-buffer-limit') - Invalid argument\r\n";
+                }
+
+                limit->hard = hard_bytes;
+                limit->soft = soft_bytes;
+                limit->soft_seconds = soft_seconds;
+            }
+        } else if (parameter == "repl-backlog-size") {
+            size_t size = 0;
+            if (!parse_memory(args[3], size) || size == 0) {
+                return "-ERR CONFIG SET failed (possibly related to argument 'repl-backlog-size') - Invalid argument\r\n";
+            }
+            std::lock_guard<std::mutex> lock(db.replication_mutex);
+            db.config.repl_backlog_size = size;
+            if (db.repl_backlog) db.repl_backlog->resize(size);
+        } else if (parameter == "save") {
+            std::vector<std::pair<long long, long long>> params;
+            if (!Persistence::parse_save_params(args[3], params)) {
+                return "-ERR CONFIG SET failed (possibly related to argument 'save') - Invalid argument\r\n";
+            }
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            db.persistence.save_params = std::move(params);
+        } else if (parameter == "repl-diskless-sync") {
+            std::string flag = to_lower(args[3]);
+            if (flag != "yes" && flag != "no") {
+                return "-ERR CONFIG SET failed (possibly related to argument 'repl-diskless-sync') - Invalid argument\r\n";
+            }
+            db.config.repl_diskless_sync = (flag == "yes");
+        } else if (parameter == "repl-diskless-sync-delay" || parameter == "repl-diskless-sync-max-replicas") {
+            int number = -1;
+            try {
+                number = std::stoi(args[3]);
+            } catch (...) {}
+            if (number < 0) {
+                return "-ERR CONFIG SET failed (possibly related to argument '" + parameter + "') - Invalid argument\r\n";
+            }
+            if (parameter == "repl-diskless-sync-delay") db.config.repl_diskless_sync_delay = number;
+            else db.config.repl_diskless_sync_max_replicas = number;
+        } else if (parameter == "appendfsync") {
+            AppendFsync policy;
+            if (!AppendOnlyFile::parse_fsync_policy(args[3], policy)) {
+                return "-ERR CONFIG SET failed (possibly related to argument 'appendfsync') - Invalid argument\r\n";
+            }
+            db.aof.set_fsync_policy(policy);
+        } else if (parameter == "appendfilename" || parameter == "appenddirname") {
+            if (db.aof.enabled()) {
+                return "-ERR CONFIG SET failed (possibly related to argument '" + parameter + "') - can't change the AOF location while appendonly is on\r\n";
+            }
+            if (args[3].empty() || args[3].find('/') != std::string::npos) {
+                return "-ERR CONFIG SET failed (possibly related to argument '" + parameter + "') - Invalid argument\r\n";
+            }
+            if (parameter == "appendfilename") db.config.appendfilename = args[3];
+            else db.config.appenddirname = args[3];
+        } else if (parameter == "auto-aof-rewrite-percentage") {
+            long long percentage = -1;
+            try {
+                percentage = std::stoll(args[3]);
+            } catch (...) {}
+            if (percentage < 0) {
+                return "-ERR CONFIG SET failed (possibly related to argument 'auto-aof-rewrite-percentage') - Invalid argument\r\n";
+            }
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            db.persistence.auto_aof_rewrite_percentage = percentage;
+        } else if (parameter == "auto-aof-rewrite-min-size") {
+            size_t size = 0;
+            if (!parse_memory(args[3], size)) {
+                return "-ERR CONFIG SET failed (possibly related to argument 'auto-aof-rewrite-min-size') - Invalid argument\r\n";
+            }
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            db.persistence.auto_aof_rewrite_min_size = static_cast<long long>(size);
+        } else if (parameter == "appendonly") {
+            std::string flag = to_lower(args[3]);
+            if (flag != "yes" && flag != "no") {
+                return "-ERR CONFIG SET failed (possibly related to argument 'appendonly') - Invalid argument\r\n";
+            }
+            if (flag == "no") {
+                Persistence::stop_aof(db);
+            } else if (!db.aof.enabled()) {
+                // The rewrite's snapshot and the first write logged after
+                // it must meet exactly.
+                std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+                std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+                if (!Persistence::start_aof(db)) {
+                    return "-ERR CONFIG SET failed (possibly related to argument 'appendonly') - Could not create the AOF\r\n";
+                }
+            }
+            db.config.appendonly = (flag == "yes");
+        } else {
+            return "-ERR Unknown option or number of arguments for CONFIG SET - '" + parameter + "'\r\n";
+        }
+        return "+OK\r\n";
+    }
 
     return "-ERR unknown command\r\n";
 }
\ No newline at end of file
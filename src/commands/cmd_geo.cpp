@@ -7,13 +7,335 @@
 #include <optional>
 #include <cstdio> 
 #include <cmath>
+#include <algorithm>
+
+namespace {
+
+struct GeoSearchRequest {
+    std::string key;
+    std::string store_key;
+    bool store_dist = false;
+
+    bool has_center = false;
+    bool from_member = false;
+    std::string member;
+    double lon = 0;
+    double lat = 0;
+
+    bool has_shape = false;
+    bool by_box = false;
+    double radius_m = 0;
+    double width_m = 0;
+    double height_m = 0;
+    double unit = 1.0;
+
+    int sort = 0; // 1 = ASC, -1 = DESC
+    long long count = 0;
+    bool any = false;
+    bool with_dist = false;
+    bool with_coord = false;
+    bool with_hash = false;
+};
+
+struct GeoMatch {
+    std::string member;
+    double dist;
+    double score;
+};
+
+// Returns meters per unit, or 0 for an unknown unit.
+double unit_to_meters(const std::string& unit) {
+    std::string u = to_upper(unit);
+    if (u == "M") return 1.0;
+    if (u == "KM") return 1000.0;
+    if (u == "FT") return 0.3048;
+    if (u == "MI") return 1609.34;
+    return 0;
+}
+
+std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.length()) + "\r\n" + s + "\r\n";
+}
+
+std::string coords_reply(double latitude, double longitude) {
+    char lat_buf[64], lon_buf[64];
+    std::snprintf(lat_buf, sizeof(lat_buf), "%.17f", latitude);
+    std::snprintf(lon_buf, sizeof(lon_buf), "%.17f", longitude);
+    return "*2\r\n" + bulk(lon_buf) + bulk(lat_buf);
+}
+
+std::string format_distance(double dist) {
+    char dist_buf[64];
+    std::snprintf(dist_buf, sizeof(dist_buf), "%.4f", dist);
+    return std::string(dist_buf);
+}
+
+// Parses everything after the fixed leading arguments; returns an error reply or "".
+std::string parse_search_options(const std::string& command, const std::vector<std::string>& args,
+                                 size_t i, GeoSearchRequest& req) {
+    bool is_search = (command == "GEOSEARCH" || command == "GEOSEARCHSTORE");
+    bool is_store = (command == "GEOSEARCHSTORE");
+    bool allow_store = (command == "GEORADIUS" || command == "GEORADIUSBYMEMBER");
+
+    auto parse_unit = [&](const std::string& unit) {
+        req.unit = unit_to_meters(unit);
+        return req.unit > 0;
+    };
+
+    try {
+        for (; i < args.size(); ++i) {
+            std::string opt = to_upper(args[i]);
+            size_t left = args.size() - i - 1;
+
+            if (is_search && opt == "FROMMEMBER" && left >= 1) {
+                if (req.has_center) return "-ERR exactly one of FROMMEMBER or FROMLONLAT can be specified for '" + to_lower(command) + "' command\r\n";
+                req.has_center = true;
+                req.from_member = true;
+                req.member = args[++i];
+            } else if (is_search && opt == "FROMLONLAT" && left >= 2) {
+                if (req.has_center) return "-ERR exactly one of FROMMEMBER or FROMLONLAT can be specified for '" + to_lower(command) + "' command\r\n";
+                req.has_center = true;
+                req.lon = std::stod(args[++i]);
+                req.lat = std::stod(args[++i]);
+            } else if (is_search && opt == "BYRADIUS" && left >= 2) {
+                if (req.has_shape) return "-ERR exactly one of BYRADIUS and BYBOX can be specified for '" + to_lower(command) + "' command\r\n";
+                req.has_shape = true;
+                req.radius_m = std::stod(args[++i]);
+                if (!parse_unit(args[++i])) return "-ERR unsupported unit provided. please use M, KM, FT, MI\r\n";
+                if (req.radius_m < 0) return "-ERR radius cannot be negative\r\n";
+                req.radius_m *= req.unit;
+            } else if (is_search && opt == "BYBOX" && left >= 3) {
+                if (req.has_shape) return "-ERR exactly one of BYRADIUS and BYBOX can be specified for '" + to_lower(command) + "' command\r\n";
+                req.has_shape = true;
+                req.by_box = true;
+                req.width_m = std::stod(args[++i]);
+                req.height_m = std::stod(args[++i]);
+                if (!parse_unit(args[++i])) return "-ERR unsupported unit provided. please use M, KM, FT, MI\r\n";
+                if (req.width_m < 0 || req.height_m < 0) return "-ERR height or width cannot be negative\r\n";
+                req.width_m *= req.unit;
+                req.height_m *= req.unit;
+            } else if (opt == "ASC") {
+                req.sort = 1;
+            } else if (opt == "DESC") {
+                req.sort = -1;
+            } else if (opt == "COUNT" && left >= 1) {
+                req.count = std::stoll(args[++i]);
+                if (req.count <= 0) return "-ERR COUNT must be > 0\r\n";
+                if (i + 1 < args.size() && to_upper(args[i + 1]) == "ANY") {
+                    req.any = true;
+                    ++i;
+                }
+            } else if (opt == "ANY") {
+                req.any = true;
+            } else if (!is_store && opt == "WITHDIST") {
+                req.with_dist = true;
+            } else if (!is_store && opt == "WITHCOORD") {
+                req.with_coord = true;
+            } else if (!is_store && opt == "WITHHASH") {
+                req.with_hash = true;
+            } else if (is_store && opt == "STOREDIST") {
+                req.store_dist = true;
+            } else if (allow_store && (opt == "STORE" || opt == "STOREDIST") && left >= 1) {
+                req.store_key = args[++i];
+                req.store_dist = (opt == "STOREDIST");
+            } else {
+                return "-ERR syntax error\r\n";
+            }
+        }
+    } catch (const std::out_of_range&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    } catch (...) {
+        return "-ERR value is not a valid float\r\n";
+    }
+
+    if (!req.has_center) return "-ERR exactly one of FROMMEMBER or FROMLONLAT can be specified for '" + to_lower(command) + "' command\r\n";
+    if (!req.has_shape) return "-ERR exactly one of BYRADIUS and BYBOX can be specified for '" + to_lower(command) + "' command\r\n";
+    if (req.any && req.count == 0) return "-ERR the ANY argument requires COUNT argument\r\n";
+    if (!req.store_key.empty() && (req.with_dist || req.with_coord || req.with_hash)) {
+        return "-ERR STORE option in GEORADIUS is not compatible with WITHDIST, WITHHASH and WITHCOORD options\r\n";
+    }
+    if (req.count > 0 && !req.any && req.sort == 0) req.sort = 1;
+    return "";
+}
+
+// Walks the covering cells of the search shape. With COUNT (and no ANY) only the
+// best `count` matches are kept in a bounded heap; COUNT ANY stops at the first
+// `count` matches.
+std::vector<GeoMatch> collect_matches(const Entry& entry, const GeoSearchRequest& req) {
+    std::vector<GeoMatch> matches;
+    bool bounded = req.count > 0 && !req.any;
+    auto heap_cmp = [&](const GeoMatch& a, const GeoMatch& b) {
+        return (req.sort < 0) ? a.dist > b.dist : a.dist < b.dist;
+    };
+
+    auto ranges = req.by_box ? GeoHash::box_ranges(req.lat, req.lon, req.width_m, req.height_m)
+                             : GeoHash::radius_ranges(req.lat, req.lon, req.radius_m);
+
+    // Candidates are decoded and measured in batches so the distance kernel
+    // can work on several scores at once.
+    const size_t batch_size = 256;
+    std::vector<const std::string*> names;
+    std::vector<double> scores;
+    std::vector<double> lats(batch_size), lons(batch_size), dists(batch_size);
+    names.reserve(batch_size);
+    scores.reserve(batch_size);
+    bool done = false;
+
+    auto consider = [&](const std::string& member, double score, double lat, double lon, double dist) {
+        if (req.by_box) {
+            if (!GeoHash::within_box(req.lat, req.lon, lat, lon, req.width_m, req.height_m)) return;
+        } else if (dist > req.radius_m) {
+            return;
+        }
+
+        if (bounded) {
+            if (matches.size() == static_cast<size_t>(req.count)) {
+                if (!heap_cmp(GeoMatch{std::string(), dist, score}, matches.front())) return;
+                std::pop_heap(matches.begin(), matches.end(), heap_cmp);
+                matches.pop_back();
+            }
+            matches.push_back({member, dist, score});
+            std::push_heap(matches.begin(), matches.end(), heap_cmp);
+            return;
+        }
+
+        matches.push_back({member, dist, score});
+        if (req.any && matches.size() >= static_cast<size_t>(req.count)) done = true;
+    };
+
+    auto flush = [&]() {
+        GeoHash::distance_batch(req.lat, req.lon, scores.data(), scores.size(), lats.data(), lons.data(), dists.data());
+        for (size_t k = 0; k < scores.size() && !done; ++k) {
+            consider(*names[k], scores[k], lats[k], lons[k], dists[k]);
+        }
+        names.clear();
+        scores.clear();
+    };
+
+    for (const auto& range : ranges) {
+        RedisZSet::for_each_in_score_range(entry, range.first, range.second,
+            [&](const std::string& member, double score) {
+                names.push_back(&member);
+                scores.push_back(score);
+                if (scores.size() == batch_size) flush();
+                return !done;
+            });
+        if (done) break;
+    }
+    if (!done && !scores.empty()) flush();
+
+    if (req.sort > 0) {
+        std::sort(matches.begin(), matches.end(), [](const GeoMatch& a, const GeoMatch& b) { return a.dist < b.dist; });
+    } else if (req.sort < 0) {
+        std::sort(matches.begin(), matches.end(), [](const GeoMatch& a, const GeoMatch& b) { return a.dist > b.dist; });
+    }
+    return matches;
+}
+
+std::string geo_search(Database& db, const std::string& command, const std::vector<std::string>& args) {
+    GeoSearchRequest req;
+    size_t opt_start = 0;
+
+    if (command == "GEOSEARCH") {
+        if (args.size() < 2) return "-ERR wrong number of arguments for 'geosearch' command\r\n";
+        req.key = args[1];
+        opt_start = 2;
+    } else if (command == "GEOSEARCHSTORE") {
+        if (args.size() < 3) return "-ERR wrong number of arguments for 'geosearchstore' command\r\n";
+        req.store_key = args[1];
+        req.key = args[2];
+        opt_start = 3;
+    } else if (command == "GEORADIUS" || command == "GEORADIUS_RO") {
+        if (args.size() < 6) return "-ERR wrong number of arguments for '" + to_lower(command) + "' command\r\n";
+        req.key = args[1];
+        try {
+            req.lon = std::stod(args[2]);
+            req.lat = std::stod(args[3]);
+            req.radius_m = std::stod(args[4]);
+        } catch (...) { return "-ERR value is not a valid float\r\n"; }
+        req.has_center = true;
+        opt_start = 5;
+    } else {
+        if (args.size() < 5) return "-ERR wrong number of arguments for '" + to_lower(command) + "' command\r\n";
+        req.key = args[1];
+        req.member = args[2];
+        req.from_member = true;
+        try {
+            req.radius_m = std::stod(args[3]);
+        } catch (...) { return "-ERR value is not a valid float\r\n"; }
+        req.has_center = true;
+        opt_start = 4;
+    }
+
+    if (!req.has_shape && req.has_center) {
+        // GEORADIUS family: the unit follows the radius positionally.
+        req.unit = unit_to_meters(args[opt_start]);
+        if (req.unit == 0) return "-ERR unsupported unit provided. please use M, KM, FT, MI\r\n";
+        if (req.radius_m < 0) return "-ERR radius cannot be negative\r\n";
+        req.radius_m *= req.unit;
+        req.has_shape = true;
+        opt_start++;
+    }
+
+    std::string error = parse_search_options(command, args, opt_start, req);
+    if (!error.empty()) return error;
+
+    std::vector<GeoMatch> matches;
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    auto it = db.kv_store.find(req.key);
+
+    if (it != db.kv_store.end() && db.is_expired(it->second)) {
+        db.expire_key(it);
+        it = db.kv_store.end();
+    }
+
+    if (it != db.kv_store.end()) {
+        if (it->second.type != VAL_ZSET) return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+
+        if (req.from_member) {
+            auto score = RedisZSet::get_score(it->second, req.member);
+            if (!score.has_value()) return "-ERR could not decode requested zset member\r\n";
+            auto coords = GeoHash::decode(score.value());
+            req.lat = coords.first;
+            req.lon = coords.second;
+        }
+        matches = collect_matches(it->second, req);
+    }
+
+    if (!req.store_key.empty()) {
+        if (matches.empty()) {
+            if (db.kv_store.erase(req.store_key) > 0) db.notify_keyspace_event(NOTIFY_GENERIC, "del", req.store_key);
+            return ":0\r\n";
+        }
+        Entry entry;
+        entry.type = VAL_ZSET;
+        for (const auto& m : matches) {
+            RedisZSet::add(entry, req.store_dist ? m.dist / req.unit : m.score, m.member);
+        }
+        db.kv_store[req.store_key] = std::move(entry);
+        db.notify_keyspace_event(NOTIFY_ZSET, (command == "GEOSEARCHSTORE") ? "geosearchstore" : "georadiusstore", req.store_key);
+        return ":" + std::to_string(matches.size()) + "\r\n";
+    }
+
+    int fields = 1 + req.with_dist + req.with_hash + req.with_coord;
+    std::string response = "*" + std::to_string(matches.size()) + "\r\n";
+    for (const auto& m : matches) {
+        if (fields == 1) {
+            response += bulk(m.member);
+            continue;
+        }
+        response += "*" + std::to_string(fields) + "\r\n" + bulk(m.member);
+        if (req.with_dist) response += bulk(format_distance(m.dist / req.unit));
+        if (req.with_hash) response += ":" + std::to_string(static_cast<long long>(m.score)) + "\r\n";
+        if (req.with_coord) {
+            auto coords = GeoHash::decode(m.score);
+            response += coords_reply(coords.first, coords.second);
+        }
+    }
+    return response;
+}
 
-double convert_to_meters(double value, const std::string& unit) {
-    if (unit == "m") return value;
-    if (unit == "km") return value * 1000.0;
-    if (unit == "ft") return value * 0.3048;
-    if (unit == "mi") return value * 1609.34;
-    return value; 
 }
 
 std::string GeoCommands::handle(Database& db, const std::vector<std::string>& args) {
@@ -39,14 +361,15 @@ std::string GeoCommands::handle(Database& db, const std::vector<std::string>& ar
 
         std::string key = args[1];
         int added_count = 0;
+        int updated_count = 0;
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -66,8 +389,9 @@ std::string GeoCommands::handle(Database& db, const std::vector<std::string>& ar
                     std::string member = args[i+2];
 
                     double score = GeoHash::encode(latitude, longitude);
-                    added_count += RedisZSet::add(it->second, score, member);
+                    added_count += RedisZSet::add(it->second, score, member, &updated_count);
                 }
+                if (added_count + updated_count > 0) db.notify_keyspace_event(NOTIFY_ZSET, "zadd", key);
             }
         }
 
@@ -82,11 +406,11 @@ std::string GeoCommands::handle(Database& db, const std::vector<std::string>& ar
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -103,13 +427,7 @@ std::string GeoCommands::handle(Database& db, const std::vector<std::string>& ar
 
                     if (score.has_value()) {
                         auto coords = GeoHash::decode(score.value());
-                        char lat_buf[64], lon_buf[64];
-                        std::snprintf(lat_buf, sizeof(lat_buf), "%.17f", coords.first);
-                        std::snprintf(lon_buf, sizeof(lon_buf), "%.17f", coords.second);
-                        
-                        std::string res = "*2\r\n$" + std::to_string(std::string(lon_buf).length()) + "\r\n" + lon_buf + "\r\n$" + 
-                                          std::to_string(std::string(lat_buf).length()) + "\r\n" + lat_buf + "\r\n";
-                        results.push_back(res);
+                        results.push_back(coords_reply(coords.first, coords.second));
                     } else {
                         results.push_back("*-1\r\n");
                     }
@@ -133,11 +451,11 @@ std::string GeoCommands::handle(Database& db, const std::vector<std::string>& ar
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -167,50 +485,9 @@ std::string GeoCommands::handle(Database& db, const std::vector<std::string>& ar
         std::string dist_str(dist_buf);
         return "$" + std::to_string(dist_str.length()) + "\r\n" + dist_str + "\r\n";
     }
-    else if (command == "GEOSEARCH") {
-        if (args.size() < 8) return "-ERR syntax error\r\n";
-        if (to_upper(args[2]) != "FROMLONLAT" || to_upper(args[5]) != "BYRADIUS") return "-ERR syntax error\r\n";
-
-        std::string key = args[1];
-        double from_lon = 0, from_lat = 0, radius = 0;
-        std::string unit = args[7];
-        try {
-            from_lon = std::stod(args[3]);
-            from_lat = std::stod(args[4]);
-            radius = std::stod(args[6]);
-        } catch (...) { return "-ERR value is not a valid float\r\n"; }
-
-        double radius_meters = convert_to_meters(radius, unit);
-        std::vector<std::string> matches;
-        bool wrong_type = false;
-
-        {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
-            auto it = db.kv_store.find(key);
-            
-            if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
-                it = db.kv_store.end();
-            }
-
-            if (it != db.kv_store.end()) {
-                if (it->second.type != VAL_ZSET) wrong_type = true;
-                else {
-                    for (const auto& pair : it->second.zset_val.dict) {
-                        const std::string& member = pair.first;
-                        double score = pair.second;
-                        auto coords = GeoHash::decode(score);
-                        double dist = GeoHash::distance(from_lat, from_lon, coords.first, coords.second);
-                        if (dist <= radius_meters) matches.push_back(member);
-                    }
-                }
-            }
-        }
-
-        if (wrong_type) return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
-        std::string response = "*" + std::to_string(matches.size()) + "\r\n";
-        for (const auto& m : matches) response += "$" + std::to_string(m.length()) + "\r\n" + m + "\r\n";
-        return response;
+    else if (command == "GEOSEARCH" || command == "GEOSEARCHSTORE" || command == "GEORADIUS" ||
+             command == "GEORADIUS_RO" || command == "GEORADIUSBYMEMBER" || command == "GEORADIUSBYMEMBER_RO") {
+        return geo_search(db, command, args);
     }
     
     return "-ERR unknown command\r\n";
@@ -11,12 +11,12 @@ std::string KeyCommands::handle(Database& db, const std::vector<std::string>& ar
         std::string key = args[1];
         std::string type_str = "none";
 
-        std::lock_guard<std::mutex> lock(db.kv_mutex);
+        std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
         auto it = db.kv_store.find(key);
 
         if (it != db.kv_store.end()) {
             if (db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
             } else {
                 switch (it->second.type) {
                     case VAL_STRING: type_str = "string"; break;
@@ -29,6 +29,26 @@ std::string KeyCommands::handle(Database& db, const std::vector<std::string>& ar
         }
         return "+" + type_str + "\r\n";
     }
+    else if (command == "DEL") {
+        if (args.size() < 2) return "-ERR wrong number of arguments for 'del' command\r\n";
+
+        int deleted = 0;
+        std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+
+        for (size_t i = 1; i < args.size(); ++i) {
+            auto it = db.kv_store.find(args[i]);
+            if (it == db.kv_store.end()) continue;
+
+            if (db.is_expired(it->second)) {
+                db.expire_key(it);
+                continue;
+            }
+            db.kv_store.erase(it);
+            db.notify_keyspace_event(NOTIFY_GENERIC, "del", args[i]);
+            deleted++;
+        }
+        return ":" + std::to_string(deleted) + "\r\n";
+    }
     else if (command == "KEYS") {
         if (args.size() < 2) return "-ERR wrong number of arguments for 'keys' command\r\n";
         
@@ -36,11 +56,11 @@ std::string KeyCommands::handle(Database& db, const std::vector<std::string>& ar
         std::vector<std::string> keys;
 
         if (pattern == "*") {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.begin();
             while (it != db.kv_store.end()) {
                 if (db.is_expired(it->second)) {
-                    it = db.kv_store.erase(it);
+                    it = db.expire_key(it);
                 } else {
                     keys.push_back(it->first);
                     ++it;
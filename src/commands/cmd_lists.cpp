@@ -11,7 +11,7 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
 
     auto check_expiry = [&](std::unordered_map<std::string, Entry>::iterator& it) {
         if (it != db.kv_store.end() && db.is_expired(it->second)) {
-            db.kv_store.erase(it);
+            db.expire_key(it);
             it = db.kv_store.end();
         }
     };
@@ -22,7 +22,7 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             check_expiry(it);
             
@@ -39,7 +39,10 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
                     list_size = RedisList::size(it->second);
                 }
             }
-            if (!wrong_type) db.notify_blocked_clients(key);
+            if (!wrong_type) {
+                db.notify_keyspace_event(NOTIFY_LIST, "rpush", key);
+                db.notify_blocked_clients(key);
+            }
         }
 
         if (wrong_type) response = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
@@ -51,7 +54,7 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             check_expiry(it);
 
@@ -68,7 +71,10 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
                     list_size = RedisList::size(it->second);
                 }
             }
-            if (!wrong_type) db.notify_blocked_clients(key);
+            if (!wrong_type) {
+                db.notify_keyspace_event(NOTIFY_LIST, "lpush", key);
+                db.notify_blocked_clients(key);
+            }
         }
 
         if (wrong_type) response = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
@@ -80,7 +86,7 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             check_expiry(it);
 
@@ -102,7 +108,7 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             check_expiry(it);
 
@@ -148,7 +154,7 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
         bool key_exists = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             check_expiry(it);
 
@@ -161,7 +167,11 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
                         popped_values.push_back(RedisList::pop_front(it->second));
                         actual_pops++;
                     }
-                    if (it->second.list_val.empty()) db.kv_store.erase(it);
+                    if (actual_pops > 0) db.notify_keyspace_event(NOTIFY_LIST, "lpop", key);
+                    if (it->second.list_val.empty()) {
+                        db.kv_store.erase(it);
+                        db.notify_keyspace_event(NOTIFY_GENERIC, "del", key);
+                    }
                 }
             }
         }
@@ -190,12 +200,22 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
         auto blocker = std::make_shared<BlockedClient>();
         blocker->key_waiting_on = key;
 
-        std::unique_lock<std::mutex> lock(db.kv_mutex);
+        std::unique_lock<std::recursive_mutex> lock(db.kv_mutex);
+
+        auto pop_and_notify = [&](std::unordered_map<std::string, Entry>::iterator it) {
+            std::string val = RedisList::pop_front(it->second);
+            db.notify_keyspace_event(NOTIFY_LIST, "lpop", key);
+            if (it->second.list_val.empty()) {
+                db.kv_store.erase(it);
+                db.notify_keyspace_event(NOTIFY_GENERIC, "del", key);
+            }
+            return val;
+        };
         
         auto should_return = [&]() -> bool {
             auto it = db.kv_store.find(key);
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
             return (it != db.kv_store.end() && it->second.type == VAL_LIST && !it->second.list_val.empty());
@@ -203,24 +223,30 @@ std::string ListCommands::handle(Database& db, std::shared_ptr<Client> client, c
 
         if (should_return()) {
             auto it = db.kv_store.find(key);
-            std::string val = RedisList::pop_front(it->second);
-            if (it->second.list_val.empty()) db.kv_store.erase(it);
+            std::string val = pop_and_notify(it);
+            // Replicas and the AOF get the pop itself, which can't block.
+            client->propagate_as({"LPOP", key});
             response = "*2\r\n$" + std::to_string(key.length()) + "\r\n" + key + "\r\n$" + std::to_string(val.length()) + "\r\n" + val + "\r\n";
+        } else if (client->in_multi) {
+            // Inside EXEC the keyspace is held for the whole transaction, so
+            // behave as if the timeout had already passed.
+            response = "*-1\r\n";
         } else {
             db.blocking_keys[key].push(blocker);
 
+            BlockedWriteLock wait_lock(db);
             bool success = false;
             if (timeout_sec > 0.001) {
-                success = blocker->cv.wait_for(lock, std::chrono::duration<double>(timeout_sec), should_return);
+                success = blocker->cv.wait_for(wait_lock, std::chrono::duration<double>(timeout_sec), should_return);
             } else {
-                blocker->cv.wait(lock, should_return);
+                blocker->cv.wait(wait_lock, should_return);
                 success = true;
             }
 
             if (success && should_return()) {
                 auto it = db.kv_store.find(key);
-                std::string val = RedisList::pop_front(it->second);
-                if (it->second.list_val.empty()) db.kv_store.erase(it);
+                std::string val = pop_and_notify(it);
+                client->propagate_as({"LPOP", key});
                 response = "*2\r\n$" + std::to_string(key.length()) + "\r\n" + key + "\r\n$" + std::to_string(val.length()) + "\r\n" + val + "\r\n";
             } else {
                 response = "*-1\r\n";
@@ -0,0 +1,40 @@
+#include "cmd_persistence.hpp"
+#include "../db/persistence.hpp"
+#include "../utils/utils.hpp"
+
+std::string PersistenceCommands::handle(Database& db, const std::vector<std::string>& args) {
+    std::string command = to_upper(args[0]);
+
+    if (command == "SAVE") {
+        if (args.size() != 1) return "-ERR wrong number of arguments for 'save' command\r\n";
+        {
+            std::lock_guard<std::mutex> lock(db.persistence_mutex);
+            if (db.persistence.bgsave_child > 0) return "-ERR Background save already in progress\r\n";
+        }
+        return Persistence::save(db) ? "+OK\r\n" : "-ERR\r\n";
+    }
+    else if (command == "BGSAVE") {
+        if (args.size() != 1) return "-ERR wrong number of arguments for 'bgsave' command\r\n";
+        std::string error = Persistence::start_bgsave(db);
+        return error.empty() ? "+Background saving started\r\n" : error;
+    }
+    else if (command == "BGREWRITEAOF") {
+        if (args.size() != 1) return "-ERR wrong number of arguments for 'bgrewriteaof' command\r\n";
+        std::string error;
+        {
+            std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+            std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+            error = Persistence::start_aof_rewrite(db);
+        }
+        if (!error.empty()) return error;
+        std::lock_guard<std::mutex> lock(db.persistence_mutex);
+        if (db.persistence.aof_rewrite_scheduled) return "+Background append only file rewriting scheduled\r\n";
+        return "+Background append only file rewriting started\r\n";
+    }
+    else if (command == "LASTSAVE") {
+        std::lock_guard<std::mutex> lock(db.persistence_mutex);
+        return ":" + std::to_string(db.persistence.last_save_time) + "\r\n";
+    }
+
+    return "-ERR unknown command\r\n";
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "../db/database.hpp"
+
+class PersistenceCommands {
+public:
+    static std::string handle(Database& db, const std::vector<std::string>& args);
+};
@@ -2,101 +2,170 @@
 #include "../server/client.hpp"
 #include "../utils/utils.hpp"
 #include <iostream>
-#include <sys/socket.h>
 #include <algorithm>
 
-std::string PubSubCommands::handle_subscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
-    if (args.size() < 2) return "-ERR wrong number of arguments for 'subscribe' command\r\n";
+static std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.length()) + "\r\n" + s + "\r\n";
+}
+
+// Replies to (P)SUBSCRIBE and (P)UNSUBSCRIBE report channels and patterns
+// together; shard channels are counted on their own, as in Redis.
+static size_t subscription_count(const Client& client) {
+    return client.subscriptions.size() + client.patterns.size();
+}
+
+static size_t reply_count(const Client& client, bool sharded) {
+    return sharded ? client.shard_subscriptions.size() : subscription_count(client);
+}
+
+static std::string subscribe(ChannelRegistry& registry, std::unordered_set<std::string>& joined,
+                             const std::shared_ptr<Client>& client, const std::vector<std::string>& args, bool sharded) {
+    std::string kind = sharded ? "ssubscribe" : "subscribe";
+    if (args.size() < 2) return "-ERR wrong number of arguments for '" + kind + "' command\r\n";
 
     std::string response;
 
     for (size_t i = 1; i < args.size(); ++i) {
-        std::string channel = args[i];
-        
-        client->subscriptions.insert(channel);
+        const std::string& channel = args[i];
 
-        {
-            std::lock_guard<std::mutex> lock(db.pubsub_mutex);
-            db.pubsub_channels[channel].insert(client.get());
+        if (joined.insert(channel).second) {
+            registry.subscribe(channel, client);
         }
 
-        response += "*3\r\n";
-        response += "$9\r\nsubscribe\r\n";
-        response += "$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n";
-        response += ":" + std::to_string(client->subscriptions.size()) + "\r\n";
+        response += "*3\r\n" + bulk(kind) + bulk(channel);
+        response += ":" + std::to_string(reply_count(*client, sharded)) + "\r\n";
     }
 
     return response;
 }
 
-std::string PubSubCommands::handle_unsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
-    std::vector<std::string> channels_to_process;
+static std::string unsubscribe(ChannelRegistry& registry, std::unordered_set<std::string>& joined,
+                               const std::shared_ptr<Client>& client, const std::vector<std::string>& args, bool sharded) {
+    std::string kind = sharded ? "sunsubscribe" : "unsubscribe";
+    std::vector<std::string> channels_to_process(args.begin() + 1, args.end());
 
-    if (args.size() > 1) {
-        for (size_t i = 1; i < args.size(); ++i) {
-            channels_to_process.push_back(args[i]);
-        }
-    } else {
-        if (client->subscriptions.empty()) {
-             return "*3\r\n$11\r\nunsubscribe\r\n$-1\r\n:0\r\n";
-        }
-        for (const auto& channel : client->subscriptions) {
-            channels_to_process.push_back(channel);
+    if (channels_to_process.empty()) {
+        if (joined.empty()) {
+            return "*3\r\n" + bulk(kind) + "$-1\r\n:" + std::to_string(reply_count(*client, sharded)) + "\r\n";
         }
+        channels_to_process.assign(joined.begin(), joined.end());
     }
 
     std::string response;
 
     for (const auto& channel : channels_to_process) {
-        bool was_subscribed = false;
-        
-        auto it = client->subscriptions.find(channel);
-        if (it != client->subscriptions.end()) {
-            client->subscriptions.erase(it);
-            was_subscribed = true;
+        if (joined.erase(channel) > 0) {
+            registry.unsubscribe(channel, client.get());
+        }
+
+        response += "*3\r\n" + bulk(kind) + bulk(channel);
+        response += ":" + std::to_string(reply_count(*client, sharded)) + "\r\n";
+    }
+
+    return response;
+}
+
+std::string PubSubCommands::handle_subscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    return subscribe(db.pubsub_channels, client->subscriptions, client, args, false);
+}
+
+std::string PubSubCommands::handle_unsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    return unsubscribe(db.pubsub_channels, client->subscriptions, client, args, false);
+}
+
+std::string PubSubCommands::handle_ssubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    return subscribe(db.pubsub_shard_channels, client->shard_subscriptions, client, args, true);
+}
+
+std::string PubSubCommands::handle_sunsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    return unsubscribe(db.pubsub_shard_channels, client->shard_subscriptions, client, args, true);
+}
+
+std::string PubSubCommands::handle_psubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    if (args.size() < 2) return "-ERR wrong number of arguments for 'psubscribe' command\r\n";
+
+    std::string response;
+
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& pattern = args[i];
+
+        if (client->patterns.insert(pattern).second) {
+            std::lock_guard<std::mutex> lock(db.pubsub_mutex);
+            db.pubsub_patterns.add(pattern, client);
         }
-        if (was_subscribed) {
+
+        response += "*3\r\n$10\r\npsubscribe\r\n" + bulk(pattern);
+        response += ":" + std::to_string(subscription_count(*client)) + "\r\n";
+    }
+
+    return response;
+}
+
+std::string PubSubCommands::handle_punsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    std::vector<std::string> patterns_to_process(args.begin() + 1, args.end());
+
+    if (patterns_to_process.empty()) {
+        if (client->patterns.empty()) {
+            return "*3\r\n$12\r\npunsubscribe\r\n$-1\r\n:" + std::to_string(subscription_count(*client)) + "\r\n";
+        }
+        patterns_to_process.assign(client->patterns.begin(), client->patterns.end());
+    }
+
+    std::string response;
+
+    for (const auto& pattern : patterns_to_process) {
+        if (client->patterns.erase(pattern) > 0) {
             std::lock_guard<std::mutex> lock(db.pubsub_mutex);
-            auto db_it = db.pubsub_channels.find(channel);
-            if (db_it != db.pubsub_channels.end()) {
-                db_it->second.erase(client.get());
-                if (db_it->second.empty()) {
-                    db.pubsub_channels.erase(db_it);
-                }
-            }
+            db.pubsub_patterns.remove(pattern, client.get());
         }
 
-        response += "*3\r\n";
-        response += "$11\r\nunsubscribe\r\n";
-        response += "$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n";
-        response += ":" + std::to_string(client->subscriptions.size()) + "\r\n";
+        response += "*3\r\n$12\r\npunsubscribe\r\n" + bulk(pattern);
+        response += ":" + std::to_string(subscription_count(*client)) + "\r\n";
     }
 
     return response;
 }
 
 std::string PubSubCommands::handle_publish(Database& db, const std::vector<std::string>& args) {
-    if (args.size() < 3) return "-ERR wrong number of arguments for 'publish' command\r\n";
+    if (args.size() != 3) return "-ERR wrong number of arguments for 'publish' command\r\n";
 
-    std::string channel = args[1];
-    std::string message = args[2];
-    int subscriber_count = 0;
+    return ":" + std::to_string(db.publish(args[1], args[2])) + "\r\n";
+}
 
-    std::string push_msg = "*3\r\n$7\r\nmessage\r\n$" + std::to_string(channel.length()) + "\r\n" + channel + "\r\n$" + std::to_string(message.length()) + "\r\n" + message + "\r\n";
+std::string PubSubCommands::handle_spublish(Database& db, const std::vector<std::string>& args) {
+    if (args.size() != 3) return "-ERR wrong number of arguments for 'spublish' command\r\n";
 
-    {
+    return ":" + std::to_string(db.spublish(args[1], args[2])) + "\r\n";
+}
+
+std::string PubSubCommands::handle_pubsub(Database& db, const std::vector<std::string>& args) {
+    if (args.size() < 2) return "-ERR wrong number of arguments for 'pubsub' command\r\n";
+
+    std::string sub = to_upper(args[1]);
+
+    if (sub == "NUMPAT" && args.size() == 2) {
         std::lock_guard<std::mutex> lock(db.pubsub_mutex);
-        auto it = db.pubsub_channels.find(channel);
-        if (it != db.pubsub_channels.end()) {
-            auto& clients = it->second;
-            subscriber_count = clients.size();
-            for (auto* client : clients) {
-                if (client->fd > 0) {
-                    send(client->fd, push_msg.c_str(), push_msg.size(), 0);
-                }
-            }
+        return ":" + std::to_string(db.pubsub_patterns.size()) + "\r\n";
+    }
+    if (sub == "NUMSUB" || sub == "SHARDNUMSUB") {
+        const ChannelRegistry& registry = (sub == "NUMSUB") ? db.pubsub_channels : db.pubsub_shard_channels;
+        std::string response = "*" + std::to_string((args.size() - 2) * 2) + "\r\n";
+        for (size_t i = 2; i < args.size(); ++i) {
+            response += bulk(args[i]) + ":" + std::to_string(registry.count(args[i])) + "\r\n";
         }
+        return response;
+    }
+    if ((sub == "CHANNELS" || sub == "SHARDCHANNELS") && args.size() <= 3) {
+        const ChannelRegistry& registry = (sub == "CHANNELS") ? db.pubsub_channels : db.pubsub_shard_channels;
+        std::string body;
+        size_t count = 0;
+        registry.for_each_channel([&](const std::string& channel) {
+            if (args.size() == 3 && !string_match(args[2], channel)) return;
+            body += bulk(channel);
+            count++;
+        });
+        return "*" + std::to_string(count) + "\r\n" + body;
     }
 
-    return ":" + std::to_string(subscriber_count) + "\r\n";
-}
\ No newline at end of file
+    return "-ERR unknown subcommand or wrong number of arguments for '" + args[1] + "'. Try PUBSUB HELP.\r\n";
+}
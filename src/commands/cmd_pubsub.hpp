@@ -10,5 +10,11 @@ class PubSubCommands {
 public:
     static std::string handle_subscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
     static std::string handle_unsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+    static std::string handle_ssubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+    static std::string handle_sunsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+    static std::string handle_psubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+    static std::string handle_punsubscribe(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
     static std::string handle_publish(Database& db, const std::vector<std::string>& args);
+    static std::string handle_spublish(Database& db, const std::vector<std::string>& args);
+    static std::string handle_pubsub(Database& db, const std::vector<std::string>& args);
 };
\ No newline at end of file
@@ -1,33 +1,357 @@
 #include "cmd_replication.hpp"
 #include "../utils/utils.hpp"
 #include "../server/client.hpp"
+#include "../db/rdb_writer.hpp"
+#include "../db/persistence.hpp"
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
 #include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <unistd.h>
 
+// Opens an anonymous temp file for a snapshot, in the data directory if it is
+// writable and in /tmp otherwise. The name is unlinked at once, so nothing is
+// left behind if the server dies mid-sync.
+static int open_snapshot_file(const std::string& dir) {
+    for (const std::string& candidate : {dir, std::string("/tmp")}) {
+        std::string path = candidate + "/temp-repl-XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd >= 0) {
+            unlink(path.c_str());
+            return fd;
+        }
+    }
+    return -1;
+}
+
+static std::string replication_info(Database& db) {
+    std::lock_guard<std::mutex> lock(db.replication_mutex);
+    const ServerConfig& config = db.config;
+
+    std::string content = "role:" + config.role + "\r\n";
+    if (config.role == "slave") {
+        content += "master_host:" + config.master_host + "\r\n";
+        content += "master_port:" + std::to_string(config.master_port) + "\r\n";
+        content += "master_link_status:" + std::string(db.master_link_up ? "up" : "down") + "\r\n";
+        content += "slave_repl_offset:" + std::to_string(db.bytes_processed) + "\r\n";
+    }
+    content += "master_replid:" + config.master_replid + "\r\n";
+    content += "master_replid2:" + config.master_replid2 + "\r\n";
+    content += "master_repl_offset:" + std::to_string(config.master_repl_offset) + "\r\n";
+    content += "second_repl_offset:" + std::to_string(config.second_repl_offset) + "\r\n";
+    content += "repl_backlog_active:" + std::string(db.repl_backlog ? "1" : "0") + "\r\n";
+    content += "repl_backlog_size:" + std::to_string(config.repl_backlog_size) + "\r\n";
+    content += "repl_backlog_first_byte_offset:" + std::to_string(db.repl_backlog ? db.repl_backlog->start_offset() + 1 : 0) + "\r\n";
+    content += "repl_backlog_histlen:" + std::to_string(db.repl_backlog ? db.repl_backlog->size() : 0) + "\r\n";
+
+    // lag is seconds since the replica's last REPLCONF ACK; offset_lag is how
+    // many stream bytes it has yet to acknowledge.
+    long long now = current_time_ms();
+    std::string replica_lines;
+    int connected = 0;
+    for (const auto& weak : db.replicas) {
+        auto replica = weak.lock();
+        if (!replica) continue;
+
+        sockaddr_in addr = {};
+        socklen_t addr_len = sizeof(addr);
+        char ip[INET_ADDRSTRLEN] = "?";
+        if (getpeername(replica->fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) == 0) {
+            inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        }
+        long long lag = replica->repl_ack_time ? (now - replica->repl_ack_time) / 1000 : -1;
+
+        replica_lines += "slave" + std::to_string(connected++) + ":ip=" + ip +
+                         ",port=" + std::to_string(replica->repl_listening_port) +
+                         ",state=" + replica->repl_state +
+                         ",offset=" + std::to_string(replica->repl_offset) +
+                         ",lag=" + std::to_string(lag) +
+                         ",offset_lag=" + std::to_string(config.master_repl_offset - replica->repl_offset) + "\r\n";
+    }
+    content += "connected_slaves:" + std::to_string(connected) + "\r\n" + replica_lines;
+    return content;
+}
+
+// Serves PSYNC <replid> <offset> from the backlog when the replica followed
+// our current history, or the previous one up to the point we left it, and
+// everything after its offset is still retained. The offset is that of the
+// next byte the replica needs, i.e. its processed count plus one. The reply
+// and the missing bytes are queued under replication_mutex, the same lock
+// propagation takes, so the replica's stream has no gap or overlap.
+static bool try_partial_resync(Database& db, std::shared_ptr<Client> client, const std::string& replid, const std::string& offset_str) {
+    long long psync_offset;
+    try {
+        psync_offset = std::stoll(offset_str);
+    } catch (...) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(db.replication_mutex);
+    if (!db.repl_backlog) return false;
+
+    bool same_history = (replid == db.config.master_replid);
+    bool previous_history = (replid == db.config.master_replid2 && psync_offset <= db.config.second_repl_offset);
+    if (!same_history && !previous_history) return false;
+
+    std::string missing = "+CONTINUE " + db.config.master_replid + "\r\n";
+    if (!db.repl_backlog->copy_from(psync_offset - 1, missing)) return false;
+
+    client->enqueue(std::make_shared<const std::string>(std::move(missing)));
+    client->repl_state = "online";
+    db.replica_acked(*client, psync_offset - 1);
+    db.replicas.push_back(client);
+    return true;
+}
+
+// Sends +FULLRESYNC followed by a point-in-time RDB of the keyspace. The
+// snapshot is taken by a forked child while no write is between execution
+// and propagation, and the replica is registered at that same instant, so
+// every later write lands in its output queue and is flushed once the
+// payload has gone out. Other clients only wait for the fork itself.
+static std::string full_resync(Database& db, std::shared_ptr<Client> client) {
+    int snapshot_fd = open_snapshot_file(db.config.dir);
+    if (snapshot_fd < 0) return "-ERR unable to create snapshot file\r\n";
+
+    pid_t child;
+    long long offset;
+    std::string replid;
+    {
+        std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+        {
+            std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+            child = RDBWriter::fork_snapshot(db, snapshot_fd);
+        }
+        if (child < 0) {
+            close(snapshot_fd);
+            return "-ERR unable to fork snapshot process\r\n";
+        }
+
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        offset = db.config.master_repl_offset;
+        replid = db.config.master_replid;
+        client->repl_state = "wait_bgsave";
+        db.replicas.push_back(client);
+        if (!db.repl_backlog) {
+            db.repl_backlog = std::make_unique<ReplicationBacklog>(db.config.repl_backlog_size, offset);
+        }
+    }
+
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+
+    struct stat st;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || fstat(snapshot_fd, &st) != 0) {
+        std::cerr << "Snapshot for full resync failed\n";
+        close(snapshot_fd);
+        shutdown(client->fd, SHUT_RDWR);
+        return "";
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        client->repl_state = "send_bulk";
+    }
+
+    std::string header = "+FULLRESYNC " + replid + " " + std::to_string(offset) + "\r\n";
+    header += "$" + std::to_string(st.st_size) + "\r\n";
+    bool ok = client->send_all(header.data(), header.size());
+
+    char chunk[64 * 1024];
+    off_t sent = 0;
+    while (ok && sent < st.st_size) {
+        ssize_t n = pread(snapshot_fd, chunk, sizeof(chunk), sent);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        ok = client->send_all(chunk, n);
+        sent += n;
+    }
+    close(snapshot_fd);
+
+    if (!ok) {
+        shutdown(client->fd, SHUT_RDWR);
+        return "";
+    }
+
+    std::lock_guard<std::mutex> lock(db.replication_mutex);
+    client->repl_state = "online";
+    return "";
+}
+
+// Streams one snapshot to every replica that asks for a full sync within
+// repl-diskless-sync-delay of the first, without touching disk. The forked
+// child writes the RDB into a pipe and this thread copies it to each replica
+// socket. The size is not known upfront, so the payload is framed as
+// "$EOF:<mark>" and ends with the same 40-byte mark. The other replicas'
+// threads stay parked on the job until the transfer is over, so nothing they
+// have queued can overtake the payload, and so this thread may use their
+// send_all.
+static std::string diskless_full_resync(Database& db, std::shared_ptr<Client> client) {
+    std::shared_ptr<DisklessSync> job;
+    {
+        std::unique_lock<std::mutex> lock(db.replication_mutex);
+        client->repl_state = "wait_bgsave";
+        if (db.diskless_sync) {
+            job = db.diskless_sync;
+            job->replicas.push_back(client);
+            job->cv.notify_all();
+            job->cv.wait(lock, [&] { return job->finished; });
+            return "";
+        }
+
+        job = std::make_shared<DisklessSync>();
+        job->replicas.push_back(client);
+        db.diskless_sync = job;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(db.config.repl_diskless_sync_delay);
+        job->cv.wait_until(lock, deadline, [&] {
+            int max_replicas = db.config.repl_diskless_sync_max_replicas;
+            return max_replicas > 0 && job->replicas.size() >= static_cast<size_t>(max_replicas);
+        });
+    }
+
+    int pipefd[2] = {-1, -1};
+    pid_t child = -1;
+    long long offset = 0;
+    std::string replid;
+    std::vector<std::shared_ptr<Client>> replicas;
+    {
+        std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+        if (pipe2(pipefd, O_CLOEXEC) == 0) {
+            {
+                std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+                child = RDBWriter::fork_snapshot(db, pipefd[1]);
+            }
+            close(pipefd[1]);
+        }
+
+        // Replicas arriving from here on start the next job.
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        db.diskless_sync.reset();
+        replicas = job->replicas;
+
+        if (child < 0) {
+            if (pipefd[0] >= 0) close(pipefd[0]);
+            for (auto& replica : replicas) shutdown(replica->fd, SHUT_RDWR);
+            job->finished = true;
+            job->cv.notify_all();
+            std::cerr << "Unable to start diskless snapshot\n";
+            return "";
+        }
+
+        offset = db.config.master_repl_offset;
+        replid = db.config.master_replid;
+        for (auto& replica : replicas) {
+            replica->repl_state = "send_bulk";
+            db.replicas.push_back(replica);
+        }
+        if (!db.repl_backlog) {
+            db.repl_backlog = std::make_unique<ReplicationBacklog>(db.config.repl_backlog_size, offset);
+        }
+    }
+
+    std::string mark = random_hex(40);
+    std::string header = "+FULLRESYNC " + replid + " " + std::to_string(offset) + "\r\n$EOF:" + mark + "\r\n";
+    std::vector<bool> alive(replicas.size());
+    size_t alive_count = 0;
+    for (size_t i = 0; i < replicas.size(); ++i) {
+        alive[i] = replicas[i]->send_all(header.data(), header.size());
+        if (alive[i]) alive_count++;
+    }
+
+    char chunk[64 * 1024];
+    while (alive_count > 0) {
+        ssize_t n = read(pipefd[0], chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (size_t i = 0; i < replicas.size(); ++i) {
+            if (alive[i] && !replicas[i]->send_all(chunk, n)) {
+                alive[i] = false;
+                alive_count--;
+            }
+        }
+    }
+    // With every replica gone nobody is reading, and the child holds its own
+    // copy of the read end, so it would block on a full pipe forever.
+    if (alive_count == 0) kill(child, SIGKILL);
+    close(pipefd[0]);
+
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+    bool snapshot_ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!snapshot_ok && alive_count > 0) std::cerr << "Snapshot for diskless full resync failed\n";
+
+    for (size_t i = 0; i < replicas.size(); ++i) {
+        if (alive[i]) alive[i] = snapshot_ok && replicas[i]->send_all(mark.data(), mark.size());
+    }
+
+    std::lock_guard<std::mutex> lock(db.replication_mutex);
+    for (size_t i = 0; i < replicas.size(); ++i) {
+        if (alive[i]) replicas[i]->repl_state = "online";
+        else shutdown(replicas[i]->fd, SHUT_RDWR);
+    }
+    job->finished = true;
+    job->cv.notify_all();
+    return "";
+}
+
+// Waits until needed replicas have processed the stream up to client's last
+// write, or timeout_ms passes (0 waits forever), and returns how many have.
+// Without block it only asks for the missing ACKs. Only this client's own
+// writes need acknowledging, so concurrent waiters mostly share a target
+// that one GETACK already covers.
+static int wait_for_replicas(Database& db, Client& client, int needed, bool block, long long timeout_ms) {
+    std::unique_lock<std::mutex> lock(db.replication_mutex);
+    long long target_offset = client.repl_write_offset;
+    int acked = db.count_replicas_acked(target_offset);
+    if (acked >= needed) return acked;
+
+    // A replica answers GETACK with everything it has processed before
+    // it, so one GETACK serves every waiter whose target it follows.
+    // GETACK travels in the replication stream like any write, so
+    // replica offsets keep matching the backlog.
+    if (db.getack_offset < target_offset) {
+        db.getack_offset = db.config.master_repl_offset;
+        db.feed_replicas(std::make_shared<const std::string>("*3\r\n$8\r\nREPLCONF\r\n$6\r\nGETACK\r\n$1\r\n*\r\n"));
+    }
+    if (!block) return acked;
+
+    auto request = std::make_shared<WaitRequest>();
+    request->needed = needed;
+    request->acked = acked;
+    auto it = db.wait_requests.emplace(target_offset, request);
+
+    auto satisfied = [&] { return request->acked >= request->needed; };
+    if (timeout_ms == 0) request->cv.wait(lock, satisfied);
+    else request->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), satisfied);
+    db.wait_requests.erase(it);
+
+    return db.count_replicas_acked(target_offset);
+}
+
 std::string ReplicationCommands::handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
     std::string command = to_upper(args[0]);
 
     if (command == "INFO") {
-        std::string section = "default";
-        if (args.size() > 1) {
-            section = to_upper(args[1]);
-        }
+        std::string section = args.size() > 1 ? to_lower(args[1]) : "default";
+        bool all = (section == "default" || section == "all" || section == "everything");
 
-        if (section == "REPLICATION") {
-            std::string content = "role:" + db.config.role + "\r\n";
-            content += "master_replid:" + db.config.master_replid + "\r\n";
-            content += "master_repl_offset:" + std::to_string(db.config.master_repl_offset) + "\r\n";
-            
-            return "$" + std::to_string(content.length()) + "\r\n" + content + "\r\n";
+        std::string content;
+        if (all || section == "persistence") content += "# Persistence\r\n" + Persistence::info(db);
+        if (all || section == "replication") {
+            if (!content.empty()) content += "\r\n";
+            content += "# Replication\r\n" + replication_info(db);
         }
-        
-        std::string content = "role:" + db.config.role + "\r\n";
-        content += "master_replid:" + db.config.master_replid + "\r\n";
-        content += "master_repl_offset:" + std::to_string(db.config.master_repl_offset) + "\r\n";
-        
         return "$" + std::to_string(content.length()) + "\r\n" + content + "\r\n";
     }
     else if (command == "REPLCONF") {
@@ -37,90 +361,139 @@ std::string ReplicationCommands::handle(Database& db, std::shared_ptr<Client> cl
         }
         
         if (args.size() > 2 && to_upper(args[1]) == "ACK") {
-             long long ack_offset = std::stoll(args[2]);
-             
-             {
-                 std::lock_guard<std::mutex> lock(db.replication_mutex);
-                 client->repl_offset = ack_offset;
+             long long ack_offset;
+             try {
+                 ack_offset = std::stoll(args[2]);
+             } catch (...) {
+                 return "";
              }
-             
-             db.wait_cv.notify_all();
+
+             std::lock_guard<std::mutex> lock(db.replication_mutex);
+             db.replica_acked(*client, ack_offset);
+             client->repl_ack_time = current_time_ms();
              return "";
         }
 
+        if (args.size() > 2 && to_lower(args[1]) == "capa") {
+            std::lock_guard<std::mutex> lock(db.replication_mutex);
+            for (size_t i = 2; i < args.size(); i += 2) {
+                if (to_lower(args[i]) == "eof") client->repl_capa_eof = true;
+            }
+        }
+
+        if (args.size() > 2 && to_lower(args[1]) == "listening-port") {
+            std::lock_guard<std::mutex> lock(db.replication_mutex);
+            try {
+                client->repl_listening_port = std::stoi(args[2]);
+            } catch (...) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+        }
+
         return "+OK\r\n";
     }
     else if (command == "PSYNC") {
-        std::string master_replid = db.config.master_replid;
-        std::string master_offset = "0";
-
-        std::string response = "+FULLRESYNC " + master_replid + " " + master_offset + "\r\n";
-
-        std::string empty_rdb_hex = "524544495330303131fa0972656469732d76657205372e322e30fa0a72656469732d62697473c040fa056374696d65c26d08bc65fa08757365642d6d656dc2b0c41000fa08616f662d62617365c000fff06e3bfec0ff5aa2";
-        std::string rdb_content = hex_to_bytes(empty_rdb_hex);
-
-        response += "$" + std::to_string(rdb_content.length()) + "\r\n";
-        response += rdb_content;
-
+        if (args.size() < 3) return "-ERR wrong number of arguments for 'psync' command\r\n";
         {
             std::lock_guard<std::mutex> lock(db.replication_mutex);
-            db.replicas.push_back(client);
+            if (db.config.role == "slave" && !db.master_link_up) {
+                return "-NOMASTERLINK Can't SYNC while not connected with my master\r\n";
+            }
+        }
+        if (try_partial_resync(db, client, args[1], args[2])) return "";
+        if (db.config.repl_diskless_sync && client->repl_capa_eof) return diskless_full_resync(db, client);
+        return full_resync(db, client);
+    }
+    else if (command == "REPLICAOF" || command == "SLAVEOF") {
+        if (args.size() != 3) return "-ERR wrong number of arguments for '" + to_lower(args[0]) + "' command\r\n";
+        if (to_upper(args[1]) != "NO" || to_upper(args[2]) != "ONE") {
+            return "-ERR REPLICAOF only supports NO ONE; start the server with --replicaof to follow a master\r\n";
         }
 
-        return response;
+        // propagation_mutex keeps the master link between two batches, and
+        // it stops applying once it sees the new role.
+        std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        if (db.config.role == "master") return "+OK\r\n";
+
+        // The new history continues from what we applied of the old one,
+        // so sibling replicas at that offset can switch over with +CONTINUE.
+        // Our backlog already holds the forwarded stream up to that point;
+        // our own replicas reconnect to learn the new ID.
+        db.config.role = "master";
+        db.config.master_repl_offset = db.bytes_processed;
+        db.shift_replication_id();
+        if (!db.repl_backlog) {
+            db.repl_backlog = std::make_unique<ReplicationBacklog>(db.config.repl_backlog_size, db.config.master_repl_offset);
+        }
+        db.disconnect_replicas();
+        if (db.master_link_fd >= 0) shutdown(db.master_link_fd, SHUT_RDWR);
+        return "+OK\r\n";
     }
     else if (command == "WAIT") {
-        if (args.size() < 3) return "-ERR wrong number of arguments for 'wait' command\r\n";
-        
-        int req_replicas = std::stoi(args[1]);
-        int timeout_ms = std::stoi(args[2]);
-        long long target_offset = db.config.master_repl_offset;
+        if (args.size() != 3) return "-ERR wrong number of arguments for 'wait' command\r\n";
 
-        if (target_offset == 0 || req_replicas == 0) {
-             int connected = 0;
-             std::lock_guard<std::mutex> lock(db.replication_mutex);
-             for(auto& weak : db.replicas) { if(!weak.expired()) connected++; }
-             return ":" + std::to_string(connected) + "\r\n";
+        int req_replicas;
+        long long timeout_ms;
+        try {
+            req_replicas = std::stoi(args[1]);
+            timeout_ms = std::stoll(args[2]);
+        } catch (...) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (timeout_ms < 0) return "-ERR timeout is negative\r\n";
+
+        // Inside EXEC the keyspace is held, so report without blocking.
+        int acked = wait_for_replicas(db, *client, req_replicas, !client->in_multi, timeout_ms);
+        return ":" + std::to_string(acked) + "\r\n";
+    }
+    else if (command == "WAITAOF") {
+        if (args.size() != 4) return "-ERR wrong number of arguments for 'waitaof' command\r\n";
+
+        int req_local, req_replicas;
+        long long timeout_ms;
+        try {
+            req_local = std::stoi(args[1]);
+            req_replicas = std::stoi(args[2]);
+            timeout_ms = std::stoll(args[3]);
+        } catch (...) {
+            return "-ERR value is not an integer or out of range\r\n";
         }
+        if (timeout_ms < 0) return "-ERR timeout is negative\r\n";
 
+        long long aof_offset;
         {
-            std::string getack_cmd = "*3\r\n$8\r\nREPLCONF\r\n$6\r\nGETACK\r\n$1\r\n*\r\n";
             std::lock_guard<std::mutex> lock(db.replication_mutex);
-            for (auto& weak : db.replicas) {
-                if (auto replica = weak.lock()) {
-                    send(replica->fd, getack_cmd.c_str(), getack_cmd.length(), 0);
-                }
+            if (db.config.role == "slave") {
+                return "-ERR WAITAOF cannot be used with replica instances. Please also note that writes to replicas are just local and are not propagated.\r\n";
             }
+            aof_offset = client->aof_write_offset;
+        }
+        if (req_local > 0 && !db.aof.enabled()) {
+            return "-ERR WAITAOF cannot be used when numlocal is set but appendonly is disabled.\r\n";
         }
 
-        std::unique_lock<std::mutex> lock(db.replication_mutex);
+        // The local fsync comes first, then the replicas get what is left
+        // of the timeout; their ACKs are requested upfront so they arrive
+        // meanwhile. Replicas count once they have processed the client's
+        // writes, as for WAIT.
+        bool block = !client->in_multi;
         auto start = std::chrono::steady_clock::now();
-        int ack_count = 0;
-
-        while (true) {
-            ack_count = 0;
-            auto it = db.replicas.begin();
-            while (it != db.replicas.end()) {
-                if (auto replica = it->lock()) {
-                    if (replica->repl_offset >= target_offset) {
-                        ack_count++;
-                    }
-                    ++it;
-                } else {
-                    it = db.replicas.erase(it);
-                }
-            }
-
-            if (ack_count >= req_replicas) break;
-
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
-            if (elapsed >= timeout_ms) break;
+        if (block) wait_for_replicas(db, *client, req_replicas, false, 0);
+        bool local = db.aof.enabled() && db.aof.is_synced(aof_offset);
+        if (!local && req_local > 0 && block) {
+            local = db.aof.wait_synced_for(aof_offset, timeout_ms) && db.aof.enabled();
+        }
 
-            db.wait_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms - elapsed));
+        long long remaining_ms = timeout_ms;
+        if (timeout_ms > 0) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            remaining_ms = timeout_ms - elapsed.count();
+            if (remaining_ms <= 0) block = false;
         }
+        int acked = wait_for_replicas(db, *client, req_replicas, block, remaining_ms);
 
-        return ":" + std::to_string(ack_count) + "\r\n";
+        return "*2\r\n:" + std::string(local ? "1" : "0") + "\r\n:" + std::to_string(acked) + "\r\n";
     }
 
     return "-ERR unknown command\r\n";
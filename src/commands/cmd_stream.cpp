@@ -5,42 +5,140 @@
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <cstdint>
 
-std::string StreamCommands::handle(Database& db, const std::vector<std::string>& args) {
+void StreamCommands::append_entry_reply(std::string& out, const StreamEntryView& view) {
+    std::string id_str = view.id.to_string();
+    out += "*2\r\n";
+    out += "$" + std::to_string(id_str.length()) + "\r\n" + id_str + "\r\n";
+    out += "*" + std::to_string(view.pairs.size() * 2) + "\r\n";
+    for (const auto& pair : view.pairs) {
+        out += "$" + std::to_string(pair.first.length()) + "\r\n";
+        out.append(pair.first.data(), pair.first.size());
+        out += "\r\n$" + std::to_string(pair.second.length()) + "\r\n";
+        out.append(pair.second.data(), pair.second.size());
+        out += "\r\n";
+    }
+}
+
+namespace {
+
+// Parses MAXLEN|MINID [=|~] threshold [LIMIT count] starting at args[i] and
+// leaves i on the last consumed argument. Returns an error reply on failure.
+std::string parse_trim_options(const std::vector<std::string>& args, size_t& i, StreamTrimSpec& spec) {
+    spec.by_min_id = (to_upper(args[i]) == "MINID");
+    if (++i >= args.size()) return "-ERR syntax error\r\n";
+
+    if (args[i] == "~" || args[i] == "=") {
+        spec.approximate = (args[i] == "~");
+        if (++i >= args.size()) return "-ERR syntax error\r\n";
+    }
+
+    if (spec.by_min_id) {
+        try { spec.min_id = RedisStream::parse_range_id(args[i], false); }
+        catch (...) { return "-ERR Invalid stream ID specified as stream command argument\r\n"; }
+    } else {
+        long long max_len = 0;
+        try { max_len = std::stoll(args[i]); }
+        catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+        if (max_len < 0) return "-ERR The MAXLEN argument must be >= 0.\r\n";
+        spec.max_len = static_cast<uint64_t>(max_len);
+    }
+
+    // Like Redis, approximate trimming evicts at most 100 blocks per call
+    // unless told otherwise.
+    spec.limit = spec.approximate ? 100 * RedisStream::BLOCK_MAX_ENTRIES : 0;
+    if (i + 2 < args.size() && to_upper(args[i + 1]) == "LIMIT") {
+        long long limit = 0;
+        try { limit = std::stoll(args[i + 2]); }
+        catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+        if (limit < 0) return "-ERR The LIMIT argument must be >= 0.\r\n";
+        if (!spec.approximate) return "-ERR syntax error, LIMIT cannot be used without the special ~ option\r\n";
+        spec.limit = static_cast<uint64_t>(limit);
+        i += 2;
+    }
+    return "";
+}
+
+// Where an approximate trim stops depends on block boundaries, which
+// differ on a replica loaded from a snapshot or an AOF replayed over a
+// rewritten base. Once it has run it is propagated as the exact trim to the
+// first entry it kept, or of everything if it kept none.
+std::vector<std::string> exact_trim_args(const Stream& stream) {
+    std::vector<std::string> out;
+    RedisStream::for_each(stream, [&](const StreamEntryView& view) {
+        out = {"MINID", "=", view.id.to_string()};
+        return false;
+    });
+    if (out.empty()) out = {"MAXLEN", "=", "0"};
+    return out;
+}
+
+}
+
+std::string StreamCommands::handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
     std::string command = to_upper(args[0]);
 
     if (command == "XADD") {
-        if (args.size() < 5 || (args.size() - 3) % 2 != 0) {
+        if (args.size() < 5) {
             return "-ERR wrong number of arguments for 'xadd' command\r\n";
         }
 
         std::string key = args[1];
-        std::string id_input = args[2];
+        bool no_mkstream = false;
+        bool trimming = false;
+        StreamTrimSpec trim_spec;
+        size_t trim_begin = 0, trim_end = 0; // trim options in args, inclusive
+        size_t i = 2;
+
+        for (; i < args.size(); ++i) {
+            std::string opt = to_upper(args[i]);
+            if (opt == "NOMKSTREAM") {
+                no_mkstream = true;
+            } else if (opt == "MAXLEN" || opt == "MINID") {
+                trim_begin = i;
+                std::string error = parse_trim_options(args, i, trim_spec);
+                if (!error.empty()) return error;
+                trim_end = i;
+                trimming = true;
+            } else {
+                break;
+            }
+        }
+
+        if (i >= args.size() || (args.size() - i - 1) < 2 || (args.size() - i - 1) % 2 != 0) {
+            return "-ERR wrong number of arguments for 'xadd' command\r\n";
+        }
+
+        std::string id_input = args[i];
         std::vector<std::pair<std::string, std::string>> pairs;
 
-        for (size_t i = 3; i < args.size(); i += 2) {
-            pairs.push_back({args[i], args[i+1]});
+        for (size_t j = i + 1; j < args.size(); j += 2) {
+            pairs.push_back({args[j], args[j+1]});
         }
 
         bool wrong_type = false;
         std::string error_response;
         std::string added_id;
+        std::vector<std::string> exact_trim;
         
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
+            if (it == db.kv_store.end() && no_mkstream) return "$-1\r\n";
+
             try {
                 if (it == db.kv_store.end()) {
                     Entry entry;
                     entry.type = VAL_STREAM;
                     added_id = RedisStream::xadd(entry, id_input, pairs);
-                    db.kv_store[key] = entry;
+                    it = db.kv_store.emplace(key, std::move(entry)).first;
                 } else {
                     if (it->second.type != VAL_STREAM) {
                         wrong_type = true;
@@ -50,6 +148,11 @@ std::string StreamCommands::handle(Database& db, const std::vector<std::string>&
                 }
                 
                 if (!wrong_type) {
+                    db.notify_keyspace_event(NOTIFY_STREAM, "xadd", key);
+                    if (trimming && RedisStream::trim(it->second.stream_val, trim_spec) > 0) {
+                        db.notify_keyspace_event(NOTIFY_STREAM, "xtrim", key);
+                    }
+                    if (trimming && trim_spec.approximate) exact_trim = exact_trim_args(it->second.stream_val);
                     db.notify_blocked_clients(key);
                 }
 
@@ -60,57 +163,132 @@ std::string StreamCommands::handle(Database& db, const std::vector<std::string>&
 
         if (wrong_type) return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
         if (!error_response.empty()) return error_response;
-        
+
+        // Replicas and the AOF get the ID we generated, not a '*' to fill in
+        // with their own clock, and an exact trim.
+        bool auto_id = id_input.find('*') != std::string::npos;
+        if (auto_id || !exact_trim.empty()) {
+            std::vector<std::string> propagated = args;
+            if (auto_id) propagated[i] = added_id;
+            if (!exact_trim.empty()) {
+                propagated.erase(propagated.begin() + trim_begin, propagated.begin() + trim_end + 1);
+                propagated.insert(propagated.begin() + trim_begin, exact_trim.begin(), exact_trim.end());
+            }
+            client->propagate_as(std::move(propagated));
+        }
         return "$" + std::to_string(added_id.length()) + "\r\n" + added_id + "\r\n";
     }
-    else if (command == "XRANGE") {
-        if (args.size() < 4) return "-ERR wrong number of arguments for 'xrange' command\r\n";
+    else if (command == "XTRIM" || command == "XDEL") {
+        if (args.size() < 3 || (command == "XTRIM" && args.size() < 4)) {
+            return "-ERR wrong number of arguments for '" + to_lower(command) + "' command\r\n";
+        }
 
+        StreamTrimSpec trim_spec;
+        std::vector<StreamID> ids;
+
+        if (command == "XTRIM") {
+            std::string strategy = to_upper(args[2]);
+            if (strategy != "MAXLEN" && strategy != "MINID") return "-ERR syntax error\r\n";
+            size_t i = 2;
+            std::string error = parse_trim_options(args, i, trim_spec);
+            if (!error.empty()) return error;
+            if (i + 1 != args.size()) return "-ERR syntax error\r\n";
+        } else {
+            try {
+                for (size_t i = 2; i < args.size(); ++i) ids.push_back(RedisStream::parse_range_id(args[i], false));
+            } catch (...) {
+                return "-ERR Invalid stream ID specified as stream command argument\r\n";
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+        auto it = db.kv_store.find(args[1]);
+
+        if (it != db.kv_store.end() && db.is_expired(it->second)) {
+            db.expire_key(it);
+            it = db.kv_store.end();
+        }
+
+        if (it == db.kv_store.end()) return ":0\r\n";
+        if (it->second.type != VAL_STREAM) {
+            return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+        }
+
+        uint64_t removed = 0;
+        if (command == "XTRIM") {
+            removed = RedisStream::trim(it->second.stream_val, trim_spec);
+            if (trim_spec.approximate) {
+                std::vector<std::string> exact = exact_trim_args(it->second.stream_val);
+                exact.insert(exact.begin(), {"XTRIM", args[1]});
+                client->propagate_as(std::move(exact));
+            }
+        } else {
+            for (const auto& id : ids) removed += RedisStream::delete_entry(it->second.stream_val, id);
+        }
+        if (removed > 0) db.notify_keyspace_event(NOTIFY_STREAM, (command == "XTRIM") ? "xtrim" : "xdel", args[1]);
+        return ":" + std::to_string(removed) + "\r\n";
+    }
+    else if (command == "XRANGE" || command == "XREVRANGE") {
+        if (args.size() != 4 && args.size() != 6) {
+            return "-ERR wrong number of arguments for '" + to_lower(command) + "' command\r\n";
+        }
+
+        bool reverse = (command == "XREVRANGE");
         std::string key = args[1];
-        std::string start = args[2];
-        std::string end = args[3];
-        std::vector<StreamEntry> entries;
-        bool wrong_type = false;
+        size_t limit = SIZE_MAX;
+
+        if (args.size() == 6) {
+            if (to_upper(args[4]) != "COUNT") return "-ERR syntax error\r\n";
+            long long count = 0;
+            try { count = std::stoll(args[5]); } 
+            catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+            limit = (count < 0) ? 0 : static_cast<size_t>(count);
+        }
+
+        StreamID start, end;
+        try {
+            start = RedisStream::parse_range_bound(reverse ? args[3] : args[2], false);
+            end = RedisStream::parse_range_bound(reverse ? args[2] : args[3], true);
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        } catch (...) {
+            return "-ERR Invalid stream ID specified as stream command argument\r\n";
+        }
+
+        std::string body;
+        size_t emitted = 0;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
             if (it != db.kv_store.end()) {
                 if (it->second.type != VAL_STREAM) {
-                    wrong_type = true;
-                } else {
-                    try {
-                        entries = RedisStream::range(it->second, start, end);
-                    } catch (...) {
-                         return "-ERR Invalid stream ID specified as stream command argument\r\n"; 
-                    }
+                    return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
                 }
-            }
-        }
 
-        if (wrong_type) return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
-
-        std::string response = "*" + std::to_string(entries.size()) + "\r\n";
-        for (const auto& entry : entries) {
-            response += "*2\r\n";
-            response += "$" + std::to_string(entry.id_str.length()) + "\r\n" + entry.id_str + "\r\n";
-            response += "*" + std::to_string(entry.pairs.size() * 2) + "\r\n";
-            for (const auto& pair : entry.pairs) {
-                response += "$" + std::to_string(pair.first.length()) + "\r\n" + pair.first + "\r\n";
-                response += "$" + std::to_string(pair.second.length()) + "\r\n" + pair.second + "\r\n";
+                auto emit = [&](const StreamEntryView& view) {
+                    append_entry_reply(body, view);
+                    return ++emitted < limit;
+                };
+                if (limit > 0) {
+                    if (reverse) RedisStream::for_each_in_range_reverse(it->second.stream_val, start, end, emit);
+                    else RedisStream::for_each_in_range(it->second.stream_val, start, end, emit);
+                }
             }
         }
-        return response;
+
+        return "*" + std::to_string(emitted) + "\r\n" + body;
     }
     else if (command == "XREAD") {
         size_t streams_idx = 0;
         long long block_ms = -1;
+        size_t limit = SIZE_MAX;
 
         for (size_t i = 1; i < args.size(); ++i) {
             std::string arg = to_upper(args[i]);
@@ -126,6 +304,17 @@ std::string StreamCommands::handle(Database& db, const std::vector<std::string>&
                 } else {
                     return "-ERR syntax error\r\n";
                 }
+            } else if (arg == "COUNT") {
+                if (i + 1 < args.size()) {
+                    long long count = 0;
+                    try {
+                        count = std::stoll(args[i+1]);
+                    } catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+                    if (count > 0) limit = static_cast<size_t>(count);
+                    i++;
+                } else {
+                    return "-ERR syntax error\r\n";
+                }
             }
         }
 
@@ -141,18 +330,28 @@ std::string StreamCommands::handle(Database& db, const std::vector<std::string>&
         for (size_t i = 0; i < key_count; ++i) keys.push_back(args[streams_idx + 1 + i]);
         for (size_t i = 0; i < key_count; ++i) ids.push_back(args[streams_idx + 1 + key_count + i]);
 
+        // Entries strictly after these IDs are returned; '$' is resolved below.
+        std::vector<StreamID> after(key_count);
+        for (size_t i = 0; i < key_count; ++i) {
+            if (ids[i] == "$") continue;
+            try {
+                after[i] = RedisStream::parse_range_id(ids[i], false);
+            } catch (...) {
+                return "-ERR Invalid stream ID specified as stream command argument\r\n";
+            }
+        }
+
         std::string response;
         bool wrong_type = false;
         
         auto check_streams = [&]() -> std::vector<std::string> {
             std::vector<std::string> responses;
             for (size_t i = 0; i < key_count; ++i) {
-                std::string key = keys[i];
-                std::string id = ids[i]; // This ID is already resolved (e.g., $ replaced by actual ID)
+                const std::string& key = keys[i];
                 auto it = db.kv_store.find(key);
 
                 if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                    db.kv_store.erase(it);
+                    db.expire_key(it);
                     it = db.kv_store.end();
                 }
 
@@ -161,41 +360,38 @@ std::string StreamCommands::handle(Database& db, const std::vector<std::string>&
                         wrong_type = true;
                         return {};
                     }
-                    
-                    try {
-                        auto entries = RedisStream::read(it->second, id);
-                        if (!entries.empty()) {
-                            std::string stream_res = "*2\r\n";
-                            stream_res += "$" + std::to_string(key.length()) + "\r\n" + key + "\r\n";
-                            stream_res += "*" + std::to_string(entries.size()) + "\r\n";
-                            
-                            for (const auto& entry : entries) {
-                                stream_res += "*2\r\n";
-                                stream_res += "$" + std::to_string(entry.id_str.length()) + "\r\n" + entry.id_str + "\r\n";
-                                stream_res += "*" + std::to_string(entry.pairs.size() * 2) + "\r\n";
-                                for (const auto& pair : entry.pairs) {
-                                    stream_res += "$" + std::to_string(pair.first.length()) + "\r\n" + pair.first + "\r\n";
-                                    stream_res += "$" + std::to_string(pair.second.length()) + "\r\n" + pair.second + "\r\n";
-                                }
-                            }
-                            responses.push_back(stream_res);
-                        }
-                    } catch (...) { }
+
+                    StreamID start = after[i];
+                    if (!RedisStream::increment(start)) continue;
+
+                    std::string body;
+                    size_t emitted = 0;
+                    RedisStream::for_each_in_range(it->second.stream_val, start, RedisStream::max_id(),
+                        [&](const StreamEntryView& view) {
+                            append_entry_reply(body, view);
+                            return ++emitted < limit;
+                        });
+
+                    if (emitted > 0) {
+                        std::string stream_res = "*2\r\n";
+                        stream_res += "$" + std::to_string(key.length()) + "\r\n" + key + "\r\n";
+                        stream_res += "*" + std::to_string(emitted) + "\r\n";
+                        stream_res += body;
+                        responses.push_back(std::move(stream_res));
+                    }
                 }
             }
             return responses;
         };
 
-        std::unique_lock<std::mutex> lock(db.kv_mutex);
+        std::unique_lock<std::recursive_mutex> lock(db.kv_mutex);
 
         for (size_t i = 0; i < key_count; ++i) {
             if (ids[i] == "$") {
                 auto it = db.kv_store.find(keys[i]);
                 if (it != db.kv_store.end() && !db.is_expired(it->second) && 
-                    it->second.type == VAL_STREAM && !it->second.stream_val.empty()) {
-                    ids[i] = it->second.stream_val.back().id_str;
-                } else {
-                    ids[i] = "0-0";
+                    it->second.type == VAL_STREAM) {
+                    after[i] = it->second.stream_val.last_id;
                 }
             }
         }
@@ -204,7 +400,9 @@ std::string StreamCommands::handle(Database& db, const std::vector<std::string>&
         
         if (wrong_type) return "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
 
-        if (stream_responses.empty() && block_ms >= 0) {
+        // Inside EXEC the keyspace is held for the whole transaction, so
+        // BLOCK behaves as if it had already timed out.
+        if (stream_responses.empty() && block_ms >= 0 && !client->in_multi) {
             auto blocker = std::make_shared<BlockedClient>();
             for (const auto& key : keys) {
                 db.blocking_keys[key].push(blocker);
@@ -1,9 +1,15 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <memory>
 #include "../db/database.hpp"
 
+class Client;
+
+struct StreamEntryView;
+
 class StreamCommands {
 public:
-    static std::string handle(Database& db, const std::vector<std::string>& args);
+    static std::string handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+    static void append_entry_reply(std::string& out, const StreamEntryView& view);
 };
\ No newline at end of file
@@ -0,0 +1,750 @@
+#include "cmd_stream_group.hpp"
+#include "cmd_stream.hpp"
+#include "../utils/utils.hpp"
+#include "../db/structs/redis_stream.hpp"
+#include "../server/client.hpp"
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <set>
+
+namespace {
+
+const std::string WRONGTYPE_ERR = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+const std::string INVALID_ID_ERR = "-ERR Invalid stream ID specified as stream command argument\r\n";
+
+std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.length()) + "\r\n" + s + "\r\n";
+}
+
+std::string integer(long long value) {
+    return ":" + std::to_string(value) + "\r\n";
+}
+
+// Returns the stream stored at key, or nullptr if there is none.
+Entry* find_stream(Database& db, const std::string& key, bool& wrong_type) {
+    auto it = db.kv_store.find(key);
+    if (it != db.kv_store.end() && db.is_expired(it->second)) {
+        db.expire_key(it);
+        return nullptr;
+    }
+    if (it == db.kv_store.end()) return nullptr;
+    if (it->second.type != VAL_STREAM) {
+        wrong_type = true;
+        return nullptr;
+    }
+    return &it->second;
+}
+
+StreamConsumerGroup* find_group(Entry* entry, const std::string& name) {
+    if (entry == nullptr) return nullptr;
+    auto it = entry->stream_val.groups.find(name);
+    return (it == entry->stream_val.groups.end()) ? nullptr : &it->second;
+}
+
+std::string nogroup_error(const std::string& key, const std::string& group) {
+    return "-NOGROUP No such key '" + key + "' or consumer group '" + group + "'\r\n";
+}
+
+// Looks up a consumer, creating it (and firing the event for it) if needed.
+StreamConsumer& consumer_for(Database& db, const std::string& key, StreamConsumerGroup& group,
+                             const std::string& name, long long now) {
+    if (!group.consumers.count(name)) db.notify_keyspace_event(NOTIFY_STREAM, "xgroup-createconsumer", key);
+    return RedisStream::get_or_create_consumer(group, name, now);
+}
+
+// Records a change to a group's pending entries or last delivered ID, which
+// fires no keyspace event of its own: it still counts towards the next save
+// and invalidates WATCHes on the key. Callers hold kv_mutex.
+void group_modified(Database& db, const std::string& key) {
+    db.dirty.fetch_add(1, std::memory_order_relaxed);
+    if (!db.watched_keys.empty()) db.touch_watched_key(key);
+}
+
+// What replicas and the AOF replay in place of a delivery or a claim: an
+// XCLAIM that sets the pending entry to the state it has here, so neither
+// their clock nor their idle times come into it.
+void propagate_claim(Client& client, const std::string& key, const std::string& group_name,
+                     const StreamConsumerGroup& group, const StreamID& id) {
+    const StreamPendingEntry& pending = group.pending.at(id);
+    client.propagate_as({"XCLAIM", key, group_name, pending.consumer, "0", id.to_string(),
+                         "TIME", std::to_string(pending.delivery_time),
+                         "RETRYCOUNT", std::to_string(pending.delivery_count),
+                         "FORCE", "JUSTID", "LASTID", group.last_delivered.to_string()});
+}
+
+// Creates a consumer the way replaying the command would not, for a
+// command that propagates nothing else.
+void propagate_consumer(Client& client, const std::string& key, const std::string& group_name,
+                        const std::string& consumer) {
+    client.propagate_as({"XGROUP", "CREATECONSUMER", key, group_name, consumer});
+}
+
+// Accepts '$' for the stream's last ID, otherwise a full or ms-only ID.
+bool parse_group_id(const Stream& stream, const std::string& arg, StreamID& out) {
+    if (arg == "$") {
+        out = stream.last_id;
+        return true;
+    }
+    try {
+        out = RedisStream::parse_range_id(arg, false);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+std::string handle_xgroup(Database& db, const std::vector<std::string>& args) {
+    if (args.size() < 2) return "-ERR wrong number of arguments for 'xgroup' command\r\n";
+    std::string sub = to_upper(args[1]);
+
+    if ((sub == "CREATE" && args.size() < 5) || (sub == "SETID" && args.size() < 5) ||
+        (sub == "DESTROY" && args.size() != 4) ||
+        ((sub == "CREATECONSUMER" || sub == "DELCONSUMER") && args.size() != 5)) {
+        return "-ERR wrong number of arguments for 'xgroup|" + to_lower(sub) + "' command\r\n";
+    }
+    if (sub != "CREATE" && sub != "SETID" && sub != "DESTROY" && sub != "CREATECONSUMER" && sub != "DELCONSUMER") {
+        return "-ERR unknown subcommand '" + args[1] + "'. Try XGROUP HELP.\r\n";
+    }
+
+    const std::string& key = args[2];
+    const std::string& group_name = args[3];
+    bool mkstream = false;
+
+    for (size_t i = 5; sub == "CREATE" && i < args.size(); ++i) {
+        std::string opt = to_upper(args[i]);
+        if (opt == "MKSTREAM") mkstream = true;
+        else if (opt == "ENTRIESREAD" && i + 1 < args.size()) i++;
+        else return "-ERR syntax error\r\n";
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    bool wrong_type = false;
+    Entry* entry = find_stream(db, key, wrong_type);
+    if (wrong_type) return WRONGTYPE_ERR;
+
+    if (entry == nullptr) {
+        if (sub != "CREATE" || !mkstream) {
+            return "-ERR The XGROUP subcommand requires the key to exist. Note that for CREATE you may want to use the MKSTREAM option to create an empty stream automatically.\r\n";
+        }
+        Entry fresh;
+        fresh.type = VAL_STREAM;
+        entry = &(db.kv_store[key] = std::move(fresh));
+    }
+
+    Stream& stream = entry->stream_val;
+
+    if (sub == "CREATE") {
+        StreamID id;
+        if (!parse_group_id(stream, args[4], id)) return INVALID_ID_ERR;
+        if (stream.groups.count(group_name)) return "-BUSYGROUP Consumer Group name already exists\r\n";
+        stream.groups[group_name].last_delivered = id;
+        db.notify_keyspace_event(NOTIFY_STREAM, "xgroup-create", key);
+        return "+OK\r\n";
+    }
+
+    StreamConsumerGroup* group = find_group(entry, group_name);
+    if (group == nullptr) {
+        return "-NOGROUP No such consumer group '" + group_name + "' for key name '" + key + "'\r\n";
+    }
+
+    if (sub == "SETID") {
+        StreamID id;
+        if (!parse_group_id(stream, args[4], id)) return INVALID_ID_ERR;
+        group->last_delivered = id;
+        db.notify_keyspace_event(NOTIFY_STREAM, "xgroup-setid", key);
+        return "+OK\r\n";
+    }
+    if (sub == "DESTROY") {
+        stream.groups.erase(group_name);
+        db.notify_keyspace_event(NOTIFY_STREAM, "xgroup-destroy", key);
+        db.notify_blocked_clients(key);
+        return integer(1);
+    }
+    if (sub == "CREATECONSUMER") {
+        if (group->consumers.count(args[4])) return integer(0);
+        consumer_for(db, key, *group, args[4], current_time_ms());
+        return integer(1);
+    }
+
+    // DELCONSUMER: the consumer's pending entries are dropped with it.
+    auto consumer = group->consumers.find(args[4]);
+    if (consumer == group->consumers.end()) return integer(0);
+    long long pending = static_cast<long long>(consumer->second.pending.size());
+    for (const auto& id : consumer->second.pending) group->pending.erase(id);
+    group->consumers.erase(consumer);
+    db.notify_keyspace_event(NOTIFY_STREAM, "xgroup-delconsumer", key);
+    return integer(pending);
+}
+
+std::string handle_xreadgroup(Database& db, Client& client, const std::vector<std::string>& args) {
+    if (args.size() < 7 || to_upper(args[1]) != "GROUP") {
+        return "-ERR wrong number of arguments for 'xreadgroup' command\r\n";
+    }
+
+    const std::string group_name = args[2];
+    const std::string consumer_name = args[3];
+    size_t streams_idx = 0;
+    long long block_ms = -1;
+    size_t limit = SIZE_MAX;
+    bool noack = false;
+
+    for (size_t i = 4; i < args.size(); ++i) {
+        std::string arg = to_upper(args[i]);
+        if (arg == "STREAMS") {
+            streams_idx = i;
+            break;
+        } else if ((arg == "BLOCK" || arg == "COUNT") && i + 1 < args.size()) {
+            long long value = 0;
+            try {
+                value = std::stoll(args[++i]);
+            } catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+            if (arg == "BLOCK") block_ms = value;
+            else if (value > 0) limit = static_cast<size_t>(value);
+        } else if (arg == "NOACK") {
+            noack = true;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+
+    if (streams_idx == 0) return "-ERR syntax error\r\n";
+    size_t remaining = args.size() - (streams_idx + 1);
+    if (remaining == 0 || remaining % 2 != 0) {
+        return "-ERR Unbalanced 'xreadgroup' list of streams: for each stream key an ID or '>' must be specified.\r\n";
+    }
+
+    size_t key_count = remaining / 2;
+    std::vector<std::string> keys;
+    std::vector<bool> new_only(key_count, false);
+    std::vector<StreamID> after(key_count);
+    bool all_new = true;
+
+    for (size_t i = 0; i < key_count; ++i) {
+        keys.push_back(args[streams_idx + 1 + i]);
+        const std::string& id = args[streams_idx + 1 + key_count + i];
+        if (id == ">") {
+            new_only[i] = true;
+            continue;
+        }
+        all_new = false;
+        try {
+            after[i] = RedisStream::parse_range_id(id, false);
+        } catch (...) {
+            return INVALID_ID_ERR;
+        }
+    }
+
+    std::string error;
+    // Keys whose group got the consumer from this command. Every run of
+    // serve() starts the propagation afresh, and only the first finds the
+    // consumer missing.
+    std::set<std::string> created_consumer;
+
+    // Each delivery is propagated as the XCLAIM it amounts to, and the
+    // group's new last ID with XGROUP SETID; a read that changed nothing
+    // else propagates only the consumer it created.
+    auto serve = [&]() -> std::vector<std::string> {
+        std::vector<std::string> responses;
+        long long now = current_time_ms();
+        client.propagate_replaced = true;
+        client.propagate_args.clear();
+
+        for (size_t i = 0; i < key_count; ++i) {
+            bool wrong_type = false;
+            Entry* entry = find_stream(db, keys[i], wrong_type);
+            if (wrong_type) {
+                error = WRONGTYPE_ERR;
+                return {};
+            }
+            StreamConsumerGroup* group = find_group(entry, group_name);
+            if (group == nullptr) {
+                error = "-NOGROUP No such key '" + keys[i] + "' or consumer group '" + group_name + "' in XREADGROUP with GROUP option\r\n";
+                return {};
+            }
+
+            Stream& stream = entry->stream_val;
+            if (!group->consumers.count(consumer_name)) created_consumer.insert(keys[i]);
+            if (created_consumer.count(keys[i])) propagate_consumer(client, keys[i], group_name, consumer_name);
+            StreamConsumer& consumer = consumer_for(db, keys[i], *group, consumer_name, now);
+            std::string body;
+            size_t emitted = 0;
+
+            if (new_only[i]) {
+                StreamID start = group->last_delivered;
+                if (!RedisStream::increment(start)) continue;
+
+                RedisStream::for_each_in_range(stream, start, RedisStream::max_id(), [&](const StreamEntryView& view) {
+                    StreamCommands::append_entry_reply(body, view);
+                    group->last_delivered = view.id;
+                    if (!noack) {
+                        RedisStream::pel_deliver(*group, view.id, consumer_name, now);
+                        propagate_claim(client, keys[i], group_name, *group, view.id);
+                    }
+                    return ++emitted < limit;
+                });
+                if (emitted == 0) continue;
+                client.propagate_as({"XGROUP", "SETID", keys[i], group_name, group->last_delivered.to_string()});
+                consumer.active_time = now;
+                group_modified(db, keys[i]);
+            } else {
+                // History: re-deliver this consumer's own pending entries.
+                StreamID start = after[i];
+                StreamEntryView view;
+                bool redelivered = false;
+                if (RedisStream::increment(start)) {
+                    for (auto it = consumer.pending.lower_bound(start); it != consumer.pending.end() && emitted < limit; ++it) {
+                        if (RedisStream::find_entry(stream, *it, view)) {
+                            StreamCommands::append_entry_reply(body, view);
+                            StreamPendingEntry& pending = group->pending[*it];
+                            pending.delivery_time = now;
+                            pending.delivery_count++;
+                            propagate_claim(client, keys[i], group_name, *group, *it);
+                            redelivered = true;
+                        } else {
+                            body += "*2\r\n" + bulk(it->to_string()) + "*-1\r\n";
+                        }
+                        emitted++;
+                    }
+                }
+                if (redelivered) group_modified(db, keys[i]);
+            }
+
+            responses.push_back("*2\r\n" + bulk(keys[i]) + "*" + std::to_string(emitted) + "\r\n" + body);
+        }
+        return responses;
+    };
+
+    std::unique_lock<std::recursive_mutex> lock(db.kv_mutex);
+    std::vector<std::string> responses = serve();
+    if (!error.empty()) return error;
+
+    // Inside EXEC the keyspace is held for the whole transaction, so
+    // BLOCK behaves as if it had already timed out.
+    if (responses.empty() && block_ms >= 0 && all_new && !client.in_multi) {
+        auto blocker = std::make_shared<BlockedClient>();
+        for (const auto& key : keys) {
+            db.blocking_keys[key].push(blocker);
+        }
+
+        auto predicate = [&]() {
+            responses = serve();
+            return !responses.empty() || !error.empty();
+        };
+
+        BlockedWriteLock wait_lock(db);
+        if (block_ms == 0) {
+            blocker->cv.wait(wait_lock, predicate);
+        } else {
+            blocker->cv.wait_for(wait_lock, std::chrono::milliseconds(block_ms), predicate);
+        }
+        if (!error.empty()) return error;
+    }
+
+    if (responses.empty()) return "*-1\r\n";
+
+    std::string response = "*" + std::to_string(responses.size()) + "\r\n";
+    for (const auto& r : responses) response += r;
+    return response;
+}
+
+std::string handle_xack(Database& db, const std::vector<std::string>& args) {
+    if (args.size() < 4) return "-ERR wrong number of arguments for 'xack' command\r\n";
+
+    std::vector<StreamID> ids;
+    try {
+        for (size_t i = 3; i < args.size(); ++i) ids.push_back(RedisStream::parse_range_id(args[i], false));
+    } catch (...) {
+        return INVALID_ID_ERR;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    bool wrong_type = false;
+    Entry* entry = find_stream(db, args[1], wrong_type);
+    if (wrong_type) return WRONGTYPE_ERR;
+
+    StreamConsumerGroup* group = find_group(entry, args[2]);
+    if (group == nullptr) return integer(0);
+
+    long long acked = 0;
+    for (const auto& id : ids) acked += RedisStream::pel_ack(*group, id);
+    if (acked > 0) group_modified(db, args[1]);
+    return integer(acked);
+}
+
+std::string handle_xpending(Database& db, const std::vector<std::string>& args) {
+    if (args.size() < 3) return "-ERR wrong number of arguments for 'xpending' command\r\n";
+
+    const std::string& key = args[1];
+    const std::string& group_name = args[2];
+    bool extended = args.size() > 3;
+    long long min_idle = 0;
+    StreamID start, end;
+    long long count = 0;
+    std::string consumer_filter;
+
+    if (extended) {
+        size_t i = 3;
+        if (to_upper(args[i]) == "IDLE") {
+            if (i + 1 >= args.size()) return "-ERR syntax error\r\n";
+            try { min_idle = std::stoll(args[i + 1]); }
+            catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+            i += 2;
+        }
+        if (args.size() - i < 3 || args.size() - i > 4) return "-ERR syntax error\r\n";
+        try {
+            start = RedisStream::parse_range_bound(args[i], false);
+            end = RedisStream::parse_range_bound(args[i + 1], true);
+        } catch (const std::runtime_error& e) {
+            return "-" + std::string(e.what()) + "\r\n";
+        } catch (...) {
+            return INVALID_ID_ERR;
+        }
+        try { count = std::stoll(args[i + 2]); }
+        catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+        if (args.size() - i == 4) consumer_filter = args[i + 3];
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    bool wrong_type = false;
+    Entry* entry = find_stream(db, key, wrong_type);
+    if (wrong_type) return WRONGTYPE_ERR;
+
+    StreamConsumerGroup* group = find_group(entry, group_name);
+    if (group == nullptr) return nogroup_error(key, group_name);
+
+    if (!extended) {
+        if (group->pending.empty()) return "*4\r\n:0\r\n$-1\r\n$-1\r\n*-1\r\n";
+
+        std::string response = "*4\r\n" + integer(static_cast<long long>(group->pending.size()));
+        response += bulk(group->pending.begin()->first.to_string());
+        response += bulk(group->pending.rbegin()->first.to_string());
+
+        std::string consumers;
+        size_t with_pending = 0;
+        for (const auto& [name, consumer] : group->consumers) {
+            if (consumer.pending.empty()) continue;
+            consumers += "*2\r\n" + bulk(name) + bulk(std::to_string(consumer.pending.size()));
+            with_pending++;
+        }
+        return response + "*" + std::to_string(with_pending) + "\r\n" + consumers;
+    }
+
+    long long now = current_time_ms();
+    std::string body;
+    long long emitted = 0;
+
+    auto emit = [&](const StreamID& id, const StreamPendingEntry& pending) {
+        long long idle = now - pending.delivery_time;
+        if (idle < min_idle) return;
+        body += "*4\r\n" + bulk(id.to_string()) + bulk(pending.consumer) + integer(idle) +
+                integer(static_cast<long long>(pending.delivery_count));
+        emitted++;
+    };
+
+    if (count > 0 && start <= end) {
+        if (consumer_filter.empty()) {
+            for (auto it = group->pending.lower_bound(start); it != group->pending.end() && it->first <= end && emitted < count; ++it) {
+                emit(it->first, it->second);
+            }
+        } else {
+            auto consumer = group->consumers.find(consumer_filter);
+            if (consumer != group->consumers.end()) {
+                const auto& ids = consumer->second.pending;
+                for (auto it = ids.lower_bound(start); it != ids.end() && *it <= end && emitted < count; ++it) {
+                    emit(*it, group->pending[*it]);
+                }
+            }
+        }
+    }
+    return "*" + std::to_string(emitted) + "\r\n" + body;
+}
+
+// XCLAIM and XAUTOCLAIM share the ownership transfer.
+struct ClaimOptions {
+    long long idle = -1;
+    long long time = -1;
+    long long retry_count = -1;
+    bool force = false;
+    bool just_id = false;
+};
+
+void claim_entry(StreamConsumerGroup& group, const StreamID& id, const std::string& consumer,
+                 const ClaimOptions& opts, long long now) {
+    StreamPendingEntry& pending = RedisStream::pel_assign(group, id, consumer);
+
+    if (opts.idle >= 0) pending.delivery_time = now - opts.idle;
+    else if (opts.time >= 0) pending.delivery_time = opts.time;
+    else pending.delivery_time = now;
+
+    if (opts.retry_count >= 0) pending.delivery_count = static_cast<uint64_t>(opts.retry_count);
+    else if (!opts.just_id) pending.delivery_count++;
+}
+
+std::string handle_xclaim(Database& db, Client& client, const std::vector<std::string>& args) {
+    if (args.size() < 6) return "-ERR wrong number of arguments for 'xclaim' command\r\n";
+
+    const std::string& key = args[1];
+    const std::string& group_name = args[2];
+    const std::string& consumer_name = args[3];
+    long long min_idle = 0;
+    try { min_idle = std::stoll(args[4]); }
+    catch (...) { return "-ERR Invalid min-idle-time argument for XCLAIM\r\n"; }
+
+    std::vector<StreamID> ids;
+    size_t i = 5;
+    for (; i < args.size(); ++i) {
+        try {
+            ids.push_back(RedisStream::parse_explicit_id(args[i]));
+        } catch (...) {
+            break;
+        }
+    }
+    if (ids.empty()) return INVALID_ID_ERR;
+
+    ClaimOptions opts;
+    bool has_last_id = false;
+    StreamID last_id;
+
+    for (; i < args.size(); ++i) {
+        std::string opt = to_upper(args[i]);
+        bool has_value = i + 1 < args.size();
+        try {
+            if (opt == "FORCE") opts.force = true;
+            else if (opt == "JUSTID") opts.just_id = true;
+            else if (opt == "IDLE" && has_value) opts.idle = std::stoll(args[++i]);
+            else if (opt == "TIME" && has_value) opts.time = std::stoll(args[++i]);
+            else if (opt == "RETRYCOUNT" && has_value) opts.retry_count = std::stoll(args[++i]);
+            else if (opt == "LASTID" && has_value) {
+                try { last_id = RedisStream::parse_range_id(args[++i], false); }
+                catch (...) { return INVALID_ID_ERR; }
+                has_last_id = true;
+            }
+            else return "-ERR Unrecognized XCLAIM option '" + args[i] + "'\r\n";
+        } catch (...) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    bool wrong_type = false;
+    Entry* entry = find_stream(db, key, wrong_type);
+    if (wrong_type) return WRONGTYPE_ERR;
+
+    StreamConsumerGroup* group = find_group(entry, group_name);
+    if (group == nullptr) return nogroup_error(key, group_name);
+
+    // Propagated as one explicit XCLAIM per entry claimed, an XACK per
+    // entry dropped for having been deleted, and whatever else changed.
+    client.propagate_replaced = true;
+    bool last_id_changed = has_last_id && last_id > group->last_delivered;
+    if (last_id_changed) group->last_delivered = last_id;
+
+    long long now = current_time_ms();
+    bool new_consumer = !group->consumers.count(consumer_name);
+    StreamConsumer& consumer = consumer_for(db, key, *group, consumer_name, now);
+    Stream& stream = entry->stream_val;
+    StreamEntryView view;
+    std::string body;
+    size_t claimed = 0;
+    bool dropped = false;
+
+    for (const auto& id : ids) {
+        auto pending = group->pending.find(id);
+        bool exists = RedisStream::find_entry(stream, id, view);
+
+        if (!exists) {
+            // Entries deleted from the stream are dropped from the PEL.
+            if (pending != group->pending.end()) {
+                RedisStream::pel_ack(*group, id);
+                client.propagate_as({"XACK", key, group_name, id.to_string()});
+                dropped = true;
+            }
+            continue;
+        }
+        if (pending == group->pending.end()) {
+            if (!opts.force || id > stream.last_id) continue;
+        } else if (min_idle > 0 && now - pending->second.delivery_time < min_idle) {
+            continue;
+        }
+
+        claim_entry(*group, id, consumer_name, opts, now);
+        propagate_claim(client, key, group_name, *group, id);
+        if (opts.just_id) body += bulk(id.to_string());
+        else StreamCommands::append_entry_reply(body, view);
+        claimed++;
+    }
+
+    if (claimed > 0) {
+        consumer.active_time = now;
+    } else {
+        if (new_consumer) propagate_consumer(client, key, group_name, consumer_name);
+        if (last_id_changed) client.propagate_as({"XGROUP", "SETID", key, group_name, last_id.to_string()});
+    }
+    if (claimed > 0 || dropped || last_id_changed) group_modified(db, key);
+    return "*" + std::to_string(claimed) + "\r\n" + body;
+}
+
+std::string handle_xautoclaim(Database& db, Client& client, const std::vector<std::string>& args) {
+    if (args.size() < 6) return "-ERR wrong number of arguments for 'xautoclaim' command\r\n";
+
+    const std::string& key = args[1];
+    const std::string& group_name = args[2];
+    const std::string& consumer_name = args[3];
+    long long min_idle = 0;
+    StreamID start;
+    long long count = 100;
+    ClaimOptions opts;
+
+    try { min_idle = std::stoll(args[4]); }
+    catch (...) { return "-ERR Invalid min-idle-time argument for XAUTOCLAIM\r\n"; }
+    try { start = RedisStream::parse_range_bound(args[5], false); }
+    catch (...) { return INVALID_ID_ERR; }
+
+    for (size_t i = 6; i < args.size(); ++i) {
+        std::string opt = to_upper(args[i]);
+        if (opt == "JUSTID") {
+            opts.just_id = true;
+        } else if (opt == "COUNT" && i + 1 < args.size()) {
+            try { count = std::stoll(args[++i]); }
+            catch (...) { return "-ERR value is not an integer or out of range\r\n"; }
+            if (count < 1) return "-ERR COUNT must be > 0\r\n";
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    bool wrong_type = false;
+    Entry* entry = find_stream(db, key, wrong_type);
+    if (wrong_type) return WRONGTYPE_ERR;
+
+    StreamConsumerGroup* group = find_group(entry, group_name);
+    if (group == nullptr) return nogroup_error(key, group_name);
+
+    // Propagated like XCLAIM.
+    client.propagate_replaced = true;
+    long long now = current_time_ms();
+    bool new_consumer = !group->consumers.count(consumer_name);
+    StreamConsumer& consumer = consumer_for(db, key, *group, consumer_name, now);
+    Stream& stream = entry->stream_val;
+    StreamEntryView view;
+
+    std::string body;
+    std::string deleted_body;
+    long long claimed = 0;
+    long long deleted = 0;
+    long long attempts = count * 10;
+
+    auto it = group->pending.lower_bound(start);
+    while (it != group->pending.end() && claimed < count && attempts-- > 0) {
+        StreamID id = it->first;
+        long long idle = now - it->second.delivery_time;
+        ++it;
+
+        if (!RedisStream::find_entry(stream, id, view)) {
+            RedisStream::pel_ack(*group, id);
+            client.propagate_as({"XACK", key, group_name, id.to_string()});
+            deleted_body += bulk(id.to_string());
+            deleted++;
+            continue;
+        }
+        if (min_idle > 0 && idle < min_idle) continue;
+
+        claim_entry(*group, id, consumer_name, opts, now);
+        propagate_claim(client, key, group_name, *group, id);
+        if (opts.just_id) body += bulk(id.to_string());
+        else StreamCommands::append_entry_reply(body, view);
+        claimed++;
+    }
+
+    if (claimed > 0) consumer.active_time = now;
+    else if (new_consumer) propagate_consumer(client, key, group_name, consumer_name);
+    if (claimed > 0 || deleted > 0) group_modified(db, key);
+    std::string cursor = (it == group->pending.end()) ? "0-0" : it->first.to_string();
+    return "*3\r\n" + bulk(cursor) + "*" + std::to_string(claimed) + "\r\n" + body +
+           "*" + std::to_string(deleted) + "\r\n" + deleted_body;
+}
+
+std::string handle_xinfo(Database& db, const std::vector<std::string>& args) {
+    if (args.size() < 3) return "-ERR wrong number of arguments for 'xinfo' command\r\n";
+
+    std::string sub = to_upper(args[1]);
+    const std::string& key = args[2];
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    bool wrong_type = false;
+    Entry* entry = find_stream(db, key, wrong_type);
+    if (wrong_type) return WRONGTYPE_ERR;
+    if (entry == nullptr) return "-ERR no such key\r\n";
+
+    const Stream& stream = entry->stream_val;
+    long long now = current_time_ms();
+
+    if (sub == "STREAM" && args.size() == 3) {
+        std::string first, last;
+        RedisStream::for_each(stream, [&](const StreamEntryView& view) {
+            StreamCommands::append_entry_reply(first, view);
+            return false;
+        });
+        RedisStream::for_each_in_range_reverse(stream, StreamID{}, RedisStream::max_id(), [&](const StreamEntryView& view) {
+            StreamCommands::append_entry_reply(last, view);
+            return false;
+        });
+
+        std::string response = "*18\r\n";
+        response += bulk("length") + integer(static_cast<long long>(stream.length));
+        response += bulk("radix-tree-keys") + integer(static_cast<long long>(stream.blocks.size()));
+        response += bulk("radix-tree-nodes") + integer(static_cast<long long>(stream.blocks.size()));
+        response += bulk("last-generated-id") + bulk(stream.last_id.to_string());
+        response += bulk("max-deleted-entry-id") + bulk(stream.max_deleted_id.to_string());
+        response += bulk("entries-added") + integer(static_cast<long long>(stream.entries_added));
+        response += bulk("groups") + integer(static_cast<long long>(stream.groups.size()));
+        response += bulk("first-entry") + (first.empty() ? "$-1\r\n" : first);
+        response += bulk("last-entry") + (last.empty() ? "$-1\r\n" : last);
+        return response;
+    }
+    if (sub == "GROUPS" && args.size() == 3) {
+        std::string response = "*" + std::to_string(stream.groups.size()) + "\r\n";
+        for (const auto& [name, group] : stream.groups) {
+            response += "*8\r\n";
+            response += bulk("name") + bulk(name);
+            response += bulk("consumers") + integer(static_cast<long long>(group.consumers.size()));
+            response += bulk("pending") + integer(static_cast<long long>(group.pending.size()));
+            response += bulk("last-delivered-id") + bulk(group.last_delivered.to_string());
+        }
+        return response;
+    }
+    if (sub == "CONSUMERS" && args.size() == 4) {
+        auto group = stream.groups.find(args[3]);
+        if (group == stream.groups.end()) return nogroup_error(key, args[3]);
+
+        std::string response = "*" + std::to_string(group->second.consumers.size()) + "\r\n";
+        for (const auto& [name, consumer] : group->second.consumers) {
+            response += "*8\r\n";
+            response += bulk("name") + bulk(name);
+            response += bulk("pending") + integer(static_cast<long long>(consumer.pending.size()));
+            response += bulk("idle") + integer(now - consumer.seen_time);
+            response += bulk("inactive") + integer(consumer.active_time < 0 ? -1 : now - consumer.active_time);
+        }
+        return response;
+    }
+    return "-ERR syntax error\r\n";
+}
+
+}
+
+std::string StreamGroupCommands::handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
+    std::string command = to_upper(args[0]);
+
+    if (command == "XGROUP") return handle_xgroup(db, args);
+    if (command == "XREADGROUP") return handle_xreadgroup(db, *client, args);
+    if (command == "XACK") return handle_xack(db, args);
+    if (command == "XPENDING") return handle_xpending(db, args);
+    if (command == "XCLAIM") return handle_xclaim(db, *client, args);
+    if (command == "XAUTOCLAIM") return handle_xautoclaim(db, *client, args);
+    if (command == "XINFO") return handle_xinfo(db, args);
+
+    return "-ERR unknown command\r\n";
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include "../db/database.hpp"
+
+class Client;
+
+class StreamGroupCommands {
+public:
+    static std::string handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+};
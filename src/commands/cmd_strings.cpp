@@ -1,10 +1,11 @@
 #include "cmd_strings.hpp"
 #include "../utils/utils.hpp"
 #include "../db/structs/redis_string.hpp" 
+#include "../server/client.hpp"
 #include <stdexcept>
 #include <iostream>
 
-std::string StringCommands::handle(Database& db, const std::vector<std::string>& args) {
+std::string StringCommands::handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
     std::string command = to_upper(args[0]);
     std::string response;
 
@@ -13,23 +14,42 @@ std::string StringCommands::handle(Database& db, const std::vector<std::string>&
         std::string val = args[2];
         long long expiry = 0;
 
+        size_t px_index = 0;
         for (size_t i = 3; i < args.size(); ++i) {
             std::string opt = to_upper(args[i]);
             if (opt == "PX" && i + 1 < args.size()) {
                 try {
                     long long ms = std::stoll(args[i+1]);
                     expiry = current_time_ms() + ms;
+                    px_index = i;
                     i++; 
                 } catch (...) {}
+            } else if (opt == "PXAT" && i + 1 < args.size()) {
+                try {
+                    expiry = std::stoll(args[i+1]);
+                    i++;
+                } catch (...) {}
             }
         }
+
+        // A relative TTL is propagated as the deadline it resolved to, so it
+        // doesn't restart when a replica or an AOF replay applies it.
+        if (px_index != 0) {
+            std::vector<std::string> absolute = args;
+            absolute[px_index] = "PXAT";
+            absolute[px_index + 1] = std::to_string(expiry);
+            client->propagate_as(std::move(absolute));
+        }
         
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             Entry entry;
             RedisString::set(entry, val);
             entry.expiry_at = expiry;
             db.kv_store[key] = entry;
+
+            db.notify_keyspace_event(NOTIFY_STRING, "set", key);
+            if (expiry != 0) db.notify_keyspace_event(NOTIFY_GENERIC, "expire", key);
         }
         
         response = "+OK\r\n";
@@ -40,12 +60,12 @@ std::string StringCommands::handle(Database& db, const std::vector<std::string>&
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end()) {
                 if (db.is_expired(it->second)) {
-                    db.kv_store.erase(it);
+                    db.expire_key(it);
                 } else {
                     val = RedisString::get(it->second);
                     if (!val.has_value()) wrong_type = true;
@@ -63,11 +83,11 @@ std::string StringCommands::handle(Database& db, const std::vector<std::string>&
         std::string error_msg;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
 
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -80,6 +100,7 @@ std::string StringCommands::handle(Database& db, const std::vector<std::string>&
                 } else {
                     new_val = RedisString::incr(it->second);
                 }
+                db.notify_keyspace_event(NOTIFY_STRING, "incrby", key);
             } 
             catch (const std::domain_error&) {
                 error_msg = "-ERR value is not an integer or out of range\r\n";
@@ -1,9 +1,12 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <memory>
 #include "../db/database.hpp"
 
+class Client;
+
 class StringCommands {
 public:
-    static std::string handle(Database& db, const std::vector<std::string>& args);
+    static std::string handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
 };
\ No newline at end of file
@@ -2,6 +2,87 @@
 #include "dispatcher.hpp"
 #include "../utils/utils.hpp"
 #include "../server/client.hpp"
+#include <algorithm>
+
+// Whether a watched key that was alive at WATCH time has since expired
+// without anyone touching it. Callers hold kv_mutex.
+static bool watched_key_expired(Database& db, const Client& client) {
+    for (const auto& [key, expired] : client.watched_keys) {
+        if (expired) continue;
+        auto it = db.kv_store.find(key);
+        if (it != db.kv_store.end() && db.is_expired(it->second)) return true;
+    }
+    return false;
+}
+
+// Runs the queued commands with kv_mutex held throughout, so no other client
+// sees the transaction half applied, and propagates its writes as a single
+// MULTI ... EXEC buffer, unless a WATCHed key has changed. Like a single write, the block holds
+// propagation_mutex from execution to propagation. On a replica the master
+// link already holds it and forwards the master's own MULTI/EXEC.
+static std::string exec_transaction(Database& db, std::shared_ptr<Client> client) {
+    bool propagate = false;
+    if (!client->is_master) {
+        for (const auto& queued_args : client->transaction_queue) {
+            if (Dispatcher::is_write_command(queued_args)) propagate = true;
+        }
+    }
+
+    if (propagate) {
+        std::string error = Dispatcher::aof_error(db);
+        if (!error.empty()) {
+            std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+            db.unwatch_all(*client);
+            return error;
+        }
+    }
+
+    std::unique_lock<std::mutex> propagation_lock(db.propagation_mutex, std::defer_lock);
+    if (propagate) {
+        propagation_lock.lock();
+        if (Dispatcher::read_only_replica(db)) {
+            std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+            db.unwatch_all(*client);
+            return Dispatcher::READONLY_ERROR;
+        }
+    }
+
+    std::string response = "*" + std::to_string(client->transaction_queue.size()) + "\r\n";
+    std::string propagation_msg = "*1\r\n$5\r\nMULTI\r\n";
+    bool wrote = false;
+    {
+        // A WATCHed key changed since WATCH: abort without running anything.
+        std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+        bool aborted = client->watch_dirty || watched_key_expired(db, *client);
+        db.unwatch_all(*client);
+        if (aborted) return "*-1\r\n";
+
+        for (const auto& queued_args : client->transaction_queue) {
+            std::string reply = Dispatcher::execute_command(db, client, queued_args);
+            if (propagate && Dispatcher::is_write_command(queued_args) && Dispatcher::reply_needs_propagation(reply, *client)) {
+                if (Dispatcher::append_propagation(propagation_msg, *client, queued_args)) wrote = true;
+            }
+            client->clear_propagation();
+            response += reply;
+        }
+    }
+
+    long long aof_offset = -1;
+    if (wrote) {
+        propagation_msg += "*1\r\n$4\r\nEXEC\r\n";
+        auto shared_msg = std::make_shared<const std::string>(std::move(propagation_msg));
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        aof_offset = db.aof.feed(*shared_msg);
+        db.feed_replicas(std::move(shared_msg));
+        client->repl_write_offset = db.config.master_repl_offset;
+        if (aof_offset >= 0) client->aof_write_offset = aof_offset;
+    }
+    if (aof_offset >= 0) {
+        propagation_lock.unlock();
+        db.aof.wait_synced(aof_offset);
+    }
+    return response;
+}
 
 std::string TxCommands::handle(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
     std::string command = to_upper(args[0]);
@@ -20,14 +101,7 @@ std::string TxCommands::handle(Database& db, std::shared_ptr<Client> client, con
       if (!client->in_multi) {
           response = "-ERR EXEC without MULTI\r\n";
       } else {
-          if (client->transaction_queue.empty()) {
-               response = "*0\r\n";
-          } else {
-               response = "*" + std::to_string(client->transaction_queue.size()) + "\r\n";
-               for (const auto& queued_args : client->transaction_queue) {
-                   response += Dispatcher::execute_command(db, client, queued_args);
-               }
-          }
+          response = exec_transaction(db, client);
           client->transaction_queue.clear();
           client->in_multi = false;
       }
@@ -38,8 +112,38 @@ std::string TxCommands::handle(Database& db, std::shared_ptr<Client> client, con
         } else {
             client->in_multi = false;
             client->transaction_queue.clear();
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+            db.unwatch_all(*client);
             response = "+OK\r\n";
         }
     }
+    else if (command == "WATCH") {
+        if (client->in_multi) {
+            response = "-ERR WATCH inside MULTI is not allowed\r\n";
+        } else if (args.size() < 2) {
+            response = "-ERR wrong number of arguments for 'watch' command\r\n";
+        } else {
+            // Nothing is locked on the client's behalf: writers just flag
+            // the watchers of the keys they touch, and EXEC checks the flag.
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+            for (size_t i = 1; i < args.size(); ++i) {
+                const std::string& key = args[i];
+                bool already = std::any_of(client->watched_keys.begin(), client->watched_keys.end(),
+                                           [&](const auto& watched) { return watched.first == key; });
+                if (already) continue;
+
+                auto it = db.kv_store.find(key);
+                bool expired = it != db.kv_store.end() && db.is_expired(it->second);
+                client->watched_keys.emplace_back(key, expired);
+                db.watched_keys[key].push_back(client.get());
+            }
+            response = "+OK\r\n";
+        }
+    }
+    else if (command == "UNWATCH") {
+        std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+        db.unwatch_all(*client);
+        response = "+OK\r\n";
+    }
     return response;
 }
\ No newline at end of file
@@ -22,17 +22,23 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
              return "-ERR wrong number of arguments for 'zadd' command\r\n";
         }
         
+        std::vector<double> scores;
+        for (size_t i = 2; i < args.size(); i += 2) {
+            try { scores.push_back(std::stod(args[i])); }
+            catch (...) { return "-ERR value is not a valid float\r\n"; }
+        }
+
         std::string key = args[1];
         int added_count = 0;
+        int updated_count = 0;
         bool wrong_type = false;
-        bool error_parsing = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -47,18 +53,13 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
                 wrong_type = true;
             } else {
                 for (size_t i = 2; i < args.size(); i += 2) {
-                    std::string score_str = args[i];
-                    std::string member = args[i+1];
-                    double score = 0;
-                    try { score = std::stod(score_str); } 
-                    catch (...) { error_parsing = true; break; }
-                    added_count += RedisZSet::add(it->second, score, member);
+                    added_count += RedisZSet::add(it->second, scores[(i - 2) / 2], args[i + 1], &updated_count);
                 }
+                if (added_count + updated_count > 0) db.notify_keyspace_event(NOTIFY_ZSET, "zadd", key);
             }
         }
 
         if (wrong_type) response = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
-        else if (error_parsing) response = "-ERR value is not a valid float\r\n";
         else response = ":" + std::to_string(added_count) + "\r\n";
     }
     else if (command == "ZRANK") {
@@ -69,11 +70,11 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -102,11 +103,11 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
         }
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -132,11 +133,11 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -157,11 +158,11 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -187,11 +188,11 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
         bool wrong_type = false;
 
         {
-            std::lock_guard<std::mutex> lock(db.kv_mutex);
+            std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
             auto it = db.kv_store.find(key);
             
             if (it != db.kv_store.end() && db.is_expired(it->second)) {
-                db.kv_store.erase(it);
+                db.expire_key(it);
                 it = db.kv_store.end();
             }
 
@@ -202,8 +203,10 @@ std::string ZSetCommands::handle(Database& db, const std::vector<std::string>& a
                     for (size_t i = 2; i < args.size(); ++i) {
                         removed_count += RedisZSet::remove(it->second, args[i]);
                     }
+                    if (removed_count > 0) db.notify_keyspace_event(NOTIFY_ZSET, "zrem", key);
                     if (RedisZSet::size(it->second) == 0) {
                         db.kv_store.erase(it);
+                        db.notify_keyspace_event(NOTIFY_GENERIC, "del", key);
                     }
                 }
             }
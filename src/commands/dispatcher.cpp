@@ -7,16 +7,61 @@
 #include "cmd_tx.hpp"
 #include "cmd_keys.hpp"
 #include "cmd_stream.hpp"
+#include "cmd_stream_group.hpp"
 #include "cmd_pubsub.hpp"
 #include "cmd_acl.hpp"
 #include "cmd_auth.hpp"
 #include "cmd_config.hpp"
 #include "cmd_replication.hpp"
+#include "cmd_persistence.hpp"
 #include "../utils/utils.hpp"
 #include "../server/client.hpp"
 #include <set>
 #include <sys/socket.h>
 
+static const std::set<std::string> write_commands = {
+    "SET", "INCR", "RPUSH", "LPUSH", "LPOP", "BLPOP",
+    "ZADD", "ZREM", "GEOADD", "GEOSEARCHSTORE", "XADD", "DEL",
+    "XTRIM", "XDEL", "XGROUP", "XREADGROUP", "XACK", "XCLAIM", "XAUTOCLAIM"
+};
+
+bool Dispatcher::is_write_command(const std::vector<std::string>& args) {
+    if (args.empty()) return false;
+    std::string command = to_upper(args[0]);
+
+    // GEORADIUS and GEORADIUSBYMEMBER are queries unless they STORE their
+    // result; options follow the center and the radius with its unit.
+    size_t options = (command == "GEORADIUS") ? 6 : (command == "GEORADIUSBYMEMBER") ? 5 : 0;
+    if (options > 0) {
+        for (size_t i = options; i + 1 < args.size(); ++i) {
+            std::string opt = to_upper(args[i]);
+            if (opt == "STORE" || opt == "STOREDIST") return true;
+        }
+        return false;
+    }
+    return write_commands.count(command) > 0;
+}
+
+bool Dispatcher::reply_needs_propagation(const std::string& reply, const Client& client) {
+    if (reply.empty() || reply[0] == '-') return false;
+    return client.propagate_replaced || (reply != "*-1\r\n" && reply != "$-1\r\n");
+}
+
+void Dispatcher::append_command(std::string& out, const std::vector<std::string>& args) {
+    out += "*" + std::to_string(args.size()) + "\r\n";
+    for (const auto& arg : args) {
+        out += "$" + std::to_string(arg.length()) + "\r\n" + arg + "\r\n";
+    }
+}
+
+bool Dispatcher::append_propagation(std::string& out, Client& client, const std::vector<std::string>& args) {
+    bool appended = !client.propagate_replaced || !client.propagate_args.empty();
+    if (!client.propagate_replaced) append_command(out, args);
+    for (const auto& command : client.propagate_args) append_command(out, command);
+    client.clear_propagation();
+    return appended;
+}
+
 std::string Dispatcher::dispatch(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
     if (args.empty()) return "";
     std::string command = to_upper(args[0]);
@@ -28,9 +73,10 @@ std::string Dispatcher::dispatch(Database& db, std::shared_ptr<Client> client, c
         }
     }
 
-    if (!client->subscriptions.empty()) {
+    if (!client->subscriptions.empty() || !client->patterns.empty() || !client->shard_subscriptions.empty()) {
         bool is_allowed = (command == "SUBSCRIBE" || command == "UNSUBSCRIBE" || 
                            command == "PSUBSCRIBE" || command == "PUNSUBSCRIBE" || 
+                           command == "SSUBSCRIBE" || command == "SUNSUBSCRIBE" || 
                            command == "PING" || command == "QUIT");
         
         if (!is_allowed) {
@@ -38,53 +84,89 @@ std::string Dispatcher::dispatch(Database& db, std::shared_ptr<Client> client, c
         }
     }
 
-    if (command == "MULTI" || command == "EXEC" || command == "DISCARD") {
+    if (command == "MULTI" || command == "EXEC" || command == "DISCARD" || command == "WATCH") {
         return TxCommands::handle(db, client, args);
     }
 
     if (client->in_multi) {
+        // These take propagation_mutex or turn the connection into a
+        // replication link, neither of which can happen while EXEC holds it.
+        static const std::set<std::string> no_multi_commands = {"PSYNC", "REPLICAOF", "SLAVEOF", "BGREWRITEAOF"};
+        if (no_multi_commands.count(command)) return "-ERR Command not allowed inside a transaction\r\n";
+        if (command == "CONFIG" && args.size() >= 3 && to_upper(args[1]) == "SET" && to_lower(args[2]) == "appendonly") {
+            return "-ERR Command not allowed inside a transaction\r\n";
+        }
+
         client->transaction_queue.push_back(args);
         return "+QUEUED\r\n";
     }
 
-    std::string response = execute_command(db, client, args);
-
-    static const std::set<std::string> write_commands = {
-        "SET", "INCR", "RPUSH", "LPUSH", "LPOP", "BLPOP", 
-        "ZADD", "ZREM", "GEOADD", "XADD", "DEL"
-    };
+    // Commands that may wait for data release propagation_mutex only while
+    // they wait; see BlockedWriteLock.
+    // A replica's master link already holds propagation_mutex and forwards
+    // the master's bytes to sub-replicas itself.
+    bool is_write = is_write_command(args) && !client->is_master;
+    if (is_write) {
+        std::string error = aof_error(db);
+        if (!error.empty()) return error;
+    }
+    std::unique_lock<std::mutex> propagation_lock(db.propagation_mutex, std::defer_lock);
+    if (is_write) {
+        propagation_lock.lock();
+        if (read_only_replica(db)) return READONLY_ERROR;
+    }
 
-    if (write_commands.count(command) > 0 && !response.empty() && response[0] != '-') {
-        std::string propagation_msg = "*" + std::to_string(args.size()) + "\r\n";
-        for (const auto& arg : args) {
-            propagation_msg += "$" + std::to_string(arg.length()) + "\r\n" + arg + "\r\n";
-        }
+    std::string response = execute_command(db, client, args);
 
-        db.config.master_repl_offset += propagation_msg.length();
+    long long aof_offset = -1;
+    std::string propagation_msg;
+    if (is_write && reply_needs_propagation(response, *client) && append_propagation(propagation_msg, *client, args)) {
+        auto shared_msg = std::make_shared<const std::string>(std::move(propagation_msg));
 
+        // The AOF is fed under replication_mutex too, so it logs writes in
+        // the same order as the replication stream.
         std::lock_guard<std::mutex> lock(db.replication_mutex);
-        auto it = db.replicas.begin();
-        while (it != db.replicas.end()) {
-            if (auto replica = it->lock()) {
-                send(replica->fd, propagation_msg.c_str(), propagation_msg.length(), 0);
-                ++it;
-            } else {
-                it = db.replicas.erase(it);
-            }
-        }
+        aof_offset = db.aof.feed(*shared_msg);
+        db.feed_replicas(std::move(shared_msg));
+        client->repl_write_offset = db.config.master_repl_offset;
+        if (aof_offset >= 0) client->aof_write_offset = aof_offset;
     }
+    client->clear_propagation();
 
+    // Under appendfsync always the reply waits for the write to be on disk,
+    // but no lock is held while it does, so other writes join the same fsync.
+    if (aof_offset >= 0) {
+        if (propagation_lock.owns_lock()) propagation_lock.unlock();
+        db.aof.wait_synced(aof_offset);
+    }
     return response;
 }
 
+const char* const Dispatcher::READONLY_ERROR = "-READONLY You can't write against a read only replica.\r\n";
+
+bool Dispatcher::read_only_replica(Database& db) {
+    // REPLICAOF NO ONE changes the role under propagation_mutex, which the
+    // caller holds.
+    return db.config.role == "slave";
+}
+
+std::string Dispatcher::aof_error(Database& db) {
+    std::string reason;
+    if (!db.aof.write_failed(reason)) return "";
+    return "-MISCONF Errors writing to the AOF file: " + reason + "\r\n";
+}
+
 std::string Dispatcher::execute_command(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args) {
     std::string command = to_upper(args[0]);
 
     if (command == "PING" || command == "ECHO") {
         return AdminCommands::handle(client, args);
     }
+    else if (command == "UNWATCH") {
+        return TxCommands::handle(db, client, args);
+    }
     else if (command == "SET" || command == "GET" || command == "INCR") {
-        return StringCommands::handle(db, args);
+        return StringCommands::handle(db, client, args);
     }
     else if (command == "RPUSH" || command == "LPUSH" || command == "LRANGE" || 
              command == "LLEN" || command == "LPOP" || command == "BLPOP") {
@@ -94,14 +176,21 @@ std::string Dispatcher::execute_command(Database& db, std::shared_ptr<Client> cl
              command == "ZCARD" || command == "ZSCORE" || command == "ZREM") {
         return ZSetCommands::handle(db, args);
     }
-    else if (command == "GEOADD" || command == "GEOPOS" || command == "GEODIST" || command == "GEOSEARCH") {
+    else if (command == "GEOADD" || command == "GEOPOS" || command == "GEODIST" || command == "GEOSEARCH" ||
+             command == "GEOSEARCHSTORE" || command == "GEORADIUS" || command == "GEORADIUS_RO" ||
+             command == "GEORADIUSBYMEMBER" || command == "GEORADIUSBYMEMBER_RO") {
         return GeoCommands::handle(db, args);
     }
-    else if (command == "TYPE" || command == "KEYS") { 
+    else if (command == "TYPE" || command == "KEYS" || command == "DEL") { 
         return KeyCommands::handle(db, args);
     }
-    else if (command == "XADD" || command == "XRANGE" || command == "XREAD") {
-        return StreamCommands::handle(db, args);
+    else if (command == "XADD" || command == "XRANGE" || command == "XREVRANGE" || command == "XREAD" ||
+             command == "XTRIM" || command == "XDEL") {
+        return StreamCommands::handle(db, client, args);
+    }
+    else if (command == "XGROUP" || command == "XREADGROUP" || command == "XACK" || command == "XPENDING" ||
+             command == "XCLAIM" || command == "XAUTOCLAIM" || command == "XINFO") {
+        return StreamGroupCommands::handle(db, client, args);
     }
     else if (command == "SUBSCRIBE") {
         return PubSubCommands::handle_subscribe(db, client, args);
@@ -109,9 +198,27 @@ std::string Dispatcher::execute_command(Database& db, std::shared_ptr<Client> cl
     else if (command == "UNSUBSCRIBE") {
         return PubSubCommands::handle_unsubscribe(db, client, args);
     }
+    else if (command == "SSUBSCRIBE") {
+        return PubSubCommands::handle_ssubscribe(db, client, args);
+    }
+    else if (command == "SUNSUBSCRIBE") {
+        return PubSubCommands::handle_sunsubscribe(db, client, args);
+    }
+    else if (command == "PSUBSCRIBE") {
+        return PubSubCommands::handle_psubscribe(db, client, args);
+    }
+    else if (command == "PUNSUBSCRIBE") {
+        return PubSubCommands::handle_punsubscribe(db, client, args);
+    }
     else if (command == "PUBLISH") {
         return PubSubCommands::handle_publish(db, args);
     }
+    else if (command == "SPUBLISH") {
+        return PubSubCommands::handle_spublish(db, args);
+    }
+    else if (command == "PUBSUB") {
+        return PubSubCommands::handle_pubsub(db, args);
+    }
     else if (command == "ACL") {
         return AclCommands::handle(db, client, args);
     }
@@ -121,7 +228,11 @@ std::string Dispatcher::execute_command(Database& db, std::shared_ptr<Client> cl
     else if (command == "CONFIG") {
         return ConfigCommands::handle(db, args);
     }
-    else if (command == "INFO" || command == "REPLCONF" || command == "PSYNC" || command == "WAIT") {
+    else if (command == "SAVE" || command == "BGSAVE" || command == "BGREWRITEAOF" || command == "LASTSAVE") {
+        return PersistenceCommands::handle(db, args);
+    }
+    else if (command == "INFO" || command == "REPLCONF" || command == "PSYNC" || command == "WAIT" ||
+             command == "WAITAOF" || command == "REPLICAOF" || command == "SLAVEOF") {
         return ReplicationCommands::handle(db, client, args);
     }
     
@@ -10,4 +10,32 @@ class Dispatcher {
 public:
     static std::string dispatch(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
     static std::string execute_command(Database& db, std::shared_ptr<Client> client, const std::vector<std::string>& args);
+
+    // Whether a successful run of the command in args changes the keyspace
+    // and so must be propagated.
+    static bool is_write_command(const std::vector<std::string>& args);
+
+    // Whether a write command's reply means it may have changed something,
+    // i.e. it is neither an error nor a null such as a timed-out BLPOP. A
+    // null still propagates whatever the command set in its place, such as
+    // the consumer a timed-out XREADGROUP created.
+    static bool reply_needs_propagation(const std::string& reply, const Client& client);
+
+    // Appends args to out as a RESP array, the form commands are propagated in.
+    static void append_command(std::string& out, const std::vector<std::string>& args);
+
+    // Appends what client's last command propagates: args, or whatever the
+    // command set in its place. Returns whether anything was appended, and
+    // resets the client for the next command either way.
+    static bool append_propagation(std::string& out, Client& client, const std::vector<std::string>& args);
+
+    // The reply that refuses a write while the AOF can't be written, or an
+    // empty string.
+    static std::string aof_error(Database& db);
+
+    // Whether writes from clients other than the master link are refused,
+    // with READONLY_ERROR, because we are a replica. Callers hold
+    // propagation_mutex.
+    static bool read_only_replica(Database& db);
+    static const char* const READONLY_ERROR;
 };
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "aof.hpp"
+#include "../utils/utils.hpp"
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// How often everysec syncs, and how long a failed write waits to be retried.
+const long long FSYNC_INTERVAL_MS = 1000;
+
+// Writes all of data at the end of the file. On failure the file is cut back
+// to its previous size so it never ends in half a command; errno is kept.
+bool append_all(int fd, const std::string& data, long long file_size) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            int saved_errno = n < 0 ? errno : ENOSPC;
+            if (done > 0 && ftruncate(fd, file_size) != 0) {
+                std::cerr << "Could not remove a partial AOF write: " << std::strerror(errno) << "\n";
+            }
+            errno = saved_errno;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}
+
+AppendOnlyFile::~AppendOnlyFile() {
+    stop();
+}
+
+bool AppendOnlyFile::start(const std::string& path) {
+    if (enabled()) return true;
+
+    int file = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (file < 0) return false;
+    off_t size = lseek(file, 0, SEEK_END);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fd = file;
+        stopping = false;
+        pending.clear();
+        // Offsets run on across files, so a caller still waiting on the
+        // previous one is released rather than compared against this one.
+        written_offset = synced_offset = fed_offset;
+        file_base = fed_offset - static_cast<long long>(size);
+        last_fsync_ms = current_time_ms();
+        write_errno = 0;
+    }
+    writer = std::thread(&AppendOnlyFile::run, this);
+    running.store(true, std::memory_order_release);
+    return true;
+}
+
+void AppendOnlyFile::stop() {
+    if (!writer.joinable()) return;
+    running.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    data_cv.notify_one();
+    writer.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    fdatasync(fd);
+    close(fd);
+    fd = -1;
+    synced_cv.notify_all();
+}
+
+long long AppendOnlyFile::feed(const std::string& data) {
+    if (!enabled()) return -1;
+    long long offset;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return -1;
+        pending += data;
+        fed_offset += static_cast<long long>(data.size());
+        offset = fed_offset;
+    }
+    data_cv.notify_one();
+    return offset;
+}
+
+void AppendOnlyFile::wait_synced(long long offset) {
+    if (offset < 0 || fsync_policy != AppendFsync::ALWAYS) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    synced_cv.wait(lock, [&] { return synced_offset >= offset || fd < 0; });
+}
+
+bool AppendOnlyFile::is_synced(long long offset) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return synced_offset >= offset;
+}
+
+bool AppendOnlyFile::wait_synced_for(long long offset, long long timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto done = [&] { return synced_offset >= offset || fd < 0; };
+    if (timeout_ms == 0) synced_cv.wait(lock, done);
+    else synced_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+    return synced_offset >= offset;
+}
+
+bool AppendOnlyFile::write_failed(std::string& reason) {
+    if (!enabled()) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (write_errno == 0) return false;
+    reason = std::strerror(write_errno);
+    return true;
+}
+
+long long AppendOnlyFile::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fed_offset - file_base;
+}
+
+std::string AppendOnlyFile::info() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string content = "aof_enabled:" + std::string(enabled() ? "1" : "0") + "\r\n";
+    content += "aof_last_write_status:" + std::string(write_errno == 0 ? "ok" : "err") + "\r\n";
+    if (enabled()) content += "aof_buffer_length:" + std::to_string(pending.size()) + "\r\n";
+    return content;
+}
+
+// One pass per wakeup: take everything fed so far, write it, and sync if the
+// policy asks for it. Writes that arrive during the sync wait in pending and
+// go out together on the next pass.
+void AppendOnlyFile::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        bool retry_wait = write_errno != 0;
+        data_cv.wait_for(lock, std::chrono::milliseconds(FSYNC_INTERVAL_MS), [&] {
+            return stopping || (!retry_wait && !pending.empty());
+        });
+
+        std::string batch;
+        batch.swap(pending);
+        long long batch_end = fed_offset;
+        long long file_size = written_offset - file_base;
+        bool unsynced = written_offset > synced_offset;
+        AppendFsync policy = fsync_policy;
+        lock.unlock();
+
+        bool ok = batch.empty() || append_all(fd, batch, file_size);
+        int saved_errno = errno;
+        long long now = current_time_ms();
+        bool sync = ok && (batch.size() > 0 || unsynced) &&
+                    (policy == AppendFsync::ALWAYS ||
+                     (policy == AppendFsync::EVERYSEC && now - last_fsync_ms >= FSYNC_INTERVAL_MS));
+        if (sync && fdatasync(fd) != 0) {
+            ok = false;
+            saved_errno = errno;
+        }
+
+        if (!ok && policy == AppendFsync::ALWAYS) {
+            // Replies already promised durability; there is no way to take
+            // the writes back.
+            std::cerr << "Can't recover from AOF write error when the AOF fsync policy is 'always': "
+                      << std::strerror(saved_errno) << ". Exiting...\n";
+            _exit(1);
+        }
+
+        lock.lock();
+        if (ok) {
+            written_offset = batch_end;
+            if (sync) {
+                synced_offset = written_offset;
+                last_fsync_ms = now;
+            } else if (policy == AppendFsync::NO) {
+                // Left to the kernel; nobody waits for it.
+                synced_offset = written_offset;
+            }
+            if (write_errno != 0) std::cerr << "AOF write error looks solved, accepting writes again\n";
+            write_errno = 0;
+        } else {
+            if (write_errno == 0) {
+                std::cerr << "Error writing to the AOF file: " << std::strerror(saved_errno) << "\n";
+            }
+            write_errno = saved_errno;
+            pending.insert(0, batch);
+        }
+        synced_cv.notify_all();
+
+        if (stopping && (pending.empty() || !ok)) return;
+    }
+}
+
+bool AppendOnlyFile::parse_fsync_policy(const std::string& str, AppendFsync& out) {
+    std::string value = to_lower(str);
+    if (value == "always") out = AppendFsync::ALWAYS;
+    else if (value == "everysec") out = AppendFsync::EVERYSEC;
+    else if (value == "no") out = AppendFsync::NO;
+    else return false;
+    return true;
+}
+
+std::string AppendOnlyFile::fsync_policy_to_string(AppendFsync policy) {
+    switch (policy) {
+        case AppendFsync::ALWAYS: return "always";
+        case AppendFsync::NO: return "no";
+        default: return "everysec";
+    }
+}
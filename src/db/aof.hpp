@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class AppendFsync { ALWAYS, EVERYSEC, NO };
+
+// The append-only file: every write command, in RESP, in the order it was
+// applied. Threads that run commands only append to an in-memory buffer; a
+// background thread writes the buffer out and syncs it according to the
+// fsync policy. Under "always" every sync covers all the writes that arrived
+// while the previous one was in progress (group commit), and under
+// "everysec" the command path never waits for the disk at all.
+class AppendOnlyFile {
+public:
+    ~AppendOnlyFile();
+
+    // Starts appending to path, creating it if needed. Returns false with
+    // errno set if it can't be opened. Switching files is stop() then
+    // start() under propagation_mutex.
+    bool start(const std::string& path);
+
+    // Writes out and syncs everything fed so far, then closes the file.
+    void stop();
+
+    bool enabled() const { return running.load(std::memory_order_acquire); }
+
+    // Appends data, one or more complete commands. Returns the log offset
+    // just past it, or -1 if the log is off. Callers feed in the order the
+    // commands were applied, which propagation_mutex already guarantees.
+    long long feed(const std::string& data);
+
+    // Size of the current file once everything fed has been written.
+    long long size();
+
+    // Under appendfsync always, blocks until offset is on disk.
+    void wait_synced(long long offset);
+
+    // Whether offset is on disk, and the same after waiting up to timeout_ms
+    // (0 waits forever) whatever the policy; everysec gets there within a
+    // second. Used by WAITAOF.
+    bool is_synced(long long offset);
+    bool wait_synced_for(long long offset, long long timeout_ms);
+
+    void set_fsync_policy(AppendFsync policy) { fsync_policy = policy; }
+    AppendFsync get_fsync_policy() const { return fsync_policy; }
+
+    // Set while writes to the file are failing; write commands are refused
+    // until a retry succeeds.
+    bool write_failed(std::string& reason);
+
+    // Fields for the "# Persistence" INFO section.
+    std::string info();
+
+    static bool parse_fsync_policy(const std::string& str, AppendFsync& out);
+    static std::string fsync_policy_to_string(AppendFsync policy);
+
+private:
+    std::atomic<bool> running{false};
+    std::atomic<AppendFsync> fsync_policy{AppendFsync::EVERYSEC};
+
+    std::mutex mutex;
+    std::condition_variable data_cv;   // wakes the writer
+    std::condition_variable synced_cv; // wakes callers of wait_synced
+    std::thread writer;
+    int fd = -1;
+    bool stopping = false;
+    std::string pending;          // fed but not yet written
+    // Log offsets count every byte fed since startup, across files;
+    // file_base is the offset at which the current file would start.
+    long long fed_offset = 0;     // once pending is written
+    long long written_offset = 0; // written to a file
+    long long synced_offset = 0;  // known to be on disk
+    long long file_base = 0;
+    long long last_fsync_ms = 0;
+    int write_errno = 0;          // of the last failed write, 0 once one succeeds
+
+    void run();
+};
@@ -0,0 +1,194 @@
+#include "aof_loader.hpp"
+#include "rdb_loader.hpp"
+#include "../utils/utils.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Progress is published every this many commands.
+const size_t PROGRESS_INTERVAL = 1024;
+
+enum class ParseResult { OK, INCOMPLETE, MALFORMED };
+
+// Reads "<prefix><number>\r\n" at pos.
+ParseResult parse_number(const char* data, size_t size, size_t& pos, char prefix, long long& out) {
+    if (pos >= size) return ParseResult::INCOMPLETE;
+    if (data[pos] != prefix) return ParseResult::MALFORMED;
+
+    size_t p = pos + 1;
+    long long value = 0;
+    size_t digits = 0;
+    while (p < size && data[p] >= '0' && data[p] <= '9') {
+        if (++digits > 18) return ParseResult::MALFORMED;
+        value = value * 10 + (data[p] - '0');
+        p++;
+    }
+    if (p + 2 > size) return ParseResult::INCOMPLETE;
+    if (digits == 0 || data[p] != '\r' || data[p + 1] != '\n') return ParseResult::MALFORMED;
+
+    pos = p + 2;
+    out = value;
+    return ParseResult::OK;
+}
+
+// Reads one command logged as a RESP array of bulk strings.
+ParseResult parse_command(const char* data, size_t size, size_t& pos, std::vector<std::string>& args) {
+    size_t p = pos;
+    long long count = 0;
+    ParseResult result = parse_number(data, size, p, '*', count);
+    if (result != ParseResult::OK) return result;
+    if (count < 1) return ParseResult::MALFORMED;
+
+    args.clear();
+    for (long long i = 0; i < count; ++i) {
+        long long len = 0;
+        result = parse_number(data, size, p, '$', len);
+        if (result != ParseResult::OK) return result;
+        if (size - p < static_cast<size_t>(len) + 2) return ParseResult::INCOMPLETE;
+        if (data[p + len] != '\r' || data[p + len + 1] != '\n') return ParseResult::MALFORMED;
+        args.emplace_back(data + p, static_cast<size_t>(len));
+        p += static_cast<size_t>(len) + 2;
+    }
+    pos = p;
+    return ParseResult::OK;
+}
+
+}
+
+AOFLoader::AOFLoader(Database& db) : db(db) {}
+
+bool AOFLoader::load(const std::vector<std::string>& paths, const Executor& execute, std::string& error) {
+    long long total = 0;
+    for (const auto& path : paths) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            error = path + ": " + std::strerror(errno);
+            return false;
+        }
+        total += static_cast<long long>(st.st_size);
+    }
+
+    LoadingScope scope(db.loading, total);
+    loaded_before = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!load_file(paths[i], i + 1 == paths.size(), execute, error)) {
+            error = paths[i] + ": " + error;
+            return false;
+        }
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    scope.finish(db.kv_store.size());
+    return true;
+}
+
+bool AOFLoader::load_file(const std::string& path, bool last, const Executor& execute, std::string& error) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        error = std::strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int map_errno = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = std::string("mmap failed: ") + std::strerror(map_errno);
+        return false;
+    }
+    const char* data = static_cast<const char*>(map);
+
+    size_t pos = 0;
+    if (size >= 5 && std::memcmp(data, "REDIS", 5) == 0) {
+        std::unordered_map<std::string, Entry> loaded;
+        try {
+            pos = RDBLoader(db).load_mapped(data, size, loaded);
+        } catch (const std::exception& e) {
+            munmap(map, size);
+            error = std::string("Bad RDB preamble: ") + e.what();
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+        if (db.kv_store.empty()) {
+            db.kv_store.swap(loaded);
+        } else {
+            for (auto& [key, entry] : loaded) db.kv_store[key] = std::move(entry);
+        }
+    }
+
+    db.replaying_aof = true;
+    std::vector<std::string> args;
+    std::vector<std::vector<std::string>> transaction;
+    bool in_multi = false;
+    size_t multi_start = 0;
+    size_t valid_end = size;
+    size_t commands = 0;
+
+    while (pos < size) {
+        size_t start = pos;
+        ParseResult result = parse_command(data, size, pos, args);
+        if (result == ParseResult::INCOMPLETE) {
+            valid_end = start;
+            break;
+        }
+        if (result == ParseResult::MALFORMED) {
+            db.replaying_aof = false;
+            munmap(map, size);
+            error = "Bad file format reading the append only file at offset " + std::to_string(start);
+            return false;
+        }
+
+        std::string command = to_upper(args[0]);
+        if (command == "MULTI") {
+            in_multi = true;
+            multi_start = start;
+            transaction.clear();
+        } else if (command == "EXEC") {
+            for (const auto& queued : transaction) execute(queued);
+            transaction.clear();
+            in_multi = false;
+        } else if (in_multi) {
+            transaction.push_back(args);
+        } else {
+            execute(args);
+        }
+
+        if (++commands % PROGRESS_INTERVAL == 0) {
+            db.loading.loaded_bytes.store(loaded_before + static_cast<long long>(pos), std::memory_order_relaxed);
+        }
+    }
+    db.replaying_aof = false;
+    munmap(map, size);
+    loaded_before += static_cast<long long>(size);
+    db.loading.loaded_bytes.store(loaded_before, std::memory_order_relaxed);
+
+    // A transaction the crash cut short never ran; drop it whole.
+    if (in_multi) valid_end = std::min(valid_end, multi_start);
+    if (valid_end < size) {
+        // Only the file being appended to when the server stopped can end
+        // early; anywhere else commands after it would be lost.
+        if (!last) {
+            error = "Unexpected end of file at offset " + std::to_string(valid_end);
+            return false;
+        }
+        std::cerr << "AOF " << path << " ends with an incomplete command; truncating it from " << size
+                  << " to " << valid_end << " bytes\n";
+        if (truncate(path.c_str(), static_cast<off_t>(valid_end)) != 0) {
+            error = std::string("Failed to truncate the AOF: ") + std::strerror(errno);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "database.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+// Rebuilds the keyspace from the AOF at startup: the base file, loaded like
+// a dump file or, for an AOF from before the manifest, replayed as commands,
+// then each incremental file, every command run through execute. Keys
+// don't expire during the replay, so every command sees the keyspace it
+// originally ran against.
+class AOFLoader {
+public:
+    using Executor = std::function<std::string(const std::vector<std::string>&)>;
+
+    explicit AOFLoader(Database& db);
+
+    // Loads paths in order. Returns false with a message in error if a file
+    // can't be read or is damaged. A tail cut short by a crash, half a
+    // command or a MULTI without its EXEC, is cut off the last file with a
+    // warning instead.
+    bool load(const std::vector<std::string>& paths, const Executor& execute, std::string& error);
+
+private:
+    Database& db;
+    long long loaded_before = 0; // bytes in the files already replayed
+
+    bool load_file(const std::string& path, bool last, const Executor& execute, std::string& error);
+};
@@ -0,0 +1,88 @@
+#include "aof_manifest.hpp"
+#include <sstream>
+
+std::vector<std::string> AOFManifest::files() const {
+    std::vector<std::string> out;
+    if (!base.name.empty()) out.push_back(base.name);
+    for (const auto& incr : incrs) out.push_back(incr.name);
+    return out;
+}
+
+AOFManifest::File AOFManifest::next_base(const std::string& prefix) const {
+    File file;
+    file.seq = base.seq + 1;
+    file.name = prefix + "." + std::to_string(file.seq) + ".base.rdb";
+    return file;
+}
+
+AOFManifest::File AOFManifest::next_incr(const std::string& prefix) const {
+    File file;
+    file.seq = incrs.empty() ? 1 : incrs.back().seq + 1;
+    file.name = prefix + "." + std::to_string(file.seq) + ".incr.aof";
+    return file;
+}
+
+std::string AOFManifest::to_string() const {
+    std::string out;
+    if (!base.name.empty()) {
+        out += "file " + base.name + " seq " + std::to_string(base.seq) + " type b\n";
+    }
+    for (const auto& incr : incrs) {
+        out += "file " + incr.name + " seq " + std::to_string(incr.seq) + " type i\n";
+    }
+    return out;
+}
+
+bool AOFManifest::parse(const std::string& content, AOFManifest& out, std::string& error) {
+    AOFManifest manifest;
+    std::istringstream lines(content);
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(lines, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string key, value, type;
+        File file;
+        bool has_seq = false;
+        while (fields >> key >> value) {
+            if (key == "file") {
+                file.name = value;
+            } else if (key == "seq") {
+                try {
+                    file.seq = std::stoll(value);
+                    has_seq = true;
+                } catch (...) {}
+            } else if (key == "type") {
+                type = value;
+            }
+        }
+
+        if (file.name.empty() || file.name.find('/') != std::string::npos || !has_seq || file.seq < 1) {
+            error = "Invalid AOF manifest line " + std::to_string(line_number);
+            return false;
+        }
+        if (type == "b") {
+            if (!manifest.base.name.empty() || !manifest.incrs.empty()) {
+                error = "Unexpected base file in the AOF manifest at line " + std::to_string(line_number);
+                return false;
+            }
+            manifest.base = file;
+        } else if (type == "i") {
+            if (!manifest.incrs.empty() && file.seq <= manifest.incrs.back().seq) {
+                error = "Out of order incremental file in the AOF manifest at line " + std::to_string(line_number);
+                return false;
+            }
+            manifest.incrs.push_back(file);
+        } else if (type != "h") {
+            // History files are already replaced; only their deletion is pending.
+            error = "Unknown file type in the AOF manifest at line " + std::to_string(line_number);
+            return false;
+        }
+    }
+
+    out = std::move(manifest);
+    return true;
+}
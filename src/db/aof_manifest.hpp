@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// The files that make up the AOF, as listed in its manifest: a base file,
+// an RDB snapshot written by a rewrite, then the incremental files of
+// commands logged since, replayed in that order. The manifest is replaced
+// atomically whenever the set changes; files no longer listed are history
+// and get deleted.
+//
+// Each line reads "file <name> seq <n> type <b|i>", as in Redis 7.
+struct AOFManifest {
+    struct File {
+        std::string name;
+        long long seq = 0;
+    };
+
+    File base; // name is empty when there is none yet
+    std::vector<File> incrs;
+
+    bool empty() const { return base.name.empty() && incrs.empty(); }
+
+    // File names in replay order.
+    std::vector<std::string> files() const;
+
+    // Names for the next base and incremental file, "<prefix>.<seq>.base.rdb"
+    // and "<prefix>.<seq>.incr.aof".
+    File next_base(const std::string& prefix) const;
+    File next_incr(const std::string& prefix) const;
+
+    std::string to_string() const;
+    static bool parse(const std::string& content, AOFManifest& out, std::string& error);
+};
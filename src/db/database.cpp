@@ -1,9 +1,14 @@
 #include "database.hpp"
 #include "../utils/utils.hpp"
 #include "rdb_loader.hpp"
+#include "../server/client.hpp"
 #include <iostream>
+#include <algorithm>
+#include <sys/socket.h>
 
 Database::Database() {
+    config.master_replid = random_hex(40);
+
     User default_user;
     default_user.name = "default";
     default_user.flags.insert("nopass");
@@ -27,11 +32,160 @@ void Database::notify_blocked_clients(const std::string& key) {
 }
 
 bool Database::is_expired(const Entry& entry) {
-    return (entry.expiry_at != 0 && current_time_ms() > entry.expiry_at);
+    return (entry.expiry_at != 0 && !replaying_aof && current_time_ms() > entry.expiry_at);
+}
+
+std::unordered_map<std::string, Entry>::iterator Database::expire_key(std::unordered_map<std::string, Entry>::iterator it) {
+    dirty.fetch_add(1, std::memory_order_relaxed);
+    if (!watched_keys.empty()) touch_watched_key(it->first);
+    if (!(config.notify_keyspace_events.load(std::memory_order_relaxed) & NOTIFY_EXPIRED)) {
+        return kv_store.erase(it);
+    }
+    std::string key = it->first;
+    auto next = kv_store.erase(it);
+    publish_keyspace_event("expired", key);
+    return next;
+}
+
+void Database::touch_watched_key(const std::string& key) {
+    auto it = watched_keys.find(key);
+    if (it == watched_keys.end()) return;
+    for (Client* client : it->second) client->watch_dirty = true;
+}
+
+void Database::touch_all_watched_keys() {
+    for (const auto& [key, clients] : watched_keys) {
+        for (Client* client : clients) client->watch_dirty = true;
+    }
+}
+
+void Database::unwatch_all(Client& client) {
+    for (const auto& [key, expired] : client.watched_keys) {
+        auto it = watched_keys.find(key);
+        if (it == watched_keys.end()) continue;
+        auto& clients = it->second;
+        clients.erase(std::remove(clients.begin(), clients.end(), &client), clients.end());
+        if (clients.empty()) watched_keys.erase(it);
+    }
+    client.watched_keys.clear();
+    client.watch_dirty = false;
+}
+
+static std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.length()) + "\r\n" + s + "\r\n";
+}
+
+// Queues msg on every live subscriber of channel and returns how many got it.
+// Subscribers come from a snapshot, so only a shard read lock is taken, and
+// only long enough to copy the pointer.
+static int deliver(const ChannelRegistry& registry, const std::string& channel, const std::string& msg,
+                   const OutputBufferLimit& limit) {
+    auto subscribers = registry.subscribers(channel);
+    if (!subscribers) return 0;
+
+    // One buffer, shared by every subscriber's queue.
+    auto shared_msg = std::make_shared<const std::string>(msg);
+    int delivered = 0;
+    for (const auto& sub : *subscribers) {
+        if (auto client = sub.client.lock()) {
+            client->enqueue_limited(shared_msg, limit);
+            delivered++;
+        }
+    }
+    return delivered;
+}
+
+int Database::publish(const std::string& channel, const std::string& message) {
+    int receivers = deliver(pubsub_channels, channel, "*3\r\n$7\r\nmessage\r\n" + bulk(channel) + bulk(message),
+                            config.pubsub_limit);
+
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    if (pubsub_patterns.size() == 0) return receivers;
+
+    const std::string* last_pattern = nullptr;
+    std::shared_ptr<const std::string> pmsg;
+    pubsub_patterns.match(channel, [&](const std::string& pattern, const std::shared_ptr<Client>& client) {
+        if (&pattern != last_pattern) {
+            last_pattern = &pattern;
+            pmsg = std::make_shared<const std::string>("*4\r\n$8\r\npmessage\r\n" + bulk(pattern) + bulk(channel) + bulk(message));
+        }
+        client->enqueue_limited(pmsg, config.pubsub_limit);
+        receivers++;
+    });
+    return receivers;
+}
+
+int Database::spublish(const std::string& channel, const std::string& message) {
+    return deliver(pubsub_shard_channels, channel, "*3\r\n$8\r\nsmessage\r\n" + bulk(channel) + bulk(message),
+                   config.pubsub_limit);
+}
+
+void Database::publish_keyspace_event(const char* event, const std::string& key) {
+    uint32_t flags = config.notify_keyspace_events.load(std::memory_order_relaxed);
+    if (flags & NOTIFY_KEYSPACE) publish("__keyspace@0__:" + key, event);
+    if (flags & NOTIFY_KEYEVENT) publish(std::string("__keyevent@0__:") + event, key);
 }
 
 void Database::load_from_file() {
     std::string path = config.dir + "/" + config.dbfilename;
     RDBLoader loader(*this);
-    loader.load(path);
-}
\ No newline at end of file
+    try {
+        loader.load(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load " << path << ": " << e.what() << "\n";
+    }
+}
+
+void Database::feed_replicas(std::shared_ptr<const std::string> msg) {
+    if (repl_backlog) repl_backlog->append(msg->data(), msg->size());
+    config.master_repl_offset += msg->size();
+
+    auto it = replicas.begin();
+    while (it != replicas.end()) {
+        if (auto replica = it->lock()) {
+            replica->enqueue_limited(msg, config.replica_limit);
+            ++it;
+        } else {
+            it = replicas.erase(it);
+        }
+    }
+}
+
+void Database::shift_replication_id() {
+    config.master_replid2 = config.master_replid;
+    config.second_repl_offset = config.master_repl_offset + 1;
+    config.master_replid = random_hex(40);
+}
+
+void Database::replica_acked(Client& replica, long long offset) {
+    long long previous = replica.repl_offset;
+    if (offset <= previous) return;
+    replica.repl_offset = offset;
+
+    auto end = wait_requests.upper_bound(offset);
+    for (auto it = wait_requests.upper_bound(previous); it != end; ++it) {
+        WaitRequest& request = *it->second;
+        if (++request.acked == request.needed) request.cv.notify_one();
+    }
+}
+
+int Database::count_replicas_acked(long long offset) {
+    int count = 0;
+    auto it = replicas.begin();
+    while (it != replicas.end()) {
+        if (auto replica = it->lock()) {
+            if (replica->repl_offset >= offset) count++;
+            ++it;
+        } else {
+            it = replicas.erase(it);
+        }
+    }
+    return count;
+}
+
+void Database::disconnect_replicas() {
+    for (const auto& weak : replicas) {
+        if (auto replica = weak.lock()) shutdown(replica->fd, SHUT_RDWR);
+    }
+    replicas.clear();
+}
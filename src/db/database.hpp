@@ -1,5 +1,11 @@
 #pragma once
 #include "object.hpp"
+#include "structs/pattern_trie.hpp"
+#include "structs/channel_registry.hpp"
+#include "structs/repl_backlog.hpp"
+#include "aof.hpp"
+#include "aof_manifest.hpp"
+#include <atomic>
 #include <unordered_map>
 #include <string>
 #include <mutex>
@@ -7,55 +13,279 @@
 #include <memory>
 #include <condition_variable>
 #include <set>
+#include <map>
 #include <vector>
+#include <sys/types.h>
 
 class Client;
 
 struct BlockedClient {
-    std::condition_variable cv;
+    std::condition_variable_any cv;
     std::string key_waiting_on;
 };
 
+// notify-keyspace-events classes, one bit per flag character.
+enum NotifyFlags : uint32_t {
+    NOTIFY_KEYSPACE = 1 << 0,  // K
+    NOTIFY_KEYEVENT = 1 << 1,  // E
+    NOTIFY_GENERIC = 1 << 2,   // g
+    NOTIFY_STRING = 1 << 3,    // $
+    NOTIFY_LIST = 1 << 4,      // l
+    NOTIFY_SET = 1 << 5,       // s
+    NOTIFY_HASH = 1 << 6,      // h
+    NOTIFY_ZSET = 1 << 7,      // z
+    NOTIFY_EXPIRED = 1 << 8,   // x
+    NOTIFY_EVICTED = 1 << 9,   // e
+    NOTIFY_STREAM = 1 << 10,   // t
+    NOTIFY_KEY_MISS = 1 << 11, // m
+    NOTIFY_NEW = 1 << 12,      // n
+    NOTIFY_ALL = NOTIFY_GENERIC | NOTIFY_STRING | NOTIFY_LIST | NOTIFY_SET | NOTIFY_HASH |
+                 NOTIFY_ZSET | NOTIFY_EXPIRED | NOTIFY_EVICTED | NOTIFY_STREAM // A
+};
+
+// Replicas sharing one diskless full sync. Guarded by
+// Database::replication_mutex; cv is signalled when replicas join and when
+// the transfer is over.
+struct DisklessSync {
+    std::vector<std::shared_ptr<Client>> replicas;
+    bool finished = false;
+    std::condition_variable cv;
+};
+
+// A client blocked in WAIT. Guarded by Database::replication_mutex.
+struct WaitRequest {
+    int needed = 0; // replicas that must acknowledge
+    int acked = 0;  // replicas that have so far
+    std::condition_variable cv;
+};
+
+// RDB save status. Guarded by Database::persistence_mutex, which is taken
+// after kv_mutex when both are needed.
+struct PersistenceState {
+    std::vector<std::pair<long long, long long>> save_params{{3600, 1}, {300, 100}, {60, 10000}};
+    long long last_save_time = 0; // unix seconds of the last successful save
+    pid_t bgsave_child = -1;
+    std::string bgsave_temp_path;
+    long long bgsave_start_ms = 0;
+    long long dirty_at_bgsave = 0;
+    long long last_bgsave_try_ms = 0;
+    bool last_bgsave_ok = true;
+    long long last_bgsave_duration = -1; // seconds
+
+    // AOF rewrite. The child writes a new base while the parent logs to the
+    // incremental file opened when it forked, the first one the new
+    // manifest keeps. A rewrite asked for during a BGSAVE is scheduled and
+    // started by cron once the BGSAVE is done.
+    long long auto_aof_rewrite_percentage = 100;
+    long long auto_aof_rewrite_min_size = 64 * 1024 * 1024;
+    AOFManifest aof_manifest;
+    bool aof_wait_rewrite = false; // the AOF is on but has no base yet
+    pid_t aof_rewrite_child = -1;
+    std::string aof_rewrite_temp_path;
+    long long aof_rewrite_incr_seq = 0;
+    long long aof_rewrite_start_ms = 0;
+    bool aof_rewrite_scheduled = false;
+    long long last_aof_rewrite_try_ms = 0;
+    bool last_aof_rewrite_ok = true;
+    long long last_aof_rewrite_duration = -1; // seconds
+    long long aof_fixed_size = 0; // bytes in the manifest's files before the current one
+    long long aof_base_size = 0;  // AOF size after the last rewrite or load
+};
+
+// Progress of an RDB load (at startup or from a master), for INFO. The
+// loader updates it without taking any lock.
+struct LoadingState {
+    std::atomic<bool> in_progress{false};
+    std::atomic<long long> start_ms{0};
+    std::atomic<long long> total_bytes{0}; // 0 when unknown, as in a diskless sync
+    std::atomic<long long> loaded_bytes{0};
+    std::atomic<long long> last_keys_loaded{0};
+};
+
 struct User {
     std::string name;
     std::set<std::string> flags;
     std::vector<std::string> passwords;
 };
 
+// One class of client-output-buffer-limit. A client whose queued output
+// exceeds hard, or stays above soft for soft_seconds, is disconnected.
+// Zero disables a limit.
+struct OutputBufferLimit {
+    std::atomic<size_t> hard;
+    std::atomic<size_t> soft;
+    std::atomic<long long> soft_seconds;
+
+    OutputBufferLimit(size_t hard, size_t soft, long long soft_seconds)
+        : hard(hard), soft(soft), soft_seconds(soft_seconds) {}
+};
+
 struct ServerConfig {
     std::string dir = "/tmp/redis-data";
     std::string dbfilename = "dump.rdb";
+    // With appendonly, the keyspace is rebuilt at startup from the AOF in
+    // dir/appenddirname instead of from the dump. Its files are named after
+    // appendfilename.
+    std::atomic<bool> appendonly{false};
+    std::string appendfilename = "appendonly.aof";
+    std::string appenddirname = "appendonlydir";
     int port = 6379;
     std::string role = "master"; 
     std::string master_host;
     int master_port = 6379;
     
-    std::string master_replid = "8371b4fb1155b71f4a04d3e1bc3e18c4a990aeeb";
+    // Replication IDs and offsets are guarded by Database::replication_mutex.
+    // replid2 is the ID this server followed before its last promotion; a
+    // replica of that old history can still continue up to second_repl_offset.
+    std::string master_replid;
+    std::string master_replid2 = std::string(40, '0');
     long long master_repl_offset = 0;
+    long long second_repl_offset = -1;
+    size_t repl_backlog_size = 1024 * 1024;
+
+    // With diskless sync the snapshot is streamed straight to replica
+    // sockets. The first replica waits repl_diskless_sync_delay seconds, or
+    // until repl_diskless_sync_max_replicas (if non-zero) are waiting, so
+    // that replicas attaching together share one snapshot.
+    std::atomic<bool> repl_diskless_sync{false};
+    std::atomic<int> repl_diskless_sync_delay{5};
+    std::atomic<int> repl_diskless_sync_max_replicas{0};
+
+    OutputBufferLimit pubsub_limit{32 * 1024 * 1024, 8 * 1024 * 1024, 60};
+    OutputBufferLimit replica_limit{256 * 1024 * 1024, 64 * 1024 * 1024, 60};
+
+    // NotifyFlags; zero unless K or E is set, so a disabled feature fails
+    // the first bit test.
+    std::atomic<uint32_t> notify_keyspace_events{0};
 };
 
 class Database {
 public:
     std::unordered_map<std::string, Entry> kv_store;
-    std::mutex kv_mutex;
+    // Recursive so EXEC can hold it across a whole transaction while each
+    // queued command takes it again.
+    std::recursive_mutex kv_mutex;
     std::unordered_map<std::string, std::queue<std::weak_ptr<BlockedClient>>> blocking_keys;
+    // Clients WATCHing each key. Guarded by kv_mutex; a client removes
+    // itself before it is destroyed.
+    std::unordered_map<std::string, std::vector<Client*>> watched_keys;
 
-    std::mutex pubsub_mutex;
-    std::unordered_map<std::string, std::set<Client*>> pubsub_channels;
+    ChannelRegistry pubsub_channels;
+    ChannelRegistry pubsub_shard_channels;
+
+    std::mutex pubsub_mutex; // guards pubsub_patterns
+    PatternTrie pubsub_patterns;
+
+    std::atomic<long long> dirty{0}; // key changes since the last successful save
+    std::mutex persistence_mutex;
+    PersistenceState persistence;
+    LoadingState loading;
+    AppendOnlyFile aof;
+    bool replaying_aof = false; // keys don't expire while the AOF is replayed at startup
 
     std::mutex acl_mutex;
     std::unordered_map<std::string, User> users;
 
+    // Held from execution to propagation of a write command, so writes reach
+    // replicas in the order they were applied and a full resync can snapshot
+    // the keyspace between two commands.
+    std::mutex propagation_mutex;
+
     std::mutex replication_mutex;
     std::vector<std::weak_ptr<Client>> replicas;
+    std::unique_ptr<ReplicationBacklog> repl_backlog; // created when the first replica attaches
+    int master_link_fd = -1; // replica side: socket to the master, -1 when down
+    bool master_link_up = false; // replica side: synced and following the stream
+    std::shared_ptr<DisklessSync> diskless_sync; // still accepting replicas, else null
     
-    long long bytes_processed = 0;
-    std::condition_variable wait_cv;
+    // WAIT callers keyed by the offset they need acknowledged, so an ACK
+    // visits only the waiters it newly satisfies. getack_offset is the
+    // stream offset just before the last GETACK we sent.
+    std::multimap<long long, std::shared_ptr<WaitRequest>> wait_requests;
+    long long getack_offset = -1;
+
+    // Replica side: master stream bytes applied. Written by the master link
+    // only, read by INFO and REPLCONF GETACK from other client threads.
+    std::atomic<long long> bytes_processed{0};
     
     ServerConfig config;
 
     Database();
     void notify_blocked_clients(const std::string& key);
     bool is_expired(const Entry& entry);
+
+    // Erases a key whose TTL has passed and fires its "expired" event.
+    // Returns the iterator following it. Callers hold kv_mutex.
+    std::unordered_map<std::string, Entry>::iterator expire_key(std::unordered_map<std::string, Entry>::iterator it);
+
+    // Fans a message out to channel and pattern subscribers and returns the
+    // number of clients it was queued for.
+    int publish(const std::string& channel, const std::string& message);
+    int spublish(const std::string& channel, const std::string& message);
+
+    // Called on every change to a key, with kv_mutex held: counts it towards
+    // the next save, invalidates WATCHes on it and publishes the event if
+    // its class is enabled.
+    void notify_keyspace_event(uint32_t type, const char* event, const std::string& key) {
+        dirty.fetch_add(1, std::memory_order_relaxed);
+        if (!watched_keys.empty()) touch_watched_key(key);
+        if (config.notify_keyspace_events.load(std::memory_order_relaxed) & type) {
+            publish_keyspace_event(event, key);
+        }
+    }
     void load_from_file(); 
+
+    // Makes the next EXEC of every client watching key (or any key) fail.
+    // Callers hold kv_mutex.
+    void touch_watched_key(const std::string& key);
+    void touch_all_watched_keys();
+
+    // Drops all of client's WATCHes. Callers hold kv_mutex.
+    void unwatch_all(Client& client);
+
+    // Appends msg to the replication stream: backlog, offset and every
+    // replica's queue. Callers hold replication_mutex.
+    void feed_replicas(std::shared_ptr<const std::string> msg);
+
+    // Starts a new replication history, keeping the current one as replid2
+    // so replicas that followed it can still partially resync. Callers hold
+    // replication_mutex.
+    void shift_replication_id();
+
+    // Records that replica has processed the stream up to offset and wakes
+    // the WAIT callers that satisfies. Callers hold replication_mutex.
+    void replica_acked(Client& replica, long long offset);
+
+    // Number of live replicas that have acknowledged offset. Callers hold
+    // replication_mutex.
+    int count_replicas_acked(long long offset);
+
+    // Drops every attached replica so it reconnects and resyncs against our
+    // current history. Callers hold replication_mutex.
+    void disconnect_replicas();
+
+private:
+    void publish_keyspace_event(const char* event, const std::string& key);
+};
+
+// What a blocked write command waits on. The command runs holding
+// propagation_mutex and kv_mutex like any write; waiting releases both and
+// waking takes them back in lock order. The write that wakes the client is
+// therefore propagated before the client's own, and nothing queues behind
+// propagation_mutex while a client is blocked.
+class BlockedWriteLock {
+public:
+    explicit BlockedWriteLock(Database& db) : db(db) {}
+
+    void lock() {
+        db.propagation_mutex.lock();
+        db.kv_mutex.lock();
+    }
+    void unlock() {
+        db.kv_mutex.unlock();
+        db.propagation_mutex.unlock();
+    }
+
+private:
+    Database& db;
 };
\ No newline at end of file
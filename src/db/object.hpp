@@ -4,6 +4,7 @@
 #include <vector>
 #include <unordered_map>
 #include <set>
+#include <map>
 #include <utility>
 #include <cstdint>
 
@@ -29,11 +30,62 @@ struct ZSet {
     std::set<std::pair<double, std::string>, ScoreMemberCompare> tree;
 };
 
-struct StreamEntry {
-    std::string id_str;
-    uint64_t ms;
-    uint64_t seq;
-    std::vector<std::pair<std::string, std::string>> pairs;
+struct StreamID {
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+
+    bool operator<(const StreamID& other) const {
+        if (ms != other.ms) return ms < other.ms;
+        return seq < other.seq;
+    }
+    bool operator>(const StreamID& other) const { return other < *this; }
+    bool operator<=(const StreamID& other) const { return !(other < *this); }
+    bool operator>=(const StreamID& other) const { return !(*this < other); }
+    bool operator==(const StreamID& other) const { return ms == other.ms && seq == other.seq; }
+    bool operator!=(const StreamID& other) const { return !(*this == other); }
+
+    std::string to_string() const { return std::to_string(ms) + "-" + std::to_string(seq); }
+};
+
+// A run of consecutive stream entries packed into one buffer. Entry IDs are
+// stored as varint deltas from master_id, and entries whose field names match
+// master_fields store only their values.
+struct StreamBlock {
+    StreamID master_id;
+    StreamID last_id;
+    std::vector<std::string> master_fields;
+    std::string data;
+    uint32_t entries = 0;
+    uint32_t live = 0;
+};
+
+struct StreamPendingEntry {
+    std::string consumer;
+    long long delivery_time = 0;
+    uint64_t delivery_count = 0;
+};
+
+struct StreamConsumer {
+    long long seen_time = 0;
+    long long active_time = -1;
+    std::set<StreamID> pending;
+};
+
+// Pending entries are indexed by ID in the group and again per consumer, so
+// acking or claiming an entry is a pair of O(log n) tree operations.
+struct StreamConsumerGroup {
+    StreamID last_delivered;
+    std::map<StreamID, StreamPendingEntry> pending;
+    std::map<std::string, StreamConsumer> consumers;
+};
+
+struct Stream {
+    std::map<StreamID, StreamBlock> blocks; // keyed by each block's master_id
+    StreamID last_id;
+    uint64_t length = 0;
+    uint64_t entries_added = 0; // every entry ever appended, deleted or not
+    StreamID max_deleted_id;    // highest ID removed by XDEL
+    std::map<std::string, StreamConsumerGroup> groups;
 };
 
 struct Entry {
@@ -41,6 +93,6 @@ struct Entry {
     std::string string_val;
     std::deque<std::string> list_val; 
     ZSet zset_val;
-    std::vector<StreamEntry> stream_val;
+    Stream stream_val;
     long long expiry_at = 0;
 };
\ No newline at end of file
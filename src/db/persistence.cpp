@@ -0,0 +1,575 @@
+#include "persistence.hpp"
+#include "rdb_writer.hpp"
+#include "../utils/utils.hpp"
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// A failed BGSAVE or AOF rewrite is not retried by cron for this long.
+const long long RETRY_DELAY_MS = 5000;
+
+std::string dump_path(const Database& db) {
+    return db.config.dir + "/" + db.config.dbfilename;
+}
+
+std::string aof_dir(const Database& db) {
+    return db.config.dir + "/" + db.config.appenddirname;
+}
+
+std::string manifest_path(const Database& db) {
+    return aof_dir(db) + "/" + db.config.appendfilename + ".manifest";
+}
+
+long long file_size(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : 0;
+}
+
+// Syncs the directory holding path, so a rename into it survives a crash.
+void sync_parent_dir(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+// Renames the finished temp file over target and syncs the directory so
+// the rename itself survives a crash.
+bool install_file(const std::string& temp_path, const std::string& target) {
+    if (rename(temp_path.c_str(), target.c_str()) != 0) {
+        std::cerr << "Failed to rename " << temp_path << ": " << std::strerror(errno) << "\n";
+        unlink(temp_path.c_str());
+        return false;
+    }
+    sync_parent_dir(target);
+    return true;
+}
+
+bool install_dump(const Database& db, const std::string& temp_path) {
+    return install_file(temp_path, dump_path(db));
+}
+
+// Progress and throughput of a load in progress. ETA and percentage are
+// only known when the payload size is; a diskless sync doesn't send it.
+std::string loading_info(const LoadingState& loading) {
+    if (!loading.in_progress) return "loading:0\r\n";
+
+    long long start_ms = loading.start_ms;
+    long long total = loading.total_bytes;
+    long long loaded = loading.loaded_bytes;
+    long long elapsed_ms = std::max(1LL, current_time_ms() - start_ms);
+    long long rate = loaded * 1000 / elapsed_ms;
+
+    char perc[32];
+    snprintf(perc, sizeof(perc), "%.2f%%", total > 0 ? loaded * 100.0 / total : 0.0);
+    long long eta = total > 0 && rate > 0 ? (total - loaded) / rate : -1;
+
+    std::string content = "loading:1\r\n";
+    content += "loading_start_time:" + std::to_string(start_ms / 1000) + "\r\n";
+    content += "loading_total_bytes:" + std::to_string(total) + "\r\n";
+    content += "loading_loaded_bytes:" + std::to_string(loaded) + "\r\n";
+    content += "loading_loaded_perc:" + std::string(perc) + "\r\n";
+    content += "loading_loaded_bytes_per_sec:" + std::to_string(rate) + "\r\n";
+    content += "loading_eta_seconds:" + std::to_string(eta) + "\r\n";
+    return content;
+}
+
+int open_temp_file(const Database& db, const std::string& name, std::string& path) {
+    path = db.config.dir + "/" + name;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed opening the temp file " << path << ": " << std::strerror(errno) << "\n";
+    }
+    return fd;
+}
+
+bool make_aof_dir(const Database& db) {
+    std::string dir = aof_dir(db);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Can't create the AOF directory " << dir << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool write_manifest(const Database& db, const AOFManifest& manifest) {
+    std::string temp_path;
+    int fd = open_temp_file(db, db.config.appenddirname + "/temp-" + db.config.appendfilename + ".manifest", temp_path);
+    if (fd < 0) return false;
+
+    std::string content = manifest.to_string();
+    size_t done = 0;
+    while (done < content.size()) {
+        ssize_t n = write(fd, content.data() + done, content.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    bool ok = done == content.size() && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        std::cerr << "Error writing " << temp_path << "\n";
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return install_file(temp_path, manifest_path(db));
+}
+
+// Points the AOF at a new, empty incremental file. Unless the AOF is still
+// waiting for its first base, the manifest listing the file is installed
+// before any write goes to it, so after a crash the loader finds them all.
+bool open_new_incr(Database& db, PersistenceState& state) {
+    AOFManifest manifest = state.aof_manifest;
+    AOFManifest::File incr = manifest.next_incr(db.config.appendfilename);
+    manifest.incrs.push_back(incr);
+
+    // Truncated, as one may be left over from an AOF that never got its base.
+    std::string path = aof_dir(db) + "/" + incr.name;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Can't create " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    close(fd);
+    if (!state.aof_wait_rewrite && !write_manifest(db, manifest)) {
+        unlink(path.c_str());
+        return false;
+    }
+
+    long long previous_size = db.aof.enabled() ? db.aof.size() : 0;
+    db.aof.stop();
+    if (!db.aof.start(path)) {
+        std::cerr << "Failed to open " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    state.aof_manifest = std::move(manifest);
+    state.aof_fixed_size += previous_size;
+    return true;
+}
+
+std::string fork_aof_rewrite(Database& db, PersistenceState& state) {
+    state.last_aof_rewrite_try_ms = current_time_ms();
+    std::string temp_path;
+    int fd = open_temp_file(db, db.config.appenddirname + "/temp-rewriteaof-bg-" + std::to_string(getpid()) + ".aof",
+                            temp_path);
+    if (fd < 0) {
+        state.last_aof_rewrite_ok = false;
+        return "-ERR Failed opening the temp AOF file\r\n";
+    }
+
+    // The new base is an RDB snapshot, the same the child of a BGSAVE writes.
+    pid_t child = RDBWriter::fork_snapshot(db, fd);
+    close(fd);
+    if (child < 0) {
+        unlink(temp_path.c_str());
+        state.last_aof_rewrite_ok = false;
+        return "-ERR Can't fork the AOF rewrite process\r\n";
+    }
+
+    state.aof_rewrite_child = child;
+    state.aof_rewrite_temp_path = temp_path;
+    state.aof_rewrite_start_ms = state.last_aof_rewrite_try_ms;
+    state.aof_rewrite_scheduled = false;
+    // Everything logged from this incremental file on is missing from the
+    // snapshot. With the AOF off there is none to keep.
+    state.aof_rewrite_incr_seq = db.aof.enabled() ? state.aof_manifest.incrs.back().seq
+                                                  : state.aof_manifest.next_incr(db.config.appendfilename).seq;
+    return "";
+}
+
+void kill_aof_rewrite(PersistenceState& state) {
+    if (state.aof_rewrite_child <= 0) return;
+    kill(state.aof_rewrite_child, SIGKILL);
+    waitpid(state.aof_rewrite_child, nullptr, 0);
+    unlink(state.aof_rewrite_temp_path.c_str());
+    state.aof_rewrite_child = -1;
+}
+
+// Installs the new base and a manifest listing it and the incremental files
+// written since the fork, then deletes the files it replaces.
+bool finish_aof_rewrite(Database& db, PersistenceState& state) {
+    const AOFManifest& old_manifest = state.aof_manifest;
+    AOFManifest manifest;
+    manifest.base = old_manifest.next_base(db.config.appendfilename);
+    for (const auto& incr : old_manifest.incrs) {
+        if (incr.seq >= state.aof_rewrite_incr_seq) manifest.incrs.push_back(incr);
+    }
+
+    std::string dir = aof_dir(db);
+    std::string base_path = dir + "/" + manifest.base.name;
+    if (!install_file(state.aof_rewrite_temp_path, base_path)) return false;
+    if (!write_manifest(db, manifest)) {
+        unlink(base_path.c_str());
+        return false;
+    }
+
+    std::vector<std::string> kept = manifest.files();
+    for (const auto& name : old_manifest.files()) {
+        if (std::find(kept.begin(), kept.end(), name) == kept.end()) unlink((dir + "/" + name).c_str());
+    }
+
+    long long fixed_size = 0;
+    for (const auto& name : kept) fixed_size += file_size(dir + "/" + name);
+    long long current_size = 0;
+    if (db.aof.enabled()) {
+        current_size = db.aof.size();
+        fixed_size -= file_size(dir + "/" + manifest.incrs.back().name);
+    }
+
+    state.aof_manifest = std::move(manifest);
+    state.aof_wait_rewrite = false;
+    state.aof_fixed_size = fixed_size;
+    state.aof_base_size = fixed_size + current_size;
+    return true;
+}
+
+void reap_aof_rewrite(Database& db, PersistenceState& state, long long now_ms) {
+    int status = 0;
+    pid_t done = waitpid(state.aof_rewrite_child, &status, WNOHANG);
+    if (done == 0 || (done < 0 && errno == EINTR)) return;
+
+    bool ok = done > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (ok) {
+        ok = finish_aof_rewrite(db, state);
+    } else {
+        std::cerr << "Background AOF rewrite error\n";
+        unlink(state.aof_rewrite_temp_path.c_str());
+    }
+    if (ok) std::cerr << "Background AOF rewrite finished successfully\n";
+    state.last_aof_rewrite_ok = ok;
+    state.last_aof_rewrite_duration = (now_ms - state.aof_rewrite_start_ms) / 1000;
+    state.aof_rewrite_child = -1;
+}
+
+bool aof_rewrite_due(Database& db, const PersistenceState& state, long long now_ms) {
+    if (state.aof_rewrite_scheduled) return true;
+    // An AOF without a base can't be loaded, so its rewrite is retried.
+    if (state.aof_wait_rewrite) return now_ms - state.last_aof_rewrite_try_ms >= RETRY_DELAY_MS;
+    if (!db.aof.enabled() || state.auto_aof_rewrite_percentage <= 0) return false;
+    if (!state.last_aof_rewrite_ok && now_ms - state.last_aof_rewrite_try_ms < RETRY_DELAY_MS) return false;
+
+    long long size = state.aof_fixed_size + db.aof.size();
+    if (size < state.auto_aof_rewrite_min_size) return false;
+    long long base = state.aof_base_size > 0 ? state.aof_base_size : 1;
+    return (size - base) * 100 / base >= state.auto_aof_rewrite_percentage;
+}
+
+}
+
+bool Persistence::save(Database& db) {
+    std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    if (db.persistence.bgsave_child > 0) return false;
+
+    std::string temp_path;
+    int fd = open_temp_file(db, "temp-" + std::to_string(getpid()) + ".rdb", temp_path);
+    if (fd < 0) return false;
+
+    RDBWriter writer(fd);
+    bool ok = writer.save(db.kv_store) && fsync(fd) == 0;
+    close(fd);
+    if (!ok) {
+        std::cerr << "Error writing " << temp_path << "\n";
+        unlink(temp_path.c_str());
+        return false;
+    }
+    if (!install_dump(db, temp_path)) return false;
+
+    db.dirty = 0;
+    db.persistence.last_save_time = current_time_ms() / 1000;
+    return true;
+}
+
+std::string Persistence::start_bgsave(Database& db) {
+    std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    PersistenceState& state = db.persistence;
+    if (state.bgsave_child > 0) return "-ERR Background save already in progress\r\n";
+    if (state.aof_rewrite_child > 0) return "-ERR Another child process is active (AOF?): can't BGSAVE right now\r\n";
+
+    state.last_bgsave_try_ms = current_time_ms();
+    std::string temp_path;
+    int fd = open_temp_file(db, "temp-bgsave-" + std::to_string(getpid()) + ".rdb", temp_path);
+    if (fd < 0) {
+        state.last_bgsave_ok = false;
+        return "-ERR Failed opening the temp RDB file\r\n";
+    }
+
+    // The child gets a copy-on-write image of the keyspace as of this moment.
+    pid_t child = RDBWriter::fork_snapshot(db, fd);
+    close(fd);
+    if (child < 0) {
+        unlink(temp_path.c_str());
+        state.last_bgsave_ok = false;
+        return "-ERR Can't fork the background save process\r\n";
+    }
+
+    state.bgsave_child = child;
+    state.bgsave_temp_path = temp_path;
+    state.bgsave_start_ms = state.last_bgsave_try_ms;
+    state.dirty_at_bgsave = db.dirty;
+    return "";
+}
+
+void Persistence::cron(Database& db) {
+    bool due = false;
+    bool rewrite_due = false;
+    {
+        std::lock_guard<std::mutex> lock(db.persistence_mutex);
+        PersistenceState& state = db.persistence;
+        long long now_ms = current_time_ms();
+
+        if (state.aof_rewrite_child > 0) {
+            reap_aof_rewrite(db, state, now_ms);
+            return;
+        }
+
+        if (state.bgsave_child > 0) {
+            int status = 0;
+            pid_t done = waitpid(state.bgsave_child, &status, WNOHANG);
+            if (done == 0 || (done < 0 && errno == EINTR)) return;
+
+            bool ok = done > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            if (ok) {
+                ok = install_dump(db, state.bgsave_temp_path);
+            } else {
+                std::cerr << "Background saving error\n";
+                unlink(state.bgsave_temp_path.c_str());
+            }
+            if (ok) {
+                // Changes made while the child ran are still unsaved.
+                db.dirty -= state.dirty_at_bgsave;
+                state.last_save_time = now_ms / 1000;
+            }
+            state.last_bgsave_ok = ok;
+            state.last_bgsave_duration = (now_ms - state.bgsave_start_ms) / 1000;
+            state.bgsave_child = -1;
+            return;
+        }
+
+        // Only one child runs at a time; a due rewrite goes first.
+        rewrite_due = aof_rewrite_due(db, state, now_ms);
+
+        // After a failure, wait a little before trying again so a full
+        // disk or a missing directory doesn't turn into a fork loop.
+        bool may_retry = state.last_bgsave_ok || now_ms - state.last_bgsave_try_ms >= RETRY_DELAY_MS;
+
+        long long dirty = db.dirty;
+        long long since_save = now_ms / 1000 - state.last_save_time;
+        for (const auto& [seconds, changes] : state.save_params) {
+            if (!rewrite_due && may_retry && dirty >= changes && since_save >= seconds) {
+                due = true;
+                break;
+            }
+        }
+    }
+
+    if (rewrite_due) {
+        std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+        std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+        start_aof_rewrite(db);
+    } else if (due) {
+        start_bgsave(db);
+    }
+}
+
+std::string Persistence::info(Database& db) {
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    const PersistenceState& state = db.persistence;
+    bool in_progress = state.bgsave_child > 0;
+
+    std::string content = loading_info(db.loading);
+    content += "rdb_changes_since_last_save:" + std::to_string(db.dirty) + "\r\n";
+    content += "rdb_bgsave_in_progress:" + std::string(in_progress ? "1" : "0") + "\r\n";
+    content += "rdb_last_save_time:" + std::to_string(state.last_save_time) + "\r\n";
+    content += "rdb_last_bgsave_status:" + std::string(state.last_bgsave_ok ? "ok" : "err") + "\r\n";
+    content += "rdb_last_bgsave_time_sec:" + std::to_string(state.last_bgsave_duration) + "\r\n";
+    content += "rdb_current_bgsave_time_sec:" +
+               std::to_string(in_progress ? (current_time_ms() - state.bgsave_start_ms) / 1000 : -1) + "\r\n";
+    content += "rdb_last_load_keys_loaded:" + std::to_string(db.loading.last_keys_loaded) + "\r\n";
+    content += db.aof.info();
+
+    bool rewriting = state.aof_rewrite_child > 0;
+    content += "aof_rewrite_in_progress:" + std::string(rewriting ? "1" : "0") + "\r\n";
+    content += "aof_rewrite_scheduled:" + std::string(state.aof_rewrite_scheduled ? "1" : "0") + "\r\n";
+    content += "aof_last_rewrite_time_sec:" + std::to_string(state.last_aof_rewrite_duration) + "\r\n";
+    content += "aof_current_rewrite_time_sec:" +
+               std::to_string(rewriting ? (current_time_ms() - state.aof_rewrite_start_ms) / 1000 : -1) + "\r\n";
+    content += "aof_last_bgrewrite_status:" + std::string(state.last_aof_rewrite_ok ? "ok" : "err") + "\r\n";
+    if (db.aof.enabled()) {
+        content += "aof_current_size:" + std::to_string(state.aof_fixed_size + db.aof.size()) + "\r\n";
+        content += "aof_base_size:" + std::to_string(state.aof_base_size) + "\r\n";
+    }
+    return content;
+}
+
+bool Persistence::find_aof(Database& db, AOFManifest& out, std::string& error) {
+    std::string dir = aof_dir(db);
+    std::string legacy_path = db.config.dir + "/" + db.config.appendfilename;
+    std::string legacy_target = dir + "/" + db.config.appendfilename;
+
+    std::ifstream in(manifest_path(db));
+    if (in) {
+        std::stringstream content;
+        content << in.rdbuf();
+        if (!AOFManifest::parse(content.str(), out, error)) return false;
+
+        // A crash during the move below leaves the old file outside.
+        if (out.base.name == db.config.appendfilename && access(legacy_target.c_str(), F_OK) != 0 &&
+            access(legacy_path.c_str(), F_OK) == 0) {
+            if (rename(legacy_path.c_str(), legacy_target.c_str()) != 0) {
+                error = "Can't move " + legacy_path + " into " + dir + ": " + std::strerror(errno);
+                return false;
+            }
+            sync_parent_dir(legacy_target);
+        }
+        return true;
+    }
+    if (errno != ENOENT) {
+        error = "Can't read " + manifest_path(db) + ": " + std::strerror(errno);
+        return false;
+    }
+
+    out = AOFManifest();
+    if (access(legacy_path.c_str(), F_OK) != 0) return true;
+
+    // The manifest goes in first, so the file is found again wherever a
+    // crash leaves it.
+    std::cerr << "Moving the AOF " << legacy_path << " into " << dir << "\n";
+    out.base.name = db.config.appendfilename;
+    out.base.seq = 1;
+    if (!make_aof_dir(db) || !write_manifest(db, out)) {
+        error = "Can't create the AOF manifest in " + dir;
+        return false;
+    }
+    if (rename(legacy_path.c_str(), legacy_target.c_str()) != 0) {
+        error = "Can't move " + legacy_path + " into " + dir + ": " + std::strerror(errno);
+        return false;
+    }
+    sync_parent_dir(legacy_target);
+    return true;
+}
+
+std::vector<std::string> Persistence::aof_paths(const Database& db, const AOFManifest& manifest) {
+    std::vector<std::string> paths;
+    for (const auto& name : manifest.files()) paths.push_back(aof_dir(db) + "/" + name);
+    return paths;
+}
+
+bool Persistence::resume_aof(Database& db, const AOFManifest& manifest) {
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    PersistenceState& state = db.persistence;
+    state.aof_manifest = manifest;
+    state.aof_wait_rewrite = false;
+
+    long long total = 0;
+    for (const auto& path : aof_paths(db, manifest)) total += file_size(path);
+    state.aof_base_size = total;
+    state.aof_fixed_size = total;
+
+    // An AOF moved in from a single file has no incremental file yet.
+    if (manifest.incrs.empty()) return open_new_incr(db, state);
+
+    std::string path = aof_dir(db) + "/" + manifest.incrs.back().name;
+    state.aof_fixed_size -= file_size(path);
+    if (!db.aof.start(path)) {
+        std::cerr << "Failed to open " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool Persistence::start_aof(Database& db) {
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    PersistenceState& state = db.persistence;
+    kill_aof_rewrite(state);
+    db.aof.stop();
+
+    // Until the rewrite installs a base, the manifest on disk still
+    // describes the previous AOF, if any, and the new file isn't listed.
+    state.aof_wait_rewrite = true;
+    if (!make_aof_dir(db) || !open_new_incr(db, state)) {
+        state.aof_wait_rewrite = false;
+        return false;
+    }
+
+    if (state.bgsave_child > 0) {
+        state.aof_rewrite_scheduled = true;
+        return true;
+    }
+    // A rewrite that fails to start is retried by cron.
+    std::string error = fork_aof_rewrite(db, state);
+    if (!error.empty()) std::cerr << "Can't start the AOF rewrite: " << error;
+    return true;
+}
+
+void Persistence::stop_aof(Database& db) {
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    PersistenceState& state = db.persistence;
+    kill_aof_rewrite(state);
+    state.aof_rewrite_scheduled = false;
+    state.aof_wait_rewrite = false;
+    db.aof.stop();
+}
+
+std::string Persistence::start_aof_rewrite(Database& db) {
+    std::lock_guard<std::mutex> lock(db.persistence_mutex);
+    PersistenceState& state = db.persistence;
+    if (state.aof_rewrite_child > 0) return "-ERR Background append only file rewriting already in progress\r\n";
+    if (state.bgsave_child > 0) {
+        state.aof_rewrite_scheduled = true;
+        return "";
+    }
+
+    if (!make_aof_dir(db)) {
+        state.last_aof_rewrite_ok = false;
+        return "-ERR Can't create the AOF directory\r\n";
+    }
+    if (db.aof.enabled() && !open_new_incr(db, state)) {
+        state.last_aof_rewrite_ok = false;
+        return "-ERR Can't open a new AOF incremental file\r\n";
+    }
+    return fork_aof_rewrite(db, state);
+}
+
+bool Persistence::parse_save_params(const std::string& str, std::vector<std::pair<long long, long long>>& out) {
+    std::istringstream in(str);
+    std::vector<std::pair<long long, long long>> params;
+    std::string seconds, changes;
+    while (in >> seconds) {
+        if (!(in >> changes)) return false;
+        try {
+            long long s = std::stoll(seconds);
+            long long c = std::stoll(changes);
+            if (s < 0 || c < 0) return false;
+            params.emplace_back(s, c);
+        } catch (...) {
+            return false;
+        }
+    }
+    out = std::move(params);
+    return true;
+}
+
+std::string Persistence::save_params_to_string(const std::vector<std::pair<long long, long long>>& params) {
+    std::string out;
+    for (const auto& [seconds, changes] : params) {
+        if (!out.empty()) out += " ";
+        out += std::to_string(seconds) + " " + std::to_string(changes);
+    }
+    return out;
+}
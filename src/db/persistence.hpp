@@ -0,0 +1,59 @@
+#pragma once
+#include "database.hpp"
+#include <string>
+
+// RDB snapshots of the keyspace: SAVE in the foreground, BGSAVE in a forked
+// child, and the "save <seconds> <changes>" schedule. Both write a temp file
+// in the data directory and rename it over dbfilename only once it is
+// complete and synced, so a crash never leaves a truncated dump behind.
+// AOF base files and manifests are installed the same way.
+class Persistence {
+public:
+    // Saves synchronously while holding kv_mutex. Returns false on failure.
+    static bool save(Database& db);
+
+    // Forks a child to save the keyspace. Returns an error reply, or an
+    // empty string once the child is running.
+    static std::string start_bgsave(Database& db);
+
+    // Called periodically: reaps a finished BGSAVE or AOF rewrite child,
+    // and starts a new one when a save rule is due or the AOF has grown by
+    // auto_aof_rewrite_percentage since its last rewrite.
+    static void cron(Database& db);
+
+    // The AOF is a directory, dir/appenddirname, holding the files listed in
+    // its manifest; see AOFManifest.
+
+    // Finds the AOF to load at startup. Leaves out empty if there is none. A
+    // single-file AOF from before the manifest is moved into the directory
+    // as its base.
+    static bool find_aof(Database& db, AOFManifest& out, std::string& error);
+    static std::vector<std::string> aof_paths(const Database& db, const AOFManifest& manifest);
+
+    // After the AOF has been loaded, resumes appending to its last
+    // incremental file.
+    static bool resume_aof(Database& db, const AOFManifest& manifest);
+
+    // Turns the AOF on from the keyspace as it is now: writes go to a new
+    // incremental file straight away, and a background rewrite writes the
+    // base that makes it loadable. Any previous AOF stays in place until
+    // then. Callers hold propagation_mutex and kv_mutex, so no write falls
+    // between the snapshot and the log. Returns false with the AOF off if
+    // the new file can't be created.
+    static bool start_aof(Database& db);
+    static void stop_aof(Database& db);
+
+    // BGREWRITEAOF: switches writes to a new incremental file and forks a
+    // child to write a new base, replacing all earlier files once it is
+    // done. With the AOF off only the base is written. Callers hold
+    // propagation_mutex and kv_mutex. Returns an error reply, or an empty
+    // string once the child is running or the rewrite is scheduled.
+    static std::string start_aof_rewrite(Database& db);
+
+    // Body of the "# Persistence" INFO section.
+    static std::string info(Database& db);
+
+    // Parses "<seconds> <changes> ..." as accepted by CONFIG SET save.
+    static bool parse_save_params(const std::string& str, std::vector<std::pair<long long, long long>>& out);
+    static std::string save_params_to_string(const std::vector<std::pair<long long, long long>>& params);
+};
@@ -1,68 +1,974 @@
 #include "rdb_loader.hpp"
+#include "structs/redis_stream.hpp"
+#include "structs/redis_zset.hpp"
+#include "../utils/crc64.hpp"
+#include "../utils/lzf.hpp"
+#include "../utils/utils.hpp"
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t READ_CHUNK = 64 * 1024;
+
+// Files smaller than this are loaded by the calling thread alone.
+const size_t PARALLEL_LOAD_MIN_BYTES = 8 * 1024 * 1024;
+const unsigned LOAD_THREADS_MAX = 8;
+// Work handed to a decoder thread at a time.
+const size_t LOAD_BATCH_BYTES = 1024 * 1024;
+const size_t LOAD_BATCH_KEYS = 4096;
+const int RDB_VERSION_MAX = 12;
+
+const uint8_t RDB_OPCODE_SLOT_INFO = 0xF4;
+const uint8_t RDB_OPCODE_MODULE_AUX = 0xF5;
+const uint8_t RDB_OPCODE_FUNCTION2 = 0xF6;
+const uint8_t RDB_OPCODE_IDLE = 0xF8;
+const uint8_t RDB_OPCODE_FREQ = 0xF9;
+const uint8_t RDB_OPCODE_AUX = 0xFA;
+const uint8_t RDB_OPCODE_RESIZEDB = 0xFB;
+const uint8_t RDB_OPCODE_EXPIRETIME_MS = 0xFC;
+const uint8_t RDB_OPCODE_EXPIRETIME = 0xFD;
+const uint8_t RDB_OPCODE_SELECTDB = 0xFE;
+const uint8_t RDB_OPCODE_EOF = 0xFF;
+
+const int RDB_TYPE_STRING = 0;
+const int RDB_TYPE_LIST = 1;
+const int RDB_TYPE_SET = 2;
+const int RDB_TYPE_ZSET = 3;
+const int RDB_TYPE_HASH = 4;
+const int RDB_TYPE_ZSET_2 = 5;
+const int RDB_TYPE_MODULE_2 = 7;
+const int RDB_TYPE_HASH_ZIPMAP = 9;
+const int RDB_TYPE_LIST_ZIPLIST = 10;
+const int RDB_TYPE_SET_INTSET = 11;
+const int RDB_TYPE_ZSET_ZIPLIST = 12;
+const int RDB_TYPE_HASH_ZIPLIST = 13;
+const int RDB_TYPE_LIST_QUICKLIST = 14;
+const int RDB_TYPE_STREAM_LISTPACKS = 15;
+const int RDB_TYPE_HASH_LISTPACK = 16;
+const int RDB_TYPE_ZSET_LISTPACK = 17;
+const int RDB_TYPE_LIST_QUICKLIST_2 = 18;
+const int RDB_TYPE_STREAM_LISTPACKS_2 = 19;
+const int RDB_TYPE_SET_LISTPACK = 20;
+const int RDB_TYPE_STREAM_LISTPACKS_3 = 21;
+const int RDB_TYPE_HASH_METADATA = 24;
+const int RDB_TYPE_HASH_LISTPACK_EX = 25;
+
+const uint8_t RDB_ENC_LZF = 3;
+
+const uint64_t QUICKLIST_NODE_CONTAINER_PLAIN = 1;
+const uint64_t QUICKLIST_NODE_CONTAINER_PACKED = 2;
+
+// Opcodes inside a serialized module value.
+const uint64_t RDB_MODULE_OPCODE_EOF = 0;
+const uint64_t RDB_MODULE_OPCODE_SINT = 1;
+const uint64_t RDB_MODULE_OPCODE_UINT = 2;
+const uint64_t RDB_MODULE_OPCODE_FLOAT = 3;
+const uint64_t RDB_MODULE_OPCODE_DOUBLE = 4;
+const uint64_t RDB_MODULE_OPCODE_STRING = 5;
+
+StreamID decode_raw_id(const std::string& raw) {
+    if (raw.size() != 16) throw std::runtime_error("Invalid stream node key");
+    StreamID id;
+    for (int i = 0; i < 8; ++i) {
+        id.ms = (id.ms << 8) | static_cast<uint8_t>(raw[i]);
+        id.seq = (id.seq << 8) | static_cast<uint8_t>(raw[8 + i]);
+    }
+    return id;
+}
+
+// Decodes every element of a listpack. Integers come back in decimal, which
+// is how they were given to the encoder in the first place.
+std::vector<std::string> decode_listpack(const std::string& lp) {
+    if (lp.size() < 7) throw std::runtime_error("Invalid listpack");
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(lp.data());
+    const unsigned char* end = p + lp.size();
+    size_t pos = 6;
+    std::vector<std::string> out;
+
+    auto need = [&](size_t n) {
+        if (pos + n > lp.size()) throw std::runtime_error("Truncated listpack");
+    };
+    auto read_int = [&](size_t width) {
+        need(width);
+        uint64_t v = 0;
+        for (size_t i = 0; i < width; ++i) v |= static_cast<uint64_t>(p[pos + i]) << (8 * i);
+        pos += width;
+        // Sign-extend from width bytes.
+        if (width < 8 && (v >> (8 * width - 1)) & 1) v |= ~0ULL << (8 * width);
+        return static_cast<int64_t>(v);
+    };
+
+    while (true) {
+        need(1);
+        uint8_t c = p[pos];
+        if (c == 0xFF) break;
+
+        size_t start = pos;
+        if ((c & 0x80) == 0) {
+            out.push_back(std::to_string(c));
+            pos += 1;
+        } else if ((c & 0xC0) == 0x80) {
+            size_t len = c & 0x3F;
+            need(1 + len);
+            out.emplace_back(lp, pos + 1, len);
+            pos += 1 + len;
+        } else if ((c & 0xE0) == 0xC0) {
+            need(2);
+            int64_t v = ((c & 0x1F) << 8) | p[pos + 1];
+            if (v >= 4096) v -= 8192;
+            out.push_back(std::to_string(v));
+            pos += 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            need(2);
+            size_t len = ((c & 0x0F) << 8) | p[pos + 1];
+            need(2 + len);
+            out.emplace_back(lp, pos + 2, len);
+            pos += 2 + len;
+        } else if (c == 0xF0) {
+            pos += 1;
+            size_t len = static_cast<uint32_t>(read_int(4));
+            need(len);
+            out.emplace_back(lp, pos, len);
+            pos += len;
+        } else if (c >= 0xF1 && c <= 0xF4) {
+            static const size_t WIDTHS[] = {2, 3, 4, 8};
+            pos += 1;
+            out.push_back(std::to_string(read_int(WIDTHS[c - 0xF1])));
+        } else {
+            throw std::runtime_error("Invalid listpack encoding");
+        }
+
+        // Skip the backlen, whose size follows from the element's size.
+        size_t element = pos - start;
+        pos += element <= 127 ? 1 : element < 16383 ? 2 : element < 2097151 ? 3 : element < 268435455 ? 4 : 5;
+        if (p + pos > end) throw std::runtime_error("Truncated listpack");
+    }
+    return out;
+}
+
+// Decodes every element of a ziplist, the encoding listpacks replaced in
+// Redis 7. Found in older dumps as list, zset and quicklist node payloads.
+std::vector<std::string> decode_ziplist(const std::string& zl) {
+    if (zl.size() < 11) throw std::runtime_error("Invalid ziplist");
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(zl.data());
+    size_t pos = 10;
+    std::vector<std::string> out;
+
+    auto need = [&](size_t n) {
+        if (pos + n > zl.size()) throw std::runtime_error("Truncated ziplist");
+    };
+    auto read_int = [&](size_t width) {
+        need(width);
+        uint64_t v = 0;
+        for (size_t i = 0; i < width; ++i) v |= static_cast<uint64_t>(p[pos + i]) << (8 * i);
+        pos += width;
+        if (width < 8 && (v >> (8 * width - 1)) & 1) v |= ~0ULL << (8 * width);
+        return static_cast<int64_t>(v);
+    };
+
+    while (true) {
+        need(1);
+        if (p[pos] == 0xFF) break;
+
+        // Skip prevlen: one byte, or 0xFE and a 4-byte length.
+        pos += p[pos] < 0xFE ? 1 : 5;
+        need(1);
+        uint8_t c = p[pos];
+
+        if ((c >> 6) == 0) {
+            size_t len = c & 0x3F;
+            need(1 + len);
+            out.emplace_back(zl, pos + 1, len);
+            pos += 1 + len;
+        } else if ((c >> 6) == 1) {
+            need(2);
+            size_t len = ((c & 0x3F) << 8) | p[pos + 1];
+            need(2 + len);
+            out.emplace_back(zl, pos + 2, len);
+            pos += 2 + len;
+        } else if ((c >> 6) == 2) {
+            need(5);
+            size_t len = (size_t(p[pos + 1]) << 24) | (size_t(p[pos + 2]) << 16) |
+                         (size_t(p[pos + 3]) << 8) | size_t(p[pos + 4]);
+            need(5 + len);
+            out.emplace_back(zl, pos + 5, len);
+            pos += 5 + len;
+        } else {
+            pos += 1;
+            if (c == 0xC0) out.push_back(std::to_string(read_int(2)));
+            else if (c == 0xD0) out.push_back(std::to_string(read_int(4)));
+            else if (c == 0xE0) out.push_back(std::to_string(read_int(8)));
+            else if (c == 0xF0) out.push_back(std::to_string(read_int(3)));
+            else if (c == 0xFE) out.push_back(std::to_string(read_int(1)));
+            else if (c >= 0xF1 && c <= 0xFD) out.push_back(std::to_string((c & 0x0F) - 1));
+            else throw std::runtime_error("Invalid ziplist encoding");
+        }
+    }
+    return out;
+}
+
+int64_t to_int(const std::string& s) {
+    try {
+        return std::stoll(s);
+    } catch (...) {
+        throw std::runtime_error("Invalid integer in listpack");
+    }
+}
+
+double to_score(const std::string& s) {
+    char* end = nullptr;
+    double score = std::strtod(s.c_str(), &end);
+    if (s.empty() || *end != '\0' || std::isnan(score)) throw std::runtime_error("Invalid sorted set score");
+    return score;
+}
+
+// Zsets packed as member, score, member, score, ...
+void load_packed_zset(const std::vector<std::string>& items, Entry& entry) {
+    if (items.size() % 2 != 0) throw std::runtime_error("Invalid packed sorted set");
+    entry.type = VAL_ZSET;
+    entry.zset_val.dict.reserve(items.size() / 2);
+    for (size_t i = 0; i < items.size(); i += 2) RedisZSet::add(entry, to_score(items[i + 1]), items[i]);
+}
+
+unsigned load_threads() {
+    return std::clamp(std::thread::hardware_concurrency(), 1u, LOAD_THREADS_MAX);
+}
+
+}
+
+// Decodes the values of a mapped file on a pool of threads. The parser only
+// finds where each value starts and ends, which is cheap, and hands keys over
+// in batches; finished batches are merged into the keyspace in file order so
+// a key that appears twice keeps its last value.
+class RDBLoader::ParallelDecoder {
+public:
+    ParallelDecoder(RDBLoader& parser, std::unordered_map<std::string, Entry>& out, unsigned threads)
+        : parser(parser), out(out) {
+        for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&ParallelDecoder::work, this);
+    }
+
+    ~ParallelDecoder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    void add(std::string key, int value_type, long long expiry_ms, size_t offset, size_t end_offset) {
+        PendingKey& pending = current.keys.emplace_back();
+        pending.key = std::move(key);
+        pending.value_type = value_type;
+        pending.expiry_ms = expiry_ms;
+        pending.offset = offset;
+        current.end_offset = end_offset;
+        current.bytes += end_offset - offset;
+        if (current.bytes >= LOAD_BATCH_BYTES || current.keys.size() >= LOAD_BATCH_KEYS) {
+            dispatch();
+            merge(false);
+        }
+    }
+
+    // Waits for every batch and merges what is left. Throws if a value
+    // failed to decode.
+    void finish() {
+        if (!current.keys.empty()) dispatch();
+        merge(true);
+    }
+
+private:
+    struct PendingKey {
+        std::string key;
+        int value_type = 0;
+        long long expiry_ms = 0;
+        size_t offset = 0;
+        Entry entry;
+        bool loaded = false;
+    };
+    struct Batch {
+        std::vector<PendingKey> keys;
+        size_t bytes = 0;
+        size_t end_offset = 0;
+        bool done = false;
+    };
+
+    RDBLoader& parser;
+    std::unordered_map<std::string, Entry>& out;
+    std::vector<std::thread> workers;
+    Batch current;
+
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::deque<Batch> batches; // references stay valid as batches are added
+    size_t next_batch = 0;     // first batch no worker has taken
+    size_t merged = 0;         // first batch not yet merged
+    bool stopping = false;
+    std::string error;
+
+    void dispatch() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batches.push_back(std::move(current));
+        }
+        current = Batch();
+        work_cv.notify_one();
+    }
+
+    void merge(bool wait) {
+        while (true) {
+            Batch* batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (wait) {
+                    done_cv.wait(lock, [&] {
+                        return !error.empty() || merged == batches.size() || batches[merged].done;
+                    });
+                }
+                if (!error.empty()) throw std::runtime_error(error);
+                if (merged == batches.size() || !batches[merged].done) return;
+                batch = &batches[merged++];
+            }
+
+            // Workers are done with it, so it is read without the lock.
+            for (auto& pending : batch->keys) {
+                if (!pending.loaded) {
+                    parser.keys_skipped++;
+                    continue;
+                }
+                pending.entry.expiry_at = pending.expiry_ms;
+                out[std::move(pending.key)] = std::move(pending.entry);
+            }
+            parser.db.loading.loaded_bytes.store(static_cast<long long>(batch->end_offset), std::memory_order_relaxed);
+            batch->keys = std::vector<PendingKey>();
+        }
+    }
+
+    void work() {
+        RDBLoader decoder(parser.db);
+        decoder.view = parser.view;
+        decoder.view_size = parser.view_size;
+        decoder.remaining = 0;
+        decoder.running_crc = false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            work_cv.wait(lock, [&] { return stopping || next_batch < batches.size(); });
+            if (stopping) return;
+            Batch& batch = batches[next_batch++];
+            lock.unlock();
+
+            std::string failure;
+            try {
+                for (auto& pending : batch.keys) {
+                    decoder.buffer_pos = pending.offset;
+                    pending.loaded = decoder.load_value(pending.value_type, pending.entry);
+                }
+            } catch (const std::exception& e) {
+                failure = e.what();
+            }
+
+            lock.lock();
+            if (!failure.empty() && error.empty()) error = failure;
+            batch.done = true;
+            done_cv.notify_all();
+        }
+    }
+};
+
+LoadingScope::LoadingScope(LoadingState& state, uint64_t total_bytes) : state(state) {
+    state.start_ms = current_time_ms();
+    state.total_bytes = static_cast<long long>(total_bytes);
+    state.loaded_bytes = 0;
+    state.in_progress = true;
+}
+
+LoadingScope::~LoadingScope() {
+    state.in_progress = false;
+}
+
+void LoadingScope::finish(size_t keys) {
+    state.last_keys_loaded = static_cast<long long>(keys);
+    long long elapsed_ms = std::max(1LL, current_time_ms() - state.start_ms);
+    double mb = state.loaded_bytes / (1024.0 * 1024.0);
+    std::cout << "Loaded " << keys << " keys, " << static_cast<long long>(mb) << " MB in "
+              << elapsed_ms / 1000.0 << " seconds (" << static_cast<long long>(mb * 1000 / elapsed_ms)
+              << " MB/s)\n";
+}
 
 RDBLoader::RDBLoader(Database& db) : db(db) {}
 
 void RDBLoader::load(const std::string& filepath) {
-    file.open(filepath, std::ios::binary);
-    if (!file.is_open()) return;
+    fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        fd = -1;
+        throw std::runtime_error(std::string("stat failed: ") + std::strerror(errno));
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    int map_errno = errno;
+    close(fd);
+    fd = -1;
+    if (map == MAP_FAILED) {
+        throw std::runtime_error(size == 0 ? "Unexpected EOF" : std::string("mmap failed: ") + std::strerror(map_errno));
+    }
+
+    LoadingScope scope(db.loading, size);
+    std::unordered_map<std::string, Entry> loaded;
+    try {
+        load_mapped(static_cast<const char*>(map), size, loaded);
+    } catch (...) {
+        munmap(map, size);
+        throw;
+    }
+    munmap(map, size);
+    scope.finish(loaded.size());
+
+    std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+    db.kv_store.swap(loaded);
+    db.touch_all_watched_keys();
+}
+
+size_t RDBLoader::load_mapped(const char* data, size_t size, std::unordered_map<std::string, Entry>& out) {
+    // Everything is in view up front; fill() is never needed.
+    map_base = view = data;
+    view_size = size;
+    buffer_pos = 0;
+    remaining = 0;
+    running_crc = false;
+
+    if (size >= PARALLEL_LOAD_MIN_BYTES) {
+        ParallelDecoder decoder(*this, out, load_threads());
+        parse(out, &decoder);
+    } else {
+        parse(out);
+    }
+    return buffer_pos;
+}
+
+void RDBLoader::load_stream(int source_fd, std::string& pending, uint64_t length, std::unordered_map<std::string, Entry>& out) {
+    size_t prefix = static_cast<size_t>(std::min<uint64_t>(pending.size(), length));
+    buffer.assign(pending, 0, prefix);
+    pending.erase(0, prefix);
+    sync_view();
+    buffer_pos = 0;
+    remaining = length - prefix;
+    fd = source_fd;
+
+    LoadingScope scope(db.loading, length);
+    parse(out);
+    scope.finish(out.size());
 
-    char magic[5];
-    if (!file.read(magic, 5) || std::string(magic, 5) != "REDIS") {
-        return;
+    // Nothing follows the checksum, but never leave payload bytes behind to
+    // be mistaken for commands.
+    while (buffer_pos < buffer.size() || remaining > 0) {
+        buffer_pos = buffer.size();
+        if (remaining > 0) fill();
     }
+}
+
+void RDBLoader::load_stream_until_mark(int source_fd, std::string& pending, const std::string& mark, std::unordered_map<std::string, Entry>& out) {
+    buffer.swap(pending);
+    pending.clear();
+    sync_view();
+    buffer_pos = 0;
+    remaining = UINT64_MAX;
+    fd = source_fd;
+
+    LoadingScope scope(db.loading, 0);
+    parse(out);
+    scope.finish(out.size());
 
-    char version[4];
-    file.read(version, 4);
+    std::string tail(mark.size(), '\0');
+    read_exact(&tail[0], tail.size());
+    if (tail != mark) throw std::runtime_error("EOF mark mismatch");
+    pending.assign(buffer, buffer_pos, std::string::npos);
+}
+
+void RDBLoader::parse(std::unordered_map<std::string, Entry>& out, ParallelDecoder* decoder) {
+    crc = 0;
+    keys_skipped = 0;
+    char header[9];
+    read_exact(header, 9);
+    if (std::memcmp(header, "REDIS", 5) != 0) throw std::runtime_error("Not an RDB file");
+    int version = std::atoi(std::string(header + 5, 4).c_str());
+    if (version < 1 || version > RDB_VERSION_MAX) {
+        throw std::runtime_error("Can't handle RDB format version " + std::to_string(version));
+    }
 
-    while (file.peek() != EOF) {
+    long long expiry_ms = 0;
+    while (true) {
         uint8_t opcode = read_byte();
 
-        if (opcode == 0xFF) break;
-        else if (opcode == 0xFE) read_length();
-        else if (opcode == 0xFB) { read_length(); read_length(); }
-        else if (opcode == 0xFA) { read_string(); read_string(); }
+        if (opcode == RDB_OPCODE_EOF) {
+            if (decoder) decoder->finish();
+            if (version >= 5) {
+                uint64_t expected = checksum_up_to(buffer_pos);
+                uint64_t stored = read_u64_le();
+                // A zero checksum means the writer had checksums disabled.
+                if (stored != 0 && stored != expected) throw std::runtime_error("Wrong RDB checksum");
+            }
+            report_progress();
+            break;
+        }
+        else if (opcode == RDB_OPCODE_SELECTDB) read_plain_length();
+        else if (opcode == RDB_OPCODE_RESIZEDB) {
+            out.reserve(out.size() + read_plain_length());
+            read_plain_length();
+        }
+        else if (opcode == RDB_OPCODE_AUX) { read_string(); read_string(); }
+        else if (opcode == RDB_OPCODE_EXPIRETIME) expiry_ms = static_cast<long long>(read_u32_le()) * 1000;
+        else if (opcode == RDB_OPCODE_EXPIRETIME_MS) expiry_ms = static_cast<long long>(read_u64_le());
+        else if (opcode == RDB_OPCODE_IDLE) read_plain_length();
+        else if (opcode == RDB_OPCODE_FREQ) read_byte();
+        else if (opcode == RDB_OPCODE_SLOT_INFO) {
+            read_plain_length(); // slot
+            read_plain_length(); // keys in slot
+            read_plain_length(); // volatile keys in slot
+        }
+        else if (opcode == RDB_OPCODE_FUNCTION2) read_string();
+        else if (opcode == RDB_OPCODE_MODULE_AUX) {
+            read_plain_length(); // module id
+            read_plain_length(); // when opcode
+            read_plain_length(); // when
+            skip_module_value();
+        }
+        else if (decoder) {
+            std::string key = read_string();
+            size_t offset = buffer_pos;
+            skip_value(opcode);
+            decoder->add(std::move(key), opcode, expiry_ms, offset, buffer_pos);
+            expiry_ms = 0;
+        }
         else {
-            uint64_t expiry_ms = 0;
-            int value_type = opcode;
+            std::string key = read_string();
+            Entry entry;
+            if (load_value(opcode, entry)) {
+                entry.expiry_at = expiry_ms;
+                out[std::move(key)] = std::move(entry);
+            } else {
+                keys_skipped++;
+            }
+            expiry_ms = 0;
+            report_progress();
+        }
+    }
+
+    if (keys_skipped > 0) {
+        std::cerr << "RDB: skipped " << keys_skipped << " keys of types this server doesn't support"
+                  << " (hashes, sets or module values)\n";
+    }
+}
+
+// CRC64 of the first len bytes. A mapped file is checksummed after parsing,
+// in slices on several threads, rather than byte by byte as it is read.
+uint64_t RDBLoader::checksum_up_to(size_t len) {
+    if (running_crc) return crc;
 
-            if (opcode == 0xFD) {
-                uint32_t ex_sec = read_u32_le();
-                expiry_ms = static_cast<uint64_t>(ex_sec) * 1000;
-                value_type = read_byte();
+    unsigned threads = len >= PARALLEL_LOAD_MIN_BYTES ? load_threads() : 1;
+    size_t slice = len / threads;
+    std::vector<uint64_t> parts(threads);
+    std::vector<std::thread> workers;
+    size_t first = len - slice * (threads - 1);
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back([&, i] { parts[i] = CRC64::update(0, map_base + first + (i - 1) * slice, slice); });
+    }
+    parts[0] = CRC64::update(0, map_base, first);
+    for (auto& worker : workers) worker.join();
+
+    uint64_t result = parts[0];
+    for (unsigned i = 1; i < threads; ++i) result = CRC64::combine(result, parts[i], slice);
+    return result;
+}
+
+void RDBLoader::report_progress() {
+    db.loading.loaded_bytes.store(static_cast<long long>(consumed + buffer_pos), std::memory_order_relaxed);
+}
+
+void RDBLoader::sync_view() {
+    view = buffer.data();
+    view_size = buffer.size();
+}
+
+bool RDBLoader::load_value(int value_type, Entry& entry) {
+    switch (value_type) {
+        case RDB_TYPE_STRING:
+            entry.type = VAL_STRING;
+            entry.string_val = read_string();
+            return true;
+        case RDB_TYPE_LIST: {
+            entry.type = VAL_LIST;
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) entry.list_val.push_back(read_string());
+            return true;
+        }
+        case RDB_TYPE_LIST_ZIPLIST:
+            entry.type = VAL_LIST;
+            for (auto& item : decode_ziplist(read_string())) entry.list_val.push_back(std::move(item));
+            return true;
+        case RDB_TYPE_LIST_QUICKLIST: {
+            entry.type = VAL_LIST;
+            uint64_t nodes = read_plain_length();
+            for (uint64_t n = 0; n < nodes; ++n) {
+                for (auto& item : decode_ziplist(read_string())) entry.list_val.push_back(std::move(item));
             }
-            else if (opcode == 0xFC) {
-                expiry_ms = read_u64_le();
-                value_type = read_byte();
+            return true;
+        }
+        case RDB_TYPE_LIST_QUICKLIST_2: {
+            entry.type = VAL_LIST;
+            uint64_t nodes = read_plain_length();
+            for (uint64_t n = 0; n < nodes; ++n) {
+                uint64_t container = read_plain_length();
+                if (container == QUICKLIST_NODE_CONTAINER_PLAIN) {
+                    entry.list_val.push_back(read_string());
+                } else if (container == QUICKLIST_NODE_CONTAINER_PACKED) {
+                    for (auto& item : decode_listpack(read_string())) entry.list_val.push_back(std::move(item));
+                } else {
+                    throw std::runtime_error("Invalid quicklist node container");
+                }
+            }
+            return true;
+        }
+        case RDB_TYPE_ZSET:
+        case RDB_TYPE_ZSET_2: {
+            entry.type = VAL_ZSET;
+            uint64_t len = read_plain_length();
+            entry.zset_val.dict.reserve(len);
+            for (uint64_t i = 0; i < len; ++i) {
+                std::string member = read_string();
+                double score = value_type == RDB_TYPE_ZSET ? read_string_double() : read_binary_double();
+                RedisZSet::add(entry, score, member);
             }
+            return true;
+        }
+        case RDB_TYPE_ZSET_ZIPLIST:
+            load_packed_zset(decode_ziplist(read_string()), entry);
+            return true;
+        case RDB_TYPE_ZSET_LISTPACK:
+            load_packed_zset(decode_listpack(read_string()), entry);
+            return true;
+        case RDB_TYPE_STREAM_LISTPACKS:
+        case RDB_TYPE_STREAM_LISTPACKS_2:
+        case RDB_TYPE_STREAM_LISTPACKS_3:
+            entry.type = VAL_STREAM;
+            load_stream_value(value_type, entry.stream_val);
+            return true;
 
-            std::string key = read_string();
-            std::string value;
+        // No hash or set type here: read past the value so the rest of the
+        // file still parses.
+        case RDB_TYPE_SET: {
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) read_string();
+            return false;
+        }
+        case RDB_TYPE_HASH: {
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) { read_string(); read_string(); }
+            return false;
+        }
+        case RDB_TYPE_HASH_ZIPMAP:
+        case RDB_TYPE_SET_INTSET:
+        case RDB_TYPE_HASH_ZIPLIST:
+        case RDB_TYPE_HASH_LISTPACK:
+        case RDB_TYPE_SET_LISTPACK:
+            read_string();
+            return false;
+        case RDB_TYPE_HASH_METADATA: {
+            read_u64_le(); // minimum field expiry
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) {
+                read_plain_length(); // field TTL
+                read_string();
+                read_string();
+            }
+            return false;
+        }
+        case RDB_TYPE_HASH_LISTPACK_EX:
+            read_u64_le(); // minimum field expiry
+            read_string();
+            return false;
+        case RDB_TYPE_MODULE_2:
+            read_plain_length(); // module id
+            skip_module_value();
+            return false;
+    }
+    throw std::runtime_error("Unsupported value type " + std::to_string(value_type));
+}
+
+void RDBLoader::skip_module_value() {
+    while (true) {
+        uint64_t opcode = read_plain_length();
+        if (opcode == RDB_MODULE_OPCODE_EOF) return;
+        else if (opcode == RDB_MODULE_OPCODE_SINT || opcode == RDB_MODULE_OPCODE_UINT) read_plain_length();
+        else if (opcode == RDB_MODULE_OPCODE_FLOAT) { uint8_t buf[4]; read_exact(buf, 4); }
+        else if (opcode == RDB_MODULE_OPCODE_DOUBLE) read_u64_le();
+        else if (opcode == RDB_MODULE_OPCODE_STRING) read_string();
+        else throw std::runtime_error("Unknown module opcode " + std::to_string(opcode));
+    }
+}
+
+// Moves past a value without decoding it, for the parser of a parallel load.
+// Types that are never loaded are read past the usual way.
+void RDBLoader::skip_value(int value_type) {
+    switch (value_type) {
+        case RDB_TYPE_STRING:
+        case RDB_TYPE_LIST_ZIPLIST:
+        case RDB_TYPE_ZSET_ZIPLIST:
+        case RDB_TYPE_ZSET_LISTPACK:
+            skip_string();
+            return;
+        case RDB_TYPE_LIST:
+        case RDB_TYPE_LIST_QUICKLIST: {
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) skip_string();
+            return;
+        }
+        case RDB_TYPE_LIST_QUICKLIST_2: {
+            uint64_t nodes = read_plain_length();
+            for (uint64_t n = 0; n < nodes; ++n) {
+                read_plain_length(); // container
+                skip_string();
+            }
+            return;
+        }
+        case RDB_TYPE_ZSET: {
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) {
+                skip_string();
+                uint8_t score_len = read_byte();
+                if (score_len < 253) skip_bytes(score_len);
+            }
+            return;
+        }
+        case RDB_TYPE_ZSET_2: {
+            uint64_t len = read_plain_length();
+            for (uint64_t i = 0; i < len; ++i) {
+                skip_string();
+                skip_bytes(8);
+            }
+            return;
+        }
+        case RDB_TYPE_STREAM_LISTPACKS:
+        case RDB_TYPE_STREAM_LISTPACKS_2:
+        case RDB_TYPE_STREAM_LISTPACKS_3: {
+            uint64_t nodes = read_plain_length();
+            for (uint64_t n = 0; n < nodes; ++n) {
+                skip_string();
+                skip_string();
+            }
+            int lengths = value_type >= RDB_TYPE_STREAM_LISTPACKS_2 ? 8 : 3;
+            for (int i = 0; i < lengths; ++i) read_plain_length();
+
+            uint64_t group_count = read_plain_length();
+            for (uint64_t g = 0; g < group_count; ++g) {
+                skip_string();
+                read_plain_length();
+                read_plain_length();
+                if (value_type >= RDB_TYPE_STREAM_LISTPACKS_2) read_plain_length();
+
+                uint64_t pel_size = read_plain_length();
+                for (uint64_t i = 0; i < pel_size; ++i) {
+                    skip_bytes(16 + 8);
+                    read_plain_length();
+                }
+                uint64_t consumer_count = read_plain_length();
+                for (uint64_t c = 0; c < consumer_count; ++c) {
+                    skip_string();
+                    skip_bytes(value_type >= RDB_TYPE_STREAM_LISTPACKS_3 ? 16 : 8);
+                    skip_bytes(16 * read_plain_length());
+                }
+            }
+            return;
+        }
+    }
+    Entry unused;
+    load_value(value_type, unused);
+}
+
+void RDBLoader::skip_string() {
+    auto [len, is_encoded] = read_length();
+    if (!is_encoded) skip_bytes(len);
+    else if (len == 0) skip_bytes(1);
+    else if (len == 1) skip_bytes(2);
+    else if (len == 2) skip_bytes(4);
+    else if (len == RDB_ENC_LZF) {
+        uint64_t compressed_len = read_plain_length();
+        read_plain_length(); // uncompressed length
+        skip_bytes(compressed_len);
+    }
+    else throw std::runtime_error("Unsupported string encoding");
+}
+
+// Reads a stream written as listpack nodes and re-packs its live entries into
+// our own blocks. Tombstones are dropped; the counters that depend on them
+// (last ID, entries added, max deleted ID) come from the stream metadata.
+void RDBLoader::load_stream_value(int value_type, Stream& stream) {
+    std::vector<std::pair<std::string, std::string>> pairs;
 
-            if (value_type == 0) {
-                value = read_string();
+    uint64_t nodes = read_plain_length();
+    for (uint64_t n = 0; n < nodes; ++n) {
+        StreamID master_id = decode_raw_id(read_string());
+        std::vector<std::string> lp = decode_listpack(read_string());
+
+        size_t pos = 0;
+        auto next = [&]() -> const std::string& {
+            if (pos >= lp.size()) throw std::runtime_error("Truncated stream node");
+            return lp[pos++];
+        };
+
+        next(); // live count
+        next(); // deleted count
+        size_t master_field_count = static_cast<size_t>(to_int(next()));
+        std::vector<std::string> master_fields;
+        for (size_t i = 0; i < master_field_count; ++i) master_fields.push_back(next());
+        next(); // master entry terminator
+
+        while (pos < lp.size()) {
+            int64_t flags = to_int(next());
+            StreamID id;
+            id.ms = master_id.ms + static_cast<uint64_t>(to_int(next()));
+            id.seq = master_id.seq + static_cast<uint64_t>(to_int(next()));
+
+            pairs.clear();
+            if (flags & 2) {
+                for (const auto& field : master_fields) pairs.emplace_back(field, next());
             } else {
-                continue; 
+                size_t count = static_cast<size_t>(to_int(next()));
+                for (size_t i = 0; i < count; ++i) {
+                    std::string field = next();
+                    pairs.emplace_back(std::move(field), next());
+                }
             }
+            next(); // lp-count
 
-            {
-                std::lock_guard<std::mutex> lock(db.kv_mutex);
-                Entry entry;
-                entry.type = VAL_STRING;
-                entry.string_val = value;
-                entry.expiry_at = (expiry_ms > 0) ? expiry_ms : 0;
-                db.kv_store[key] = entry;
+            if (!(flags & 1)) RedisStream::append_entry(stream, id, pairs);
+        }
+    }
+
+    uint64_t length = read_plain_length(); // recomputed by append_entry
+    stream.last_id.ms = read_plain_length();
+    stream.last_id.seq = read_plain_length();
+
+    if (value_type >= RDB_TYPE_STREAM_LISTPACKS_2) {
+        read_plain_length(); // first entry ID, implied by the entries
+        read_plain_length();
+        stream.max_deleted_id.ms = read_plain_length();
+        stream.max_deleted_id.seq = read_plain_length();
+        stream.entries_added = read_plain_length();
+    } else {
+        // Older dumps don't track deletions, so count every entry once.
+        stream.entries_added = length;
+    }
+
+    uint64_t group_count = read_plain_length();
+    for (uint64_t g = 0; g < group_count; ++g) {
+        std::string name = read_string();
+        StreamConsumerGroup& group = stream.groups[name];
+        group.last_delivered.ms = read_plain_length();
+        group.last_delivered.seq = read_plain_length();
+        if (value_type >= RDB_TYPE_STREAM_LISTPACKS_2) read_plain_length(); // entries-read
+
+        uint64_t pel_size = read_plain_length();
+        for (uint64_t i = 0; i < pel_size; ++i) {
+            std::string raw(16, '\0');
+            read_exact(&raw[0], 16);
+            StreamPendingEntry& pending = group.pending[decode_raw_id(raw)];
+            pending.delivery_time = static_cast<long long>(read_u64_le());
+            pending.delivery_count = read_plain_length();
+        }
+
+        uint64_t consumer_count = read_plain_length();
+        for (uint64_t c = 0; c < consumer_count; ++c) {
+            std::string consumer_name = read_string();
+            StreamConsumer& consumer = group.consumers[consumer_name];
+            consumer.seen_time = static_cast<long long>(read_u64_le());
+            consumer.active_time = value_type >= RDB_TYPE_STREAM_LISTPACKS_3
+                ? static_cast<long long>(read_u64_le()) : consumer.seen_time;
+
+            uint64_t owned = read_plain_length();
+            for (uint64_t i = 0; i < owned; ++i) {
+                std::string raw(16, '\0');
+                read_exact(&raw[0], 16);
+                StreamID id = decode_raw_id(raw);
+                consumer.pending.insert(id);
+                group.pending[id].consumer = consumer_name;
             }
         }
     }
-    file.close();
+}
+
+void RDBLoader::fill() {
+    consumed += buffer_pos;
+    buffer.erase(0, buffer_pos);
+    buffer_pos = 0;
+    sync_view();
+    if (remaining == 0) throw std::runtime_error("Unexpected EOF");
+
+    size_t old_size = buffer.size();
+    size_t want = static_cast<size_t>(std::min<uint64_t>(READ_CHUNK, remaining));
+    buffer.resize(old_size + want);
+
+    ssize_t n;
+    do {
+        n = read(fd, &buffer[old_size], want);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        buffer.resize(old_size);
+        sync_view();
+        throw std::runtime_error("Unexpected EOF");
+    }
+    buffer.resize(old_size + n);
+    sync_view();
+    remaining -= static_cast<uint64_t>(n);
+}
+
+void RDBLoader::read_exact(void* dst, size_t len) {
+    char* out = static_cast<char*>(dst);
+    while (len > 0) {
+        if (buffer_pos == view_size) fill();
+        size_t n = std::min(len, view_size - buffer_pos);
+        std::memcpy(out, view + buffer_pos, n);
+        if (running_crc) crc = CRC64::update(crc, out, n);
+        buffer_pos += n;
+        out += n;
+        len -= n;
+    }
+}
+
+void RDBLoader::skip_bytes(size_t len) {
+    while (len > 0) {
+        if (buffer_pos == view_size) fill();
+        size_t n = std::min(len, view_size - buffer_pos);
+        if (running_crc) crc = CRC64::update(crc, view + buffer_pos, n);
+        buffer_pos += n;
+        len -= n;
+    }
 }
 
 uint8_t RDBLoader::read_byte() {
-    char b;
-    if (!file.read(&b, 1)) throw std::runtime_error("Unexpected EOF");
-    return static_cast<uint8_t>(b);
+    uint8_t b;
+    read_exact(&b, 1);
+    return b;
 }
 
 std::pair<uint64_t, bool> RDBLoader::read_length() {
@@ -74,43 +980,92 @@ std::pair<uint64_t, bool> RDBLoader::read_length() {
         uint8_t next = read_byte();
         return {((byte & 0x3F) << 8) | next, false};
     }
-    else if (type == 2) return {read_u32_be(), false};
-    else return {byte & 0x3F, true};
+    else if (byte == 0x80) return {read_u32_be(), false};
+    else if (byte == 0x81) return {read_u64_be(), false};
+    else if (type == 3) return {byte & 0x3F, true};
+    throw std::runtime_error("Invalid length encoding");
+}
+
+uint64_t RDBLoader::read_plain_length() {
+    auto [len, is_encoded] = read_length();
+    if (is_encoded) throw std::runtime_error("Unexpected encoded length");
+    return len;
 }
 
 std::string RDBLoader::read_string() {
     auto [len, is_encoded] = read_length();
 
     if (is_encoded) {
-        if (len == 0) return std::to_string((int)read_byte());
+        if (len == 0) return std::to_string(static_cast<int8_t>(read_byte()));
         else if (len == 1) {
-            int16_t val = (uint8_t)read_byte() | ((uint8_t)read_byte() << 8);
-            return std::to_string(val);
-        } else if (len == 2) return std::to_string((int32_t)read_u32_le());
-        throw std::runtime_error("Unsupported integer encoding");
+            uint8_t lo = read_byte();
+            uint8_t hi = read_byte();
+            return std::to_string(static_cast<int16_t>(lo | (hi << 8)));
+        } else if (len == 2) return std::to_string(static_cast<int32_t>(read_u32_le()));
+        else if (len == RDB_ENC_LZF) {
+            uint64_t compressed_len = read_plain_length();
+            uint64_t str_len = read_plain_length();
+            std::string compressed(compressed_len, '\0');
+            if (compressed_len > 0) read_exact(&compressed[0], compressed_len);
+            std::string str(str_len, '\0');
+            if (!LZF::decompress(compressed.data(), compressed.size(), &str[0], str.size())) {
+                throw std::runtime_error("Invalid LZF compressed string");
+            }
+            return str;
+        }
+        throw std::runtime_error("Unsupported string encoding");
     }
 
-    std::string str;
-    str.resize(len);
-    file.read(&str[0], len);
+    std::string str(len, '\0');
+    if (len > 0) read_exact(&str[0], len);
     return str;
 }
 
 uint32_t RDBLoader::read_u32_le() {
-    uint32_t val;
-    file.read(reinterpret_cast<char*>(&val), 4);
-    return val;
+    uint8_t buf[4];
+    read_exact(buf, 4);
+    return uint32_t(buf[0]) | (uint32_t(buf[1]) << 8) | (uint32_t(buf[2]) << 16) | (uint32_t(buf[3]) << 24);
 }
 
 uint64_t RDBLoader::read_u64_le() {
-    uint64_t val;
-    file.read(reinterpret_cast<char*>(&val), 8);
+    uint8_t buf[8];
+    read_exact(buf, 8);
+    uint64_t val = 0;
+    for (int i = 7; i >= 0; --i) val = (val << 8) | buf[i];
     return val;
 }
 
 uint32_t RDBLoader::read_u32_be() {
     uint8_t buf[4];
-    file.read(reinterpret_cast<char*>(buf), 4);
-    return (uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) | 
+    read_exact(buf, 4);
+    return (uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) |
            (uint32_t(buf[2]) << 8)  | uint32_t(buf[3]);
-}
\ No newline at end of file
+}
+
+uint64_t RDBLoader::read_u64_be() {
+    uint8_t buf[8];
+    read_exact(buf, 8);
+    uint64_t val = 0;
+    for (int i = 0; i < 8; ++i) val = (val << 8) | buf[i];
+    return val;
+}
+
+// Scores of the original zset encoding: a length byte and the score in
+// decimal, with three reserved lengths for NaN and the infinities.
+double RDBLoader::read_string_double() {
+    uint8_t len = read_byte();
+    if (len == 253) throw std::runtime_error("Invalid sorted set score");
+    if (len == 254) return INFINITY;
+    if (len == 255) return -INFINITY;
+    char buf[256];
+    read_exact(buf, len);
+    buf[len] = '\0';
+    return std::strtod(buf, nullptr);
+}
+
+double RDBLoader::read_binary_double() {
+    uint64_t bits = read_u64_le();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
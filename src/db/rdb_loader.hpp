@@ -1,24 +1,89 @@
 #pragma once
 #include "database.hpp"
 #include <string>
-#include <fstream>
+#include <unordered_map>
 #include <vector>
 #include <cstdint>
 #include <utility>
 
+// Publishes a load in progress to INFO for as long as it lives.
+class LoadingScope {
+public:
+    LoadingScope(LoadingState& state, uint64_t total_bytes);
+    ~LoadingScope();
+
+    // Records and logs a successful load.
+    void finish(size_t keys);
+
+private:
+    LoadingState& state;
+};
+
 class RDBLoader {
 public:
     explicit RDBLoader(Database& db);
+
+    // Loads a dump file and swaps it in as the keyspace. A missing file
+    // leaves the keyspace untouched. The file is mapped rather than read,
+    // and values of large files are decoded by a pool of threads.
     void load(const std::string& filepath);
 
+    // Parses the RDB payload at the start of data, a mapped file, into out and
+    // returns its length. Used for files that only begin with an RDB, such as
+    // an AOF with an RDB preamble.
+    size_t load_mapped(const char* data, size_t size, std::unordered_map<std::string, Entry>& out);
+
+    // Parses an RDB payload of exactly length bytes as it arrives on fd,
+    // without buffering the whole payload. Bytes already received are taken
+    // from the front of pending first; anything in pending beyond the payload
+    // is left there. Throws std::runtime_error on malformed input or EOF.
+    void load_stream(int fd, std::string& pending, uint64_t length, std::unordered_map<std::string, Entry>& out);
+
+    // Same, for a payload of unknown length followed by mark, as sent by a
+    // diskless master ("$EOF:<mark>"). Anything received after the mark is
+    // put back into pending.
+    void load_stream_until_mark(int fd, std::string& pending, const std::string& mark, std::unordered_map<std::string, Entry>& out);
+
 private:
+    class ParallelDecoder;
+
     Database& db;
-    std::ifstream file;
+    int fd = -1;
+    std::string buffer;
+    // Bytes being parsed: the contents of buffer, or all of a mapped file.
+    const char* view = nullptr;
+    size_t view_size = 0;
+    size_t buffer_pos = 0;
+    uint64_t consumed = 0;           // bytes dropped from the front of buffer
+    uint64_t remaining = UINT64_MAX; // payload bytes not yet pulled into buffer, huge if unknown
+    bool running_crc = true;
+    uint64_t crc = 0;                // CRC64 of every byte consumed so far, if running_crc
+    const char* map_base = nullptr;  // set for a mapped file, whose CRC is computed separately
+    size_t keys_skipped = 0;
+
+    void parse(std::unordered_map<std::string, Entry>& out, ParallelDecoder* decoder = nullptr);
+    uint64_t checksum_up_to(size_t offset);
+    void report_progress();
+    void sync_view();
+
+    // Returns false if the value was read but has no type to load into.
+    bool load_value(int value_type, Entry& entry);
+    void load_stream_value(int value_type, Stream& stream);
+    void skip_module_value();
+    void skip_value(int value_type);
+    void skip_string();
+    void skip_bytes(size_t len);
 
+    void fill();
+    void read_exact(void* dst, size_t len);
     uint8_t read_byte();
-    uint32_t read_u32_le(); 
-    uint64_t read_u64_le(); 
-    uint32_t read_u32_be(); 
+    uint32_t read_u32_le();
+    uint64_t read_u64_le();
+    uint32_t read_u32_be();
+    uint64_t read_u64_be();
+    double read_string_double();
+    double read_binary_double();
     std::pair<uint64_t, bool> read_length();
+    uint64_t read_plain_length();
     std::string read_string();
-};
\ No newline at end of file
+};
@@ -0,0 +1,431 @@
+#include "rdb_writer.hpp"
+#include "structs/redis_stream.hpp"
+#include "../utils/crc64.hpp"
+#include "../utils/utils.hpp"
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+
+const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+const uint8_t RDB_OPCODE_AUX = 0xFA;
+const uint8_t RDB_OPCODE_RESIZEDB = 0xFB;
+const uint8_t RDB_OPCODE_EXPIRETIME_MS = 0xFC;
+const uint8_t RDB_OPCODE_SELECTDB = 0xFE;
+const uint8_t RDB_OPCODE_EOF = 0xFF;
+
+const uint8_t RDB_TYPE_STRING = 0;
+const uint8_t RDB_TYPE_LIST = 1;
+const uint8_t RDB_TYPE_ZSET_2 = 5;
+const uint8_t RDB_TYPE_STREAM_LISTPACKS_3 = 21;
+
+const uint8_t RDB_ENC_INT8 = 0xC0;
+const uint8_t RDB_ENC_INT16 = 0xC1;
+const uint8_t RDB_ENC_INT32 = 0xC2;
+
+// Parses str only if it is the canonical decimal form of an int64, so that
+// storing the number instead of the text round-trips exactly.
+bool string_to_int64(std::string_view str, int64_t& out) {
+    if (str.empty() || str.size() > 20) return false;
+    if (str == "0") {
+        out = 0;
+        return true;
+    }
+
+    size_t i = 0;
+    bool negative = (str[0] == '-');
+    if (negative) i++;
+    if (i == str.size() || str[i] < '1' || str[i] > '9') return false;
+
+    uint64_t value = 0;
+    for (; i < str.size(); ++i) {
+        if (str[i] < '0' || str[i] > '9') return false;
+        uint64_t digit = str[i] - '0';
+        if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) return false;
+        value = value * 10 + digit;
+    }
+
+    if (negative) {
+        if (value > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1) return false;
+        out = static_cast<int64_t>(0 - value);
+    } else {
+        if (value > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) return false;
+        out = static_cast<int64_t>(value);
+    }
+    return true;
+}
+
+// Stream IDs as stored in node keys and PELs: ms then seq, both big-endian.
+std::string encode_raw_id(const StreamID& id) {
+    std::string raw(16, '\0');
+    for (int i = 0; i < 8; ++i) {
+        raw[i] = static_cast<char>(id.ms >> (56 - 8 * i));
+        raw[8 + i] = static_cast<char>(id.seq >> (56 - 8 * i));
+    }
+    return raw;
+}
+
+// Builds a listpack: a 6-byte header (total bytes, element count), the
+// elements, each followed by its own encoded length so the list can be walked
+// backwards, and a 0xFF terminator.
+class Listpack {
+public:
+    void append_int(int64_t value) {
+        size_t start = body.size();
+        if (value >= 0 && value <= 127) {
+            body.push_back(static_cast<char>(value));
+        } else if (value >= -4096 && value <= 4095) {
+            uint64_t v = static_cast<uint64_t>(value) & 0x1FFF;
+            body.push_back(static_cast<char>(0xC0 | (v >> 8)));
+            body.push_back(static_cast<char>(v & 0xFF));
+        } else if (value >= -32768 && value <= 32767) {
+            put_int(0xF1, value, 2);
+        } else if (value >= -8388608 && value <= 8388607) {
+            put_int(0xF2, value, 3);
+        } else if (value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max()) {
+            put_int(0xF3, value, 4);
+        } else {
+            put_int(0xF4, value, 8);
+        }
+        finish_element(start);
+    }
+
+    void append_string(std::string_view str) {
+        int64_t value;
+        if (string_to_int64(str, value)) {
+            append_int(value);
+            return;
+        }
+
+        size_t start = body.size();
+        size_t len = str.size();
+        if (len < 64) {
+            body.push_back(static_cast<char>(0x80 | len));
+        } else if (len < 4096) {
+            body.push_back(static_cast<char>(0xE0 | (len >> 8)));
+            body.push_back(static_cast<char>(len & 0xFF));
+        } else {
+            body.push_back(static_cast<char>(0xF0));
+            for (int i = 0; i < 4; ++i) body.push_back(static_cast<char>(len >> (8 * i)));
+        }
+        body.append(str);
+        finish_element(start);
+    }
+
+    std::string finish() const {
+        uint32_t total = static_cast<uint32_t>(6 + body.size() + 1);
+        uint16_t count = elements < 65535 ? static_cast<uint16_t>(elements) : 65535;
+
+        std::string out;
+        out.reserve(total);
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(total >> (8 * i)));
+        for (int i = 0; i < 2; ++i) out.push_back(static_cast<char>(count >> (8 * i)));
+        out += body;
+        out.push_back(static_cast<char>(0xFF));
+        return out;
+    }
+
+private:
+    std::string body;
+    size_t elements = 0;
+
+    void put_int(uint8_t encoding, int64_t value, int bytes) {
+        body.push_back(static_cast<char>(encoding));
+        uint64_t v = static_cast<uint64_t>(value);
+        for (int i = 0; i < bytes; ++i) body.push_back(static_cast<char>(v >> (8 * i)));
+    }
+
+    // Appends the backlen of the element that starts at start.
+    void finish_element(size_t start) {
+        uint64_t len = body.size() - start;
+        if (len <= 127) {
+            body.push_back(static_cast<char>(len));
+        } else if (len < 16383) {
+            body.push_back(static_cast<char>(len >> 7));
+            body.push_back(static_cast<char>((len & 127) | 128));
+        } else if (len < 2097151) {
+            body.push_back(static_cast<char>(len >> 14));
+            body.push_back(static_cast<char>(((len >> 7) & 127) | 128));
+            body.push_back(static_cast<char>((len & 127) | 128));
+        } else if (len < 268435455) {
+            body.push_back(static_cast<char>(len >> 21));
+            body.push_back(static_cast<char>(((len >> 14) & 127) | 128));
+            body.push_back(static_cast<char>(((len >> 7) & 127) | 128));
+            body.push_back(static_cast<char>((len & 127) | 128));
+        } else {
+            body.push_back(static_cast<char>(len >> 28));
+            body.push_back(static_cast<char>(((len >> 21) & 127) | 128));
+            body.push_back(static_cast<char>(((len >> 14) & 127) | 128));
+            body.push_back(static_cast<char>(((len >> 7) & 127) | 128));
+            body.push_back(static_cast<char>((len & 127) | 128));
+        }
+        elements++;
+    }
+};
+
+// Encodes one stream block as a Redis stream node. The master entry carries
+// the live/deleted counts and the block's field names; each entry stores its
+// ID as a delta from the master ID, and entries flagged SAMEFIELDS omit their
+// field names exactly as in the in-memory block.
+std::string encode_stream_node(const StreamBlock& block) {
+    Listpack lp;
+    lp.append_int(block.live);
+    lp.append_int(block.entries - block.live);
+    lp.append_int(static_cast<int64_t>(block.master_fields.size()));
+    for (const auto& field : block.master_fields) lp.append_string(field);
+    lp.append_int(0);
+
+    StreamEntryView view;
+    for (size_t pos = 0; pos < block.data.size();) {
+        pos = RedisStream::decode_entry(block, pos, view);
+
+        bool same_fields = view.pairs.size() == block.master_fields.size();
+        for (size_t i = 0; same_fields && i < view.pairs.size(); ++i) {
+            same_fields = (view.pairs[i].first == block.master_fields[i]);
+        }
+
+        int64_t flags = (view.deleted ? 1 : 0) | (same_fields ? 2 : 0);
+        lp.append_int(flags);
+        lp.append_int(static_cast<int64_t>(view.id.ms - block.master_id.ms));
+        lp.append_int(static_cast<int64_t>(view.id.seq - block.master_id.seq));
+
+        int64_t num_fields = static_cast<int64_t>(view.pairs.size());
+        if (same_fields) {
+            for (const auto& pair : view.pairs) lp.append_string(pair.second);
+            lp.append_int(num_fields + 3);
+        } else {
+            lp.append_int(num_fields);
+            for (const auto& pair : view.pairs) {
+                lp.append_string(pair.first);
+                lp.append_string(pair.second);
+            }
+            lp.append_int(num_fields * 2 + 4);
+        }
+    }
+    return lp.finish();
+}
+
+}
+
+RDBWriter::RDBWriter(int fd) : fd(fd) {
+    buffer.reserve(WRITE_BUFFER_SIZE);
+}
+
+void RDBWriter::flush() {
+    size_t written = 0;
+    while (!failed && written < buffer.size()) {
+        ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            break;
+        }
+        written += n;
+    }
+    buffer.clear();
+}
+
+void RDBWriter::write_raw(const void* data, size_t len) {
+    crc = CRC64::update(crc, data, len);
+    buffer.append(static_cast<const char*>(data), len);
+    if (buffer.size() >= WRITE_BUFFER_SIZE) flush();
+}
+
+void RDBWriter::write_byte(uint8_t byte) {
+    write_raw(&byte, 1);
+}
+
+void RDBWriter::write_u64_le(uint64_t value) {
+    unsigned char buf[8];
+    for (int i = 0; i < 8; ++i) buf[i] = static_cast<unsigned char>(value >> (8 * i));
+    write_raw(buf, 8);
+}
+
+void RDBWriter::write_double(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    write_u64_le(bits);
+}
+
+void RDBWriter::write_length(uint64_t len) {
+    if (len < (1 << 6)) {
+        write_byte(static_cast<uint8_t>(len));
+    } else if (len < (1 << 14)) {
+        unsigned char buf[2] = {static_cast<unsigned char>(0x40 | (len >> 8)), static_cast<unsigned char>(len & 0xFF)};
+        write_raw(buf, 2);
+    } else if (len <= std::numeric_limits<uint32_t>::max()) {
+        unsigned char buf[5] = {0x80};
+        for (int i = 0; i < 4; ++i) buf[1 + i] = static_cast<unsigned char>(len >> (24 - 8 * i));
+        write_raw(buf, 5);
+    } else {
+        unsigned char buf[9] = {0x81};
+        for (int i = 0; i < 8; ++i) buf[1 + i] = static_cast<unsigned char>(len >> (56 - 8 * i));
+        write_raw(buf, 9);
+    }
+}
+
+void RDBWriter::write_string(const std::string& str) {
+    int64_t value;
+    if (str.size() <= 11 && string_to_int64(str, value)) {
+        if (value >= std::numeric_limits<int8_t>::min() && value <= std::numeric_limits<int8_t>::max()) {
+            unsigned char buf[2] = {RDB_ENC_INT8, static_cast<unsigned char>(value)};
+            write_raw(buf, 2);
+            return;
+        }
+        if (value >= std::numeric_limits<int16_t>::min() && value <= std::numeric_limits<int16_t>::max()) {
+            unsigned char buf[3] = {RDB_ENC_INT16, static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8)};
+            write_raw(buf, 3);
+            return;
+        }
+        if (value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max()) {
+            unsigned char buf[5] = {RDB_ENC_INT32};
+            for (int i = 0; i < 4; ++i) buf[1 + i] = static_cast<unsigned char>(value >> (8 * i));
+            write_raw(buf, 5);
+            return;
+        }
+    }
+    write_length(str.size());
+    write_raw(str.data(), str.size());
+}
+
+void RDBWriter::write_stream_id(const StreamID& id) {
+    write_length(id.ms);
+    write_length(id.seq);
+}
+
+void RDBWriter::write_stream(const Stream& stream) {
+    write_length(stream.blocks.size());
+    for (const auto& [master_id, block] : stream.blocks) {
+        write_string(encode_raw_id(master_id));
+        write_string(encode_stream_node(block));
+    }
+
+    StreamID first_id;
+    RedisStream::for_each(stream, [&](const StreamEntryView& view) {
+        first_id = view.id;
+        return false;
+    });
+
+    write_length(stream.length);
+    write_stream_id(stream.last_id);
+    write_stream_id(first_id);
+    write_stream_id(stream.max_deleted_id);
+    write_length(stream.entries_added);
+
+    write_length(stream.groups.size());
+    for (const auto& [name, group] : stream.groups) {
+        write_string(name);
+        write_stream_id(group.last_delivered);
+        write_length(std::numeric_limits<uint64_t>::max()); // entries-read unknown; the loader recomputes lag
+
+        write_length(group.pending.size());
+        for (const auto& [id, pending] : group.pending) {
+            std::string raw = encode_raw_id(id);
+            write_raw(raw.data(), raw.size());
+            write_u64_le(static_cast<uint64_t>(pending.delivery_time));
+            write_length(pending.delivery_count);
+        }
+
+        write_length(group.consumers.size());
+        for (const auto& [consumer_name, consumer] : group.consumers) {
+            write_string(consumer_name);
+            write_u64_le(static_cast<uint64_t>(consumer.seen_time));
+            write_u64_le(static_cast<uint64_t>(consumer.active_time));
+            write_length(consumer.pending.size());
+            for (const auto& id : consumer.pending) {
+                std::string raw = encode_raw_id(id);
+                write_raw(raw.data(), raw.size());
+            }
+        }
+    }
+}
+
+bool RDBWriter::save(const std::unordered_map<std::string, Entry>& kv_store) {
+    long long now = current_time_ms();
+    size_t live_keys = 0;
+    size_t expiring_keys = 0;
+    for (const auto& [key, entry] : kv_store) {
+        if (entry.expiry_at != 0 && now > entry.expiry_at) continue;
+        live_keys++;
+        if (entry.expiry_at != 0) expiring_keys++;
+    }
+
+    write_raw("REDIS0011", 9);
+
+    write_byte(RDB_OPCODE_AUX);
+    write_string("redis-ver");
+    write_string("7.2.0");
+    write_byte(RDB_OPCODE_AUX);
+    write_string("redis-bits");
+    write_string(std::to_string(sizeof(void*) * 8));
+    write_byte(RDB_OPCODE_AUX);
+    write_string("ctime");
+    write_string(std::to_string(now / 1000));
+
+    write_byte(RDB_OPCODE_SELECTDB);
+    write_length(0);
+    write_byte(RDB_OPCODE_RESIZEDB);
+    write_length(live_keys);
+    write_length(expiring_keys);
+
+    for (const auto& [key, entry] : kv_store) {
+        if (failed) return false;
+        if (entry.expiry_at != 0 && now > entry.expiry_at) continue;
+
+        if (entry.expiry_at != 0) {
+            write_byte(RDB_OPCODE_EXPIRETIME_MS);
+            write_u64_le(static_cast<uint64_t>(entry.expiry_at));
+        }
+
+        switch (entry.type) {
+            case VAL_STRING:
+                write_byte(RDB_TYPE_STRING);
+                write_string(key);
+                write_string(entry.string_val);
+                break;
+            case VAL_LIST:
+                write_byte(RDB_TYPE_LIST);
+                write_string(key);
+                write_length(entry.list_val.size());
+                for (const auto& item : entry.list_val) write_string(item);
+                break;
+            case VAL_ZSET:
+                write_byte(RDB_TYPE_ZSET_2);
+                write_string(key);
+                write_length(entry.zset_val.tree.size());
+                for (const auto& [score, member] : entry.zset_val.tree) {
+                    write_string(member);
+                    write_double(score);
+                }
+                break;
+            case VAL_STREAM:
+                write_byte(RDB_TYPE_STREAM_LISTPACKS_3);
+                write_string(key);
+                write_stream(entry.stream_val);
+                break;
+        }
+    }
+
+    write_byte(RDB_OPCODE_EOF);
+    uint64_t checksum = crc;
+    write_u64_le(checksum);
+    flush();
+    return !failed;
+}
+
+pid_t RDBWriter::fork_snapshot(Database& db, int fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only this thread survives in the child, so it must not touch any
+        // lock another thread might have been holding at fork time.
+        RDBWriter writer(fd);
+        // A pipe to a diskless sync cannot be synced and has nothing to sync.
+        bool ok = writer.save(db.kv_store) && (fsync(fd) == 0 || errno == EINVAL);
+        _exit(ok ? 0 : 1);
+    }
+    return pid;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "database.hpp"
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <sys/types.h>
+
+// Serialises a keyspace in RDB version 11 format, readable by upstream Redis.
+class RDBWriter {
+public:
+    explicit RDBWriter(int fd);
+
+    // Writes the whole file, checksum included. Keys that have already
+    // expired are skipped. Returns false on a write error.
+    bool save(const std::unordered_map<std::string, Entry>& kv_store);
+
+    // Forks a child that saves db.kv_store to fd, a file or a pipe, and exits
+    // with status 0 on success. The caller must hold kv_mutex so the child
+    // starts from a consistent keyspace; the parent can release it as soon as
+    // this returns.
+    static pid_t fork_snapshot(Database& db, int fd);
+
+private:
+    int fd;
+    std::string buffer;
+    uint64_t crc = 0;
+    bool failed = false;
+
+    void flush();
+    void write_raw(const void* data, size_t len);
+    void write_byte(uint8_t byte);
+    void write_u64_le(uint64_t value);
+    void write_double(double value);
+    void write_length(uint64_t len);
+    void write_string(const std::string& str);
+    void write_stream_id(const StreamID& id);
+    void write_stream(const Stream& stream);
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Client;
+
+struct ChannelSubscriber {
+    std::weak_ptr<Client> client;
+    const Client* id; // identity only, never dereferenced
+};
+
+// Channel -> subscribers map split into independently locked shards.
+// Each channel's subscriber list is immutable once published: SUBSCRIBE and
+// UNSUBSCRIBE copy it, edit the copy and swap the pointer in, while PUBLISH
+// only holds a shard's read lock long enough to take a reference to the
+// current list. A replaced list is freed when its last reader drops it.
+class ChannelRegistry {
+public:
+    using SubscriberList = std::vector<ChannelSubscriber>;
+
+    static const size_t SHARD_COUNT = 64;
+
+    // Returns true if the client was not already subscribed.
+    bool subscribe(const std::string& channel, const std::shared_ptr<Client>& client) {
+        Shard& shard = shard_for(channel);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto& current = shard.channels[channel];
+        if (current) {
+            for (const auto& sub : *current) {
+                if (sub.id == client.get()) return false;
+            }
+        }
+
+        auto next = current ? std::make_shared<SubscriberList>(*current) : std::make_shared<SubscriberList>();
+        next->push_back({client, client.get()});
+        current = std::move(next);
+        return true;
+    }
+
+    // Returns true if the client was subscribed.
+    bool unsubscribe(const std::string& channel, const Client* client) {
+        Shard& shard = shard_for(channel);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto it = shard.channels.find(channel);
+        if (it == shard.channels.end()) return false;
+
+        auto next = std::make_shared<SubscriberList>();
+        next->reserve(it->second->size());
+        for (const auto& sub : *it->second) {
+            if (sub.id != client) next->push_back(sub);
+        }
+        if (next->size() == it->second->size()) return false;
+
+        if (next->empty()) shard.channels.erase(it);
+        else it->second = std::move(next);
+        return true;
+    }
+
+    // Snapshot of the channel's subscribers, or nullptr if it has none.
+    std::shared_ptr<const SubscriberList> subscribers(const std::string& channel) const {
+        const Shard& shard = shard_for(channel);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto it = shard.channels.find(channel);
+        return (it == shard.channels.end()) ? nullptr : it->second;
+    }
+
+    size_t count(const std::string& channel) const {
+        auto list = subscribers(channel);
+        return list ? list->size() : 0;
+    }
+
+    // Calls fn(channel) for every channel with at least one subscriber.
+    template <typename Fn>
+    void for_each_channel(Fn fn) const {
+        for (const Shard& shard : shards) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            for (const auto& entry : shard.channels) fn(entry.first);
+        }
+    }
+
+private:
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const SubscriberList>> channels;
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+
+    Shard& shard_for(const std::string& channel) {
+        return shards[std::hash<std::string>{}(channel) % SHARD_COUNT];
+    }
+
+    const Shard& shard_for(const std::string& channel) const {
+        return shards[std::hash<std::string>{}(channel) % SHARD_COUNT];
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include "../../utils/utils.hpp"
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class Client;
+
+// Index of PSUBSCRIBE patterns keyed by each pattern's literal prefix (the
+// characters before its first glob metacharacter). A channel only has to be
+// checked against the patterns stored on the trie path it spells out; every
+// other pattern has a prefix the channel does not start with.
+//
+// Subscribers are held weakly, like ChannelRegistry's, so a client whose
+// last reference is gone is skipped even before its destructor unsubscribes.
+class PatternTrie {
+public:
+    // Returns true if the client was not already subscribed to pattern.
+    bool add(const std::string& pattern, const std::shared_ptr<Client>& client) {
+        Node* node = &root;
+        for (char c : literal_prefix(pattern)) {
+            auto& child = node->children[c];
+            if (!child) child = std::make_unique<Node>();
+            node = child.get();
+        }
+
+        auto& clients = node->patterns[pattern];
+        if (clients.empty()) pattern_count++;
+        return clients.emplace(client.get(), client).second;
+    }
+
+    // Returns true if the client was subscribed to pattern.
+    bool remove(const std::string& pattern, const Client* client) {
+        return remove(root, pattern, literal_prefix(pattern), client);
+    }
+
+    // Calls fn(pattern, client) for every live subscriber matching channel.
+    template <typename Fn>
+    void match(const std::string& channel, Fn fn) const {
+        const Node* node = &root;
+        size_t depth = 0;
+
+        while (node != nullptr) {
+            for (const auto& [pattern, clients] : node->patterns) {
+                std::string_view rest(pattern);
+                rest.remove_prefix(depth);
+                if (!string_match(rest, std::string_view(channel).substr(depth))) continue;
+                for (const auto& [id, weak] : clients) {
+                    if (auto client = weak.lock()) fn(pattern, client);
+                }
+            }
+            if (depth == channel.size()) break;
+
+            auto it = node->children.find(channel[depth++]);
+            node = (it == node->children.end()) ? nullptr : it->second.get();
+        }
+    }
+
+    size_t size() const { return pattern_count; }
+
+private:
+    struct Node {
+        std::map<char, std::unique_ptr<Node>> children;
+        std::map<std::string, std::map<const Client*, std::weak_ptr<Client>>> patterns;
+    };
+
+    Node root;
+    size_t pattern_count = 0;
+
+    static std::string_view literal_prefix(std::string_view pattern) {
+        return pattern.substr(0, pattern.find_first_of("*?[\\"));
+    }
+
+    bool remove(Node& node, const std::string& pattern, std::string_view rest, const Client* client) {
+        if (!rest.empty()) {
+            auto it = node.children.find(rest[0]);
+            if (it == node.children.end()) return false;
+
+            bool removed = remove(*it->second, pattern, rest.substr(1), client);
+            if (it->second->children.empty() && it->second->patterns.empty()) node.children.erase(it);
+            return removed;
+        }
+
+        auto it = node.patterns.find(pattern);
+        if (it == node.patterns.end() || it->second.erase(client) == 0) return false;
+        if (it->second.empty()) {
+            node.patterns.erase(it);
+            pattern_count--;
+        }
+        return true;
+    }
+};
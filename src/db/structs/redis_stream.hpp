@@ -7,26 +7,111 @@
 #include <stdexcept>
 #include <iostream>
 #include <limits>
+#include <string_view>
+
+// A decoded stream entry whose strings point into the block holding it.
+struct StreamEntryView {
+    StreamID id;
+    bool deleted = false;
+    std::vector<std::pair<std::string_view, std::string_view>> pairs;
+};
+
+// XTRIM / XADD trimming options. Approximate trimming only drops whole
+// blocks, so it never has to touch entries inside a block.
+struct StreamTrimSpec {
+    bool by_min_id = false;
+    bool approximate = false;
+    uint64_t max_len = 0;
+    StreamID min_id;
+    uint64_t limit = 0; // 0 means unlimited
+};
 
 class RedisStream {
+public:
+    static const uint32_t BLOCK_MAX_ENTRIES = 100;
+    static const size_t BLOCK_MAX_BYTES = 4096;
+
 private:
-    struct StreamID {
-        uint64_t ms;
-        uint64_t seq;
-        
-        bool operator>(const StreamID& other) const {
-            if (ms != other.ms) return ms > other.ms;
-            return seq > other.seq;
-        }
-        bool operator<(const StreamID& other) const {
-            if (ms != other.ms) return ms < other.ms;
-            return seq < other.seq;
-        }
-        bool operator>=(const StreamID& other) const { return !(*this < other); }
-        bool operator<=(const StreamID& other) const { return !(*this > other); }
-        bool operator==(const StreamID& other) const { return ms == other.ms && seq == other.seq; }
+    enum EntryFlags : uint8_t {
+        ENTRY_DELETED = 1,
+        ENTRY_SAME_FIELDS = 2
     };
 
+    static void put_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static uint64_t get_varint(const std::string& in, size_t& pos) {
+        uint64_t value = 0;
+        int shift = 0;
+        while (true) {
+            uint8_t byte = static_cast<uint8_t>(in[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+            shift += 7;
+        }
+        return value;
+    }
+
+    static void put_string(std::string& out, const std::string& str) {
+        put_varint(out, str.size());
+        out.append(str);
+    }
+
+    static std::string_view get_string(const std::string& in, size_t& pos) {
+        size_t len = get_varint(in, pos);
+        std::string_view str(in.data() + pos, len);
+        pos += len;
+        return str;
+    }
+
+    static bool has_master_fields(const StreamBlock& block, const std::vector<std::pair<std::string, std::string>>& pairs) {
+        if (block.master_fields.size() != pairs.size()) return false;
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            if (block.master_fields[i] != pairs[i].first) return false;
+        }
+        return true;
+    }
+
+public:
+    // Appends an entry whose ID the caller has already checked is greater
+    // than stream.last_id.
+    static void append_entry(Stream& stream, const StreamID& id, const std::vector<std::pair<std::string, std::string>>& pairs) {
+        StreamBlock* block = nullptr;
+        if (!stream.blocks.empty()) {
+            StreamBlock& tail = stream.blocks.rbegin()->second;
+            if (tail.entries < BLOCK_MAX_ENTRIES && tail.data.size() < BLOCK_MAX_BYTES) block = &tail;
+        }
+        if (block == nullptr) {
+            block = &stream.blocks[id];
+            block->master_id = id;
+            for (const auto& pair : pairs) block->master_fields.push_back(pair.first);
+        }
+
+        bool same_fields = has_master_fields(*block, pairs);
+        uint64_t ms_delta = id.ms - block->master_id.ms;
+
+        block->data.push_back(static_cast<char>(same_fields ? ENTRY_SAME_FIELDS : 0));
+        put_varint(block->data, ms_delta);
+        put_varint(block->data, ms_delta == 0 ? id.seq - block->master_id.seq : id.seq);
+        if (!same_fields) put_varint(block->data, pairs.size());
+        for (const auto& pair : pairs) {
+            if (!same_fields) put_string(block->data, pair.first);
+            put_string(block->data, pair.second);
+        }
+
+        block->last_id = id;
+        block->entries++;
+        block->live++;
+        stream.last_id = id;
+        stream.length++;
+        stream.entries_added++;
+    }
+
     static StreamID parse_explicit_id(const std::string& id) {
         size_t dash_pos = id.find('-');
         if (dash_pos == std::string::npos) {
@@ -63,28 +148,60 @@ private:
         return {ms, seq};
     }
 
-public:
+    static StreamID max_id() {
+        return {std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max()};
+    }
+
+    static bool increment(StreamID& id) {
+        if (id.seq == std::numeric_limits<uint64_t>::max()) {
+            if (id.ms == std::numeric_limits<uint64_t>::max()) return false;
+            id.ms++;
+            id.seq = 0;
+        } else {
+            id.seq++;
+        }
+        return true;
+    }
+
+    static bool decrement(StreamID& id) {
+        if (id.seq == 0) {
+            if (id.ms == 0) return false;
+            id.ms--;
+            id.seq = std::numeric_limits<uint64_t>::max();
+        } else {
+            id.seq--;
+        }
+        return true;
+    }
+
+    // Parses an XRANGE/XREVRANGE bound; a leading '(' makes it exclusive.
+    static StreamID parse_range_bound(const std::string& id, bool is_end) {
+        if (id.empty() || id[0] != '(') return parse_range_id(id, is_end);
+
+        std::string inner = id.substr(1);
+        if (inner == "-" || inner == "+") throw std::invalid_argument("Invalid stream ID format");
+
+        StreamID bound = parse_range_id(inner, is_end);
+        if (is_end && !decrement(bound)) throw std::runtime_error("ERR invalid end ID for the interval");
+        if (!is_end && !increment(bound)) throw std::runtime_error("ERR invalid start ID for the interval");
+        return bound;
+    }
+
     static std::string xadd(Entry& entry, const std::string& id_str, const std::vector<std::pair<std::string, std::string>>& pairs) {
+        Stream& stream = entry.stream_val;
         StreamID new_id;
-        bool is_generated = false;
 
         if (id_str == "*") {
             uint64_t now_ms = current_time_ms();
             uint64_t seq = 0;
 
-            if (!entry.stream_val.empty()) {
-                const auto& last = entry.stream_val.back();
-                StreamID last_id = {last.ms, last.seq};
-                if (now_ms > last_id.ms) {
-                    seq = 0;
-                } else {
-                    now_ms = last_id.ms;
-                    seq = last_id.seq + 1;
-                }
+            const StreamID& last_id = stream.last_id;
+            if (now_ms <= last_id.ms) {
+                now_ms = last_id.ms;
+                seq = last_id.seq + 1;
             }
             if (now_ms == 0 && seq == 0) seq = 1;
             new_id = {now_ms, seq};
-            is_generated = true;
         }
         else if (id_str.find("-*") != std::string::npos) {
             size_t dash_pos = id_str.find('-');
@@ -93,13 +210,9 @@ public:
             } catch (...) { throw std::invalid_argument("Invalid stream ID format"); }
 
             uint64_t seq = 0;
-            if (!entry.stream_val.empty()) {
-                const auto& last = entry.stream_val.back();
-                if (new_id.ms == last.ms) seq = last.seq + 1;
-            }
+            if (new_id.ms == stream.last_id.ms) seq = stream.last_id.seq + 1;
             if (new_id.ms == 0 && seq == 0) seq = 1;
             new_id.seq = seq;
-            is_generated = true;
         } 
         else {
             new_id = parse_explicit_id(id_str);
@@ -109,59 +222,224 @@ public:
             throw std::runtime_error("ERR The ID specified in XADD must be greater than 0-0");
         }
 
-        if (!entry.stream_val.empty()) {
-            const auto& last = entry.stream_val.back();
-            StreamID last_id = {last.ms, last.seq};
-            if (new_id <= last_id) {
-                throw std::runtime_error("ERR The ID specified in XADD is equal or smaller than the target stream top item");
-            }
+        if (new_id <= stream.last_id) {
+            throw std::runtime_error("ERR The ID specified in XADD is equal or smaller than the target stream top item");
         }
 
-        std::string final_id_str;
-        if (is_generated) {
-            final_id_str = std::to_string(new_id.ms) + "-" + std::to_string(new_id.seq);
+        append_entry(stream, new_id, pairs);
+        return new_id.to_string();
+    }
+
+    // Decodes the entry at pos and returns the position of the entry after it.
+    static size_t decode_entry(const StreamBlock& block, size_t pos, StreamEntryView& out) {
+        uint8_t flags = static_cast<uint8_t>(block.data[pos++]);
+        uint64_t ms_delta = get_varint(block.data, pos);
+        uint64_t seq = get_varint(block.data, pos);
+
+        out.id.ms = block.master_id.ms + ms_delta;
+        out.id.seq = (ms_delta == 0) ? block.master_id.seq + seq : seq;
+        out.deleted = (flags & ENTRY_DELETED) != 0;
+        out.pairs.clear();
+
+        if (flags & ENTRY_SAME_FIELDS) {
+            for (const auto& field : block.master_fields) {
+                out.pairs.emplace_back(field, get_string(block.data, pos));
+            }
         } else {
-            final_id_str = id_str;
+            uint64_t count = get_varint(block.data, pos);
+            for (uint64_t i = 0; i < count; ++i) {
+                std::string_view field = get_string(block.data, pos);
+                out.pairs.emplace_back(field, get_string(block.data, pos));
+            }
+        }
+        return pos;
+    }
+
+    // Visits live entries in ID order until fn returns false.
+    template <typename Fn>
+    static void for_each(const Stream& stream, Fn fn) {
+        StreamEntryView view;
+        for (const auto& [master_id, block] : stream.blocks) {
+            size_t pos = 0;
+            while (pos < block.data.size()) {
+                pos = decode_entry(block, pos, view);
+                if (!view.deleted && !fn(view)) return;
+            }
         }
+    }
+
+    // Visits live entries with start <= id <= end in ID order until fn returns
+    // false. Seeks straight to the block that can hold start.
+    template <typename Fn>
+    static void for_each_in_range(const Stream& stream, const StreamID& start, const StreamID& end, Fn fn) {
+        if (start > end) return;
+
+        auto it = stream.blocks.upper_bound(start);
+        if (it != stream.blocks.begin()) --it;
 
-        StreamEntry new_entry;
-        new_entry.id_str = final_id_str;
-        new_entry.ms = new_id.ms;
-        new_entry.seq = new_id.seq;
-        new_entry.pairs = pairs;
-        
-        entry.stream_val.push_back(new_entry);
-        return final_id_str;
+        StreamEntryView view;
+        for (; it != stream.blocks.end() && it->first <= end; ++it) {
+            const StreamBlock& block = it->second;
+            if (block.last_id < start || block.live == 0) continue;
+
+            size_t pos = 0;
+            while (pos < block.data.size()) {
+                pos = decode_entry(block, pos, view);
+                if (view.deleted || view.id < start) continue;
+                if (view.id > end) return;
+                if (!fn(view)) return;
+            }
+        }
     }
 
-    static std::vector<StreamEntry> range(const Entry& entry, const std::string& start_str, const std::string& end_str) {
-        std::vector<StreamEntry> result;
-        if (entry.stream_val.empty()) return result;
+    // Same as for_each_in_range, newest entry first.
+    template <typename Fn>
+    static void for_each_in_range_reverse(const Stream& stream, const StreamID& start, const StreamID& end, Fn fn) {
+        if (start > end) return;
 
-        StreamID start_id = parse_range_id(start_str, false);
-        StreamID end_id = parse_range_id(end_str, true);
+        auto it = stream.blocks.upper_bound(end);
+        StreamEntryView view;
+        std::vector<size_t> offsets;
 
-        for (const auto& item : entry.stream_val) {
-            StreamID item_id = {item.ms, item.seq};
-            if (item_id >= start_id && item_id <= end_id) {
-                result.push_back(item);
+        while (it != stream.blocks.begin()) {
+            --it;
+            const StreamBlock& block = it->second;
+            if (block.last_id < start) return;
+            if (block.live == 0) continue;
+
+            offsets.clear();
+            for (size_t pos = 0; pos < block.data.size(); pos = decode_entry(block, pos, view)) {
+                offsets.push_back(pos);
+            }
+
+            for (auto off = offsets.rbegin(); off != offsets.rend(); ++off) {
+                decode_entry(block, *off, view);
+                if (view.deleted || view.id > end) continue;
+                if (view.id < start) return;
+                if (!fn(view)) return;
             }
         }
-        return result;
     }
 
-    static std::vector<StreamEntry> read(const Entry& entry, const std::string& start_str) {
-        std::vector<StreamEntry> result;
-        if (entry.stream_val.empty()) return result;
+    // Tombstones the entry with the given ID. A block left without live
+    // entries is dropped from the index.
+    static bool delete_entry(Stream& stream, const StreamID& id) {
+        auto it = stream.blocks.upper_bound(id);
+        if (it == stream.blocks.begin()) return false;
+        --it;
 
-        StreamID start_id = parse_explicit_id(start_str);
+        StreamBlock& block = it->second;
+        if (block.last_id < id) return false;
 
-        for (const auto& item : entry.stream_val) {
-            StreamID item_id = {item.ms, item.seq};
-            if (item_id > start_id) {
-                result.push_back(item);
+        StreamEntryView view;
+        for (size_t pos = 0; pos < block.data.size();) {
+            size_t next = decode_entry(block, pos, view);
+            if (view.id > id) return false;
+            if (view.id == id) {
+                if (view.deleted) return false;
+                block.data[pos] |= ENTRY_DELETED;
+                block.live--;
+                stream.length--;
+                if (id > stream.max_deleted_id) stream.max_deleted_id = id;
+                if (block.live == 0) stream.blocks.erase(it);
+                return true;
             }
+            pos = next;
         }
-        return result;
+        return false;
+    }
+
+    // Evicts the oldest entries according to spec and returns how many were
+    // removed. Whole blocks are unlinked from the index; only exact trimming
+    // tombstones individual entries at the head of the first block.
+    static uint64_t trim(Stream& stream, const StreamTrimSpec& spec) {
+        uint64_t removed = 0;
+
+        while (!stream.blocks.empty()) {
+            auto it = stream.blocks.begin();
+            StreamBlock& block = it->second;
+
+            bool whole = spec.by_min_id ? block.last_id < spec.min_id
+                                        : stream.length - block.live >= spec.max_len;
+            if (whole) {
+                if (spec.limit > 0 && removed + block.live > spec.limit) break;
+                removed += block.live;
+                stream.length -= block.live;
+                stream.blocks.erase(it);
+                continue;
+            }
+            if (spec.approximate) break;
+
+            StreamEntryView view;
+            for (size_t pos = 0; pos < block.data.size();) {
+                size_t next = decode_entry(block, pos, view);
+                if (!view.deleted) {
+                    bool drop = spec.by_min_id ? view.id < spec.min_id : stream.length > spec.max_len;
+                    if (!drop) break;
+                    block.data[pos] |= ENTRY_DELETED;
+                    block.live--;
+                    stream.length--;
+                    removed++;
+                }
+                pos = next;
+            }
+            // Entries past the cut may all have been deleted already.
+            if (block.live == 0) stream.blocks.erase(it);
+            break;
+        }
+        return removed;
+    }
+
+    // Fetches a single live entry by ID.
+    static bool find_entry(const Stream& stream, const StreamID& id, StreamEntryView& out) {
+        bool found = false;
+        for_each_in_range(stream, id, id, [&](const StreamEntryView& view) {
+            out.id = view.id;
+            out.deleted = false;
+            out.pairs = view.pairs;
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+    static StreamConsumer& get_or_create_consumer(StreamConsumerGroup& group, const std::string& name, long long now) {
+        auto it = group.consumers.find(name);
+        if (it == group.consumers.end()) {
+            it = group.consumers.emplace(name, StreamConsumer()).first;
+        }
+        it->second.seen_time = now;
+        return it->second;
+    }
+
+    // Makes consumer the owner of the pending entry for id, creating it if needed.
+    static StreamPendingEntry& pel_assign(StreamConsumerGroup& group, const StreamID& id, const std::string& consumer) {
+        auto it = group.pending.find(id);
+        if (it == group.pending.end()) {
+            it = group.pending.emplace(id, StreamPendingEntry()).first;
+        } else if (it->second.consumer != consumer) {
+            auto owner = group.consumers.find(it->second.consumer);
+            if (owner != group.consumers.end()) owner->second.pending.erase(id);
+        }
+
+        it->second.consumer = consumer;
+        group.consumers[consumer].pending.insert(id);
+        return it->second;
+    }
+
+    static void pel_deliver(StreamConsumerGroup& group, const StreamID& id, const std::string& consumer, long long now) {
+        StreamPendingEntry& pending = pel_assign(group, id, consumer);
+        pending.delivery_time = now;
+        pending.delivery_count++;
+    }
+
+    static bool pel_ack(StreamConsumerGroup& group, const StreamID& id) {
+        auto it = group.pending.find(id);
+        if (it == group.pending.end()) return false;
+
+        auto owner = group.consumers.find(it->second.consumer);
+        if (owner != group.consumers.end()) owner->second.pending.erase(id);
+        group.pending.erase(it);
+        return true;
     }
-};
\ No newline at end of file
+};
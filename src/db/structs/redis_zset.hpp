@@ -8,7 +8,9 @@
 
 class RedisZSet {
 public:
-    static int add(Entry& entry, double score, const std::string& member) {
+    // Returns 1 if member is new. updated, when given, is incremented if an
+    // existing member's score changes.
+    static int add(Entry& entry, double score, const std::string& member, int* updated = nullptr) {
         auto& dict = entry.zset_val.dict;
         auto& tree = entry.zset_val.tree;
 
@@ -19,8 +21,9 @@ public:
                 tree.erase({old_score, member});
                 tree.insert({score, member});
                 it->second = score;
+                if (updated) (*updated)++;
             }
-            return 0; 
+            return 0;
         } else {
             dict[member] = score;
             tree.insert({score, member});
@@ -82,6 +85,16 @@ public:
         return result;
     }
 
+    // Visits members with min <= score < max in score order; fn returns false to stop early.
+    template <typename Fn>
+    static bool for_each_in_score_range(const Entry& entry, double min, double max, Fn fn) {
+        const auto& tree = entry.zset_val.tree;
+        for (auto it = tree.lower_bound({min, std::string()}); it != tree.end() && it->first < max; ++it) {
+            if (!fn(it->second, it->first)) return false;
+        }
+        return true;
+    }
+
     static int size(const Entry& entry) {
         return static_cast<int>(entry.zset_val.tree.size());
     }
@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Fixed-size ring holding the tail of the replication stream. Offsets are
+// replication offsets: the number of stream bytes produced before a given
+// byte, so end_offset() always equals master_repl_offset. A replica that
+// reconnects having processed N bytes can resume if start_offset() <= N.
+class ReplicationBacklog {
+public:
+    ReplicationBacklog(size_t capacity, long long offset)
+        : ring(std::max<size_t>(capacity, 1)), end(offset) {}
+
+    void append(const char* data, size_t len) {
+        end += static_cast<long long>(len);
+        if (len >= ring.size()) {
+            data += len - ring.size();
+            len = ring.size();
+        }
+
+        size_t first = std::min(len, ring.size() - head);
+        std::copy(data, data + first, ring.begin() + head);
+        std::copy(data + first, data + len, ring.begin());
+        head = (head + len) % ring.size();
+        histlen = std::min(histlen + len, ring.size());
+    }
+
+    long long start_offset() const { return end - static_cast<long long>(histlen); }
+    long long end_offset() const { return end; }
+    size_t size() const { return histlen; }
+    size_t capacity() const { return ring.size(); }
+
+    // Appends everything from offset to the end of the stream to out.
+    // Returns false if offset is outside the retained window.
+    bool copy_from(long long offset, std::string& out) const {
+        if (offset < start_offset() || offset > end) return false;
+
+        size_t len = static_cast<size_t>(end - offset);
+        size_t pos = (head + ring.size() - len) % ring.size();
+        size_t first = std::min(len, ring.size() - pos);
+        out.append(ring.data() + pos, first);
+        out.append(ring.data(), len - first);
+        return true;
+    }
+
+    // Changes the capacity, keeping as much of the most recent history as fits.
+    void resize(size_t capacity) {
+        std::string tail;
+        copy_from(start_offset(), tail);
+
+        ring.assign(std::max<size_t>(capacity, 1), '\0');
+        head = 0;
+        histlen = 0;
+        end -= static_cast<long long>(tail.size());
+        append(tail.data(), tail.size());
+    }
+
+private:
+    std::vector<char> ring;
+    size_t head = 0;    // where the next byte goes
+    size_t histlen = 0; // valid bytes, ending just before head
+    long long end;
+};
@@ -1,4 +1,5 @@
 #include "server/server.hpp"
+#include "db/persistence.hpp"
 #include <string>
 #include <vector>
 #include <iostream>
@@ -22,6 +23,59 @@ int main(int argc, char **argv) {
                 std::cerr << "Invalid port number provided" << std::endl;
             }
             i++;
+        } else if (arg == "--repl-backlog-size" && i + 1 < argc) {
+            try {
+                server.db.config.repl_backlog_size = std::stoull(argv[i + 1]);
+            } catch (...) {
+                std::cerr << "Invalid repl-backlog-size provided" << std::endl;
+            }
+            i++;
+        } else if (arg == "--save" && i + 1 < argc) {
+            if (!Persistence::parse_save_params(argv[i + 1], server.db.persistence.save_params)) {
+                std::cerr << "Invalid save rules provided" << std::endl;
+            }
+            i++;
+        } else if (arg == "--repl-diskless-sync" && i + 1 < argc) {
+            server.db.config.repl_diskless_sync = (std::string(argv[i + 1]) == "yes");
+            i++;
+        } else if (arg == "--repl-diskless-sync-delay" && i + 1 < argc) {
+            try {
+                server.db.config.repl_diskless_sync_delay = std::stoi(argv[i + 1]);
+            } catch (...) {
+                std::cerr << "Invalid repl-diskless-sync-delay provided" << std::endl;
+            }
+            i++;
+        } else if (arg == "--appendonly" && i + 1 < argc) {
+            server.db.config.appendonly = (std::string(argv[i + 1]) == "yes");
+            i++;
+        } else if (arg == "--appendfsync" && i + 1 < argc) {
+            AppendFsync policy;
+            if (AppendOnlyFile::parse_fsync_policy(argv[i + 1], policy)) {
+                server.db.aof.set_fsync_policy(policy);
+            } else {
+                std::cerr << "Invalid appendfsync policy provided" << std::endl;
+            }
+            i++;
+        } else if (arg == "--appendfilename" && i + 1 < argc) {
+            server.db.config.appendfilename = argv[i + 1];
+            i++;
+        } else if (arg == "--appenddirname" && i + 1 < argc) {
+            server.db.config.appenddirname = argv[i + 1];
+            i++;
+        } else if (arg == "--auto-aof-rewrite-percentage" && i + 1 < argc) {
+            try {
+                server.db.persistence.auto_aof_rewrite_percentage = std::stoll(argv[i + 1]);
+            } catch (...) {
+                std::cerr << "Invalid auto-aof-rewrite-percentage provided" << std::endl;
+            }
+            i++;
+        } else if (arg == "--auto-aof-rewrite-min-size" && i + 1 < argc) {
+            try {
+                server.db.persistence.auto_aof_rewrite_min_size = std::stoll(argv[i + 1]);
+            } catch (...) {
+                std::cerr << "Invalid auto-aof-rewrite-min-size provided" << std::endl;
+            }
+            i++;
         } else if (arg == "--replicaof" && i + 1 < argc) {
             server.db.config.role = "slave";
             std::string replica_arg = argv[i + 1];
@@ -6,9 +6,15 @@
 #include <algorithm>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include "../utils/utils.hpp"
 
 Client::Client(int fd, Database& db) : fd(fd), db(db) {
     blocker = std::make_shared<BlockedClient>();
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     
     std::lock_guard<std::mutex> lock(db.acl_mutex);
     auto it = db.users.find("default");
@@ -25,12 +31,137 @@ Client::Client(int fd, Database& db) : fd(fd), db(db) {
 }
 
 Client::~Client() {
+    if (!watched_keys.empty()) {
+        std::lock_guard<std::recursive_mutex> lock(db.kv_mutex);
+        db.unwatch_all(*this);
+    }
+    for (const auto& channel : subscriptions) {
+        db.pubsub_channels.unsubscribe(channel, this);
+    }
+    for (const auto& channel : shard_subscriptions) {
+        db.pubsub_shard_channels.unsubscribe(channel, this);
+    }
+    {
+        std::lock_guard<std::mutex> lock(db.pubsub_mutex);
+        for (const auto& pattern : patterns) {
+            db.pubsub_patterns.remove(pattern, this);
+        }
+    }
+
     if (fd >= 0) close(fd);
+    if (wake_fd >= 0) close(wake_fd);
+}
 
-    std::lock_guard<std::mutex> lock(db.pubsub_mutex);
-    for (const auto& channel : subscriptions) {
-        db.pubsub_channels[channel].erase(this);
+void Client::enqueue(std::shared_ptr<const std::string> data) {
+    if (data->empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (closing) return;
+        output_bytes += data->size();
+        output_queue.push_back(std::move(data));
+    }
+    wake();
+}
+
+bool Client::enqueue_limited(std::shared_ptr<const std::string> data, const OutputBufferLimit& limit) {
+    size_t hard_limit = limit.hard;
+    size_t soft_limit = limit.soft;
+    bool over_limit = false;
+
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (closing) return false;
+        output_bytes += data->size();
+        output_queue.push_back(std::move(data));
+
+        if (hard_limit > 0 && output_bytes > hard_limit) {
+            over_limit = true;
+        } else if (soft_limit > 0 && output_bytes > soft_limit) {
+            long long now = current_time_ms();
+            if (soft_limit_since == 0) soft_limit_since = now;
+            over_limit = (now - soft_limit_since >= limit.soft_seconds * 1000);
+        } else {
+            soft_limit_since = 0;
+        }
+
+        if (over_limit) {
+            closing = true;
+            output_queue.clear();
+            output_bytes = 0;
+        }
+    }
+
+    if (over_limit) {
+        std::cerr << "Client fd " << fd << " closed for overcoming of output buffer limits.\n";
+        shutdown(fd, SHUT_RDWR);
+        return false;
+    }
+    wake();
+    return true;
+}
+
+bool Client::send_all(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pollfd pfd = {fd, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+void Client::wake() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// Writes as much queued output as the socket takes without blocking,
+// gathering up to FLUSH_BATCH queued buffers into each send.
+// Returns false once the connection is unusable.
+bool Client::flush_output() {
+    static const size_t FLUSH_BATCH = 64;
+    std::lock_guard<std::mutex> lock(output_mutex);
+
+    while (!output_queue.empty()) {
+        iovec iov[FLUSH_BATCH];
+        size_t count = 0;
+        for (auto it = output_queue.begin(); it != output_queue.end() && count < FLUSH_BATCH; ++it, ++count) {
+            size_t skip = (count == 0) ? output_offset : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+            iov[count].iov_len = (*it)->size() - skip;
+        }
+
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        output_bytes -= sent;
+        size_t remaining = static_cast<size_t>(sent);
+        while (remaining > 0) {
+            size_t front_left = output_queue.front()->size() - output_offset;
+            if (remaining < front_left) {
+                output_offset += remaining;
+                break;
+            }
+            remaining -= front_left;
+            output_queue.pop_front();
+            output_offset = 0;
+        }
     }
+    return !closing;
 }
 
 void Client::handle_requests() {
@@ -38,6 +169,26 @@ void Client::handle_requests() {
     std::string accumulated_data;
 
     while (true) {
+        pollfd fds[2] = {{fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            if (closing) break;
+            if (!output_queue.empty()) fds[0].events |= POLLOUT;
+        }
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t ignored = read(wake_fd, &count, sizeof(count));
+            (void)ignored;
+        }
+        if (!flush_output()) break;
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
         ssize_t bytes_read = recv(fd, buffer, sizeof(buffer), 0);
         if (bytes_read <= 0) break;
 
@@ -53,7 +204,12 @@ void Client::handle_requests() {
             std::string response = Dispatcher::dispatch(db, shared_from_this(), args);
             
             if (!response.empty()) {
-                send(fd, response.c_str(), response.length(), 0);
+                {
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    output_bytes += response.size();
+                    output_queue.push_back(std::make_shared<const std::string>(std::move(response)));
+                }
+                if (!flush_output()) return;
             }
             
             processed_bytes += command_size;
@@ -61,4 +217,4 @@ void Client::handle_requests() {
         
         accumulated_data.erase(0, processed_bytes);
     }
-}
\ No newline at end of file
+}
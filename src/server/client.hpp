@@ -3,6 +3,8 @@
 #include <string>
 #include <memory>
 #include <unordered_set>
+#include <deque>
+#include <mutex>
 #include "../db/database.hpp" 
 
 class Client : public std::enable_shared_from_this<Client> {
@@ -12,15 +14,75 @@ public:
     
     bool in_multi = false;
     std::vector<std::vector<std::string>> transaction_queue;
+    // WATCHed keys, each with whether it had already expired when watched,
+    // and whether any has been touched since. Guarded by Database::kv_mutex.
+    std::vector<std::pair<std::string, bool>> watched_keys;
+    bool watch_dirty = false;
     std::shared_ptr<BlockedClient> blocker;
     std::unordered_set<std::string> subscriptions;
+    std::unordered_set<std::string> patterns;
+    std::unordered_set<std::string> shard_subscriptions;
     
     std::string username = "default";
     bool is_authenticated = false;
-    long long repl_offset = 0;
+    bool is_master = false; // replica side: the link we apply the master's stream from
+    // Set by a write command whose effect depends on when or where it ran
+    // (an auto-generated ID, a relative TTL, a stream delivery) to commands
+    // that don't, which are then propagated instead of the command as given.
+    // With propagate_replaced set and no commands, nothing is propagated.
+    bool propagate_replaced = false;
+    std::vector<std::vector<std::string>> propagate_args;
+
+    void propagate_as(std::vector<std::string> command) {
+        propagate_replaced = true;
+        propagate_args.push_back(std::move(command));
+    }
+    void clear_propagation() {
+        propagate_replaced = false;
+        propagate_args.clear();
+    }
+    // Stream offset just after this client's last propagated write, which
+    // is what its WAIT waits for. Guarded by Database::replication_mutex.
+    long long repl_write_offset = 0;
+    // AOF log offset just past this client's last write, which is what its
+    // WAITAOF waits for. Guarded by Database::replication_mutex.
+    long long aof_write_offset = 0;
+    // Replica bookkeeping, guarded by Database::replication_mutex.
+    long long repl_offset = 0; // last acknowledged offset
+    long long repl_ack_time = 0;
+    int repl_listening_port = 0;
+    const char* repl_state = "online";
+    bool repl_capa_eof = false; // accepts an EOF-marked (diskless) payload
 
     Client(int fd, Database& db);
     ~Client();
 
     void handle_requests();
+
+    // Queues data for this client's socket and wakes its thread to write it.
+    // Other threads never write to fd directly, so a slow reader only ever
+    // grows its own queue.
+    void enqueue(std::shared_ptr<const std::string> data);
+
+    // Same as enqueue, but enforces an output buffer limit class. Returns
+    // false if the client is over the limit and has been disconnected.
+    bool enqueue_limited(std::shared_ptr<const std::string> data, const OutputBufferLimit& limit);
+
+    // Blocking write straight to the socket, bypassing the queue. Only for
+    // the client's own thread while nothing queued is due ahead of data, as
+    // when a full resync payload goes out before the buffered write stream.
+    bool send_all(const char* data, size_t len);
+
+private:
+    int wake_fd = -1;
+
+    std::mutex output_mutex;
+    std::deque<std::shared_ptr<const std::string>> output_queue;
+    size_t output_offset = 0; // bytes of the front buffer already written
+    size_t output_bytes = 0;  // unwritten bytes across the whole queue
+    long long soft_limit_since = 0;
+    bool closing = false;
+
+    void wake();
+    bool flush_output();
 };
\ No newline at end of file
@@ -2,24 +2,33 @@
 #include "client.hpp"
 #include "../commands/dispatcher.hpp"
 #include "../utils/utils.hpp"
+#include "../protocol/parser.hpp"
+#include "../db/rdb_loader.hpp"
+#include "../db/persistence.hpp"
+#include "../db/aof_loader.hpp"
 #include <iostream>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h> 
+#include <poll.h>
+#include <cerrno>
 #include <cstring>
 #include <thread>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <chrono>
 
 void Server::run(int port) {
     std::cout << std::unitbuf;
     std::cerr << std::unitbuf;
     
-    db.load_from_file();
+    if (!load_data()) return;
+    db.persistence.last_save_time = current_time_ms() / 1000;
+    std::thread(&Server::cron, this).detach();
 
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -69,17 +78,102 @@ void Server::run(int port) {
     }
 }
 
+// With appendonly the AOF is the source of truth. If there is none yet, the
+// dump is loaded and a background rewrite makes it the AOF's first base.
+bool Server::load_data() {
+    if (!db.config.appendonly) {
+        db.load_from_file();
+        return true;
+    }
+
+    AOFManifest manifest;
+    std::string error;
+    if (!Persistence::find_aof(db, manifest, error)) {
+        std::cerr << error << "\n";
+        return false;
+    }
+    if (manifest.empty()) {
+        db.load_from_file();
+        std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+        std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+        return Persistence::start_aof(db);
+    }
+
+    // Replayed commands run as a client of their own, marked as in a
+    // transaction so that nothing blocks.
+    auto replay_client = std::make_shared<Client>(-1, db);
+    replay_client->in_multi = true;
+    AOFLoader loader(db);
+    bool ok = loader.load(Persistence::aof_paths(db, manifest), [&](const std::vector<std::string>& args) {
+        std::string reply = Dispatcher::execute_command(db, replay_client, args);
+        replay_client->clear_propagation();
+        return reply;
+    }, error);
+    if (!ok) {
+        std::cerr << "Failed to load the AOF: " << error << "\n";
+        return false;
+    }
+    db.dirty = 0;
+    return Persistence::resume_aof(db, manifest);
+}
+
+// Background housekeeping that isn't tied to any client.
+void Server::cron() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Persistence::cron(db);
+    }
+}
+
 void Server::connect_to_master() {
+    std::thread(&Server::replication_loop, this).detach();
+}
+
+// Keeps the link to the master up until this server is promoted. Once a
+// full sync has given us the master's history, reconnects ask to continue
+// from the offset already applied instead of starting over.
+void Server::replication_loop() {
+    while (true) {
+        int master_fd = open_master_link();
+        if (master_fd >= 0) {
+            {
+                std::lock_guard<std::mutex> lock(db.replication_mutex);
+                if (db.config.role != "slave") {
+                    close(master_fd);
+                    return;
+                }
+                db.master_link_fd = master_fd;
+            }
+            handle_replication_stream(master_fd);
+            {
+                std::lock_guard<std::mutex> lock(db.replication_mutex);
+                db.master_link_fd = -1;
+                db.master_link_up = false;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(db.replication_mutex);
+            if (db.config.role != "slave") return;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+// Connects and runs the handshake up to and including PSYNC. Returns the
+// socket, or -1 if any step failed.
+int Server::open_master_link() {
     int master_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (master_fd < 0) {
         std::cerr << "Failed to create master socket\n";
-        return;
+        return -1;
     }
 
     struct hostent *server = gethostbyname(db.config.master_host.c_str());
     if (server == NULL) {
         std::cerr << "No such host: " << db.config.master_host << "\n";
-        return;
+        close(master_fd);
+        return -1;
     }
 
     struct sockaddr_in serv_addr;
@@ -90,131 +184,230 @@ void Server::connect_to_master() {
 
     if (connect(master_fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
         std::cerr << "Error connecting to master\n";
-        return;
+        close(master_fd);
+        return -1;
     }
 
     char buffer[1024];
-    int n;
 
     std::string ping_cmd = "*1\r\n$4\r\nPING\r\n";
     send(master_fd, ping_cmd.c_str(), ping_cmd.length(), 0);
 
-    n = recv(master_fd, buffer, sizeof(buffer), 0);
-    if (n <= 0) return;
+    if (recv(master_fd, buffer, sizeof(buffer), 0) <= 0) {
+        close(master_fd);
+        return -1;
+    }
 
     std::string port_str = std::to_string(db.config.port);
     std::string replconf_port = "*3\r\n$8\r\nREPLCONF\r\n$14\r\nlistening-port\r\n$" + 
                                 std::to_string(port_str.length()) + "\r\n" + port_str + "\r\n";
     send(master_fd, replconf_port.c_str(), replconf_port.length(), 0);
 
-    n = recv(master_fd, buffer, sizeof(buffer), 0);
-    if (n <= 0) return;
+    if (recv(master_fd, buffer, sizeof(buffer), 0) <= 0) {
+        close(master_fd);
+        return -1;
+    }
 
-    std::string replconf_capa = "*3\r\n$8\r\nREPLCONF\r\n$4\r\ncapa\r\n$6\r\npsync2\r\n";
+    std::string replconf_capa = "*5\r\n$8\r\nREPLCONF\r\n$4\r\ncapa\r\n$3\r\neof\r\n$4\r\ncapa\r\n$6\r\npsync2\r\n";
     send(master_fd, replconf_capa.c_str(), replconf_capa.length(), 0);
 
-    n = recv(master_fd, buffer, sizeof(buffer), 0);
-    if (n <= 0) return;
+    if (recv(master_fd, buffer, sizeof(buffer), 0) <= 0) {
+        close(master_fd);
+        return -1;
+    }
 
-    std::string psync_cmd = "*3\r\n$5\r\nPSYNC\r\n$1\r\n?\r\n$2\r\n-1\r\n";
+    std::string replid = "?";
+    std::string offset = "-1";
+    if (have_master_history) {
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        replid = db.config.master_replid;
+        offset = std::to_string(db.bytes_processed + 1);
+    }
+    std::string psync_cmd = "*3\r\n$5\r\nPSYNC\r\n$" + std::to_string(replid.length()) + "\r\n" + replid + "\r\n$" +
+                            std::to_string(offset.length()) + "\r\n" + offset + "\r\n";
     send(master_fd, psync_cmd.c_str(), psync_cmd.length(), 0);
 
-    std::thread(&Server::handle_replication_stream, this, master_fd).detach();
+    return master_fd;
 }
 
 void Server::handle_replication_stream(int master_fd) {
     auto master_client = std::make_shared<Client>(master_fd, this->db);
     master_client->is_authenticated = true;
+    master_client->is_master = true;
 
     std::string buffer;
-    char chunk[1024];
-    bool rdb_processed = false;
+    char chunk[16 * 1024];
 
-    while (true) {
+    auto receive = [&]() {
         ssize_t bytes_read = recv(master_fd, chunk, sizeof(chunk), 0);
-        if (bytes_read <= 0) break;
-        
+        if (bytes_read <= 0) return false;
         buffer.append(chunk, bytes_read);
+        return true;
+    };
+    auto read_line = [&](std::string& line) {
+        size_t line_end;
+        while ((line_end = buffer.find("\r\n")) == std::string::npos) {
+            if (!receive()) return false;
+        }
+        line = buffer.substr(0, line_end);
+        buffer.erase(0, line_end + 2);
+        return true;
+    };
 
-        if (!rdb_processed) {
-            size_t newline_pos = buffer.find("\r\n");
-            if (newline_pos != std::string::npos) {
-                std::string line = buffer.substr(0, newline_pos);
-                if (line.find("FULLRESYNC") != std::string::npos) {
-                    buffer.erase(0, newline_pos + 2);
-                }
+    std::string reply_line;
+    if (!read_line(reply_line)) return;
+
+    std::istringstream reply(reply_line);
+    std::string status, replid, offset;
+    reply >> status >> replid >> offset;
+
+    if (status == "+FULLRESYNC") {
+        // A diskless master does not know the size upfront and sends
+        // "$EOF:<40-byte mark>" instead, repeating the mark after the payload.
+        std::string bulk_header;
+        std::string eof_mark;
+        uint64_t rdb_len = 0;
+        try {
+            if (!read_line(bulk_header) || bulk_header.empty() || bulk_header[0] != '$') throw std::runtime_error("missing payload");
+            if (bulk_header.compare(0, 5, "$EOF:") == 0) {
+                eof_mark = bulk_header.substr(5);
+                if (eof_mark.size() != 40) throw std::runtime_error("bad EOF mark");
+            } else {
+                rdb_len = std::stoull(bulk_header.substr(1));
             }
+        } catch (const std::exception& e) {
+            std::cerr << "Bad full resync payload from master\n";
+            return;
+        }
 
-            if (!buffer.empty() && buffer[0] == '$') {
-                size_t len_end = buffer.find("\r\n");
-                if (len_end != std::string::npos) {
-                    try {
-                        std::string len_str = buffer.substr(1, len_end - 1);
-                        size_t rdb_len = std::stoul(len_str);
-                        size_t rdb_total_size = (len_end + 2) + rdb_len;
-                        
-                        if (buffer.size() >= rdb_total_size) {
-                            buffer.erase(0, rdb_total_size);
-                            rdb_processed = true;
-                        } else {
-                            continue;
-                        }
-                    } catch (...) {
-                         buffer.clear();
-                    }
-                } else {
-                    continue; 
+        // The snapshot is parsed as it arrives into a separate keyspace, and
+        // clients keep reading the old data until it is swapped in whole.
+        std::unordered_map<std::string, Entry> loaded;
+        try {
+            RDBLoader loader(db);
+            if (eof_mark.empty()) loader.load_stream(master_fd, buffer, rdb_len, loaded);
+            else loader.load_stream_until_mark(master_fd, buffer, eof_mark, loaded);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load snapshot from master: " << e.what() << "\n";
+            return;
+        }
+        long long sync_offset = 0;
+        try {
+            sync_offset = std::stoll(offset);
+        } catch (...) {}
+
+        // Swapped in under propagation_mutex, so a sub-replica's full sync
+        // snapshots either the old dataset with the old offset or the new
+        // one with the new offset.
+        {
+            std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+            {
+                std::lock_guard<std::recursive_mutex> kv_lock(db.kv_mutex);
+                db.kv_store.swap(loaded);
+                db.touch_all_watched_keys();
+
+                // The old AOF describes the dataset we just dropped; it is
+                // replaced once a rewrite has written the new one as a base.
+                if (db.aof.enabled() && !Persistence::start_aof(db)) {
+                    std::cerr << "Failed to restart the AOF after a full sync\n";
                 }
             }
+
+            // We now follow the master's history from its offset. Our own
+            // sub-replicas were on another history and must resync.
+            std::lock_guard<std::mutex> lock(db.replication_mutex);
+            db.config.master_replid = replid;
+            db.config.master_replid2 = std::string(40, '0');
+            db.config.second_repl_offset = -1;
+            db.config.master_repl_offset = sync_offset;
+            db.bytes_processed = sync_offset;
+            db.getack_offset = -1;
+            if (db.repl_backlog) {
+                db.repl_backlog = std::make_unique<ReplicationBacklog>(db.config.repl_backlog_size, sync_offset);
+            }
+            db.disconnect_replicas();
+            db.master_link_up = true;
+            have_master_history = true;
         }
+        loaded.clear(); // the old dataset, freed outside kv_mutex
+    } else if (status == "+CONTINUE") {
+        // The master may have been promoted since we last saw it; its
+        // new ID takes over and ours becomes the previous history.
+        // Sub-replicas are dropped so they pick up the new ID too; they can
+        // still continue through replid2.
+        std::lock_guard<std::mutex> lock(db.replication_mutex);
+        if (!replid.empty() && replid != db.config.master_replid) {
+            db.config.master_replid2 = db.config.master_replid;
+            db.config.second_repl_offset = db.bytes_processed + 1;
+            db.config.master_replid = replid;
+            db.disconnect_replicas();
+        }
+        db.master_link_up = true;
+    } else {
+        std::cerr << "Unexpected reply to PSYNC: " << status << "\n";
+        return;
+    }
 
-        if (rdb_processed) {
+    long long last_ack = 0;
+    std::vector<std::string> args;
+
+    while (true) {
+        // Apply every complete command received so far, then forward exactly
+        // those bytes to our own sub-replicas and drop them from the buffer,
+        // so offsets match along the whole chain. Applying and forwarding
+        // happen under propagation_mutex like any write on a master.
+        size_t processed_bytes = 0;
+        {
+            std::lock_guard<std::mutex> propagation_lock(db.propagation_mutex);
+            {
+                // Promoted by REPLICAOF NO ONE: nothing more from the old master.
+                std::lock_guard<std::mutex> lock(db.replication_mutex);
+                if (db.config.role != "slave") break;
+            }
+            std::string aof_batch;
             while (true) {
-                if (buffer.empty() || buffer[0] != '*') break;
-
-                size_t line_end = buffer.find("\r\n");
-                if (line_end == std::string::npos) break; 
-
-                try {
-                    int num_args = std::stoi(buffer.substr(1, line_end - 1));
-                    size_t current_pos = line_end + 2;
-                    std::vector<std::string> args;
-                    bool complete_command = true;
-
-                    for (int i = 0; i < num_args; ++i) {
-                        if (current_pos >= buffer.size()) { complete_command = false; break; }
-                        if (buffer[current_pos] != '$') { complete_command = false; break; }
-                        
-                        size_t len_end = buffer.find("\r\n", current_pos);
-                        if (len_end == std::string::npos) { complete_command = false; break; }
-
-                        int arg_len = std::stoi(buffer.substr(current_pos + 1, len_end - (current_pos + 1)));
-                        size_t arg_start = len_end + 2;
-                        
-                        if (buffer.size() < arg_start + arg_len + 2) { complete_command = false; break; }
-
-                        args.push_back(buffer.substr(arg_start, arg_len));
-                        current_pos = arg_start + arg_len + 2; 
-                    }
-
-                    if (complete_command) {
-                        std::string response = Dispatcher::dispatch(db, master_client, args);
-                        
-                        if (args.size() > 1 && to_upper(args[0]) == "REPLCONF" && to_upper(args[1]) == "GETACK") {
-                             send(master_fd, response.c_str(), response.length(), 0);
-                        }
-
-                        db.bytes_processed += current_pos;
-
-                        buffer.erase(0, current_pos);
-                    } else {
-                        break; 
-                    }
-                } catch (...) {
-                    break; 
+                size_t command_size = Parser::parse_resp_array(buffer, processed_bytes, args);
+                if (command_size == 0) break;
+
+                // The AOF logs what we apply, transactions included; PINGs
+                // and GETACKs only matter to the link.
+                std::string command = to_upper(args[0]);
+                if (Dispatcher::is_write_command(args) || command == "MULTI" || command == "EXEC") {
+                    aof_batch.append(buffer, processed_bytes, command_size);
                 }
+
+                std::string response = Dispatcher::dispatch(db, master_client, args);
+                if (args.size() > 1 && to_upper(args[0]) == "REPLCONF" && to_upper(args[1]) == "GETACK") {
+                    send(master_fd, response.c_str(), response.length(), MSG_NOSIGNAL);
+                }
+
+                db.bytes_processed += command_size;
+                processed_bytes += command_size;
             }
+
+            if (processed_bytes > 0) {
+                std::lock_guard<std::mutex> lock(db.replication_mutex);
+                if (!aof_batch.empty()) db.aof.feed(aof_batch);
+                db.feed_replicas(std::make_shared<const std::string>(buffer, 0, processed_bytes));
+            }
+        }
+        buffer.erase(0, processed_bytes);
+
+        // Acknowledge our offset every second so the master can report lag
+        // without asking.
+        if (current_time_ms() - last_ack >= 1000) {
+            std::string offset_str = std::to_string(db.bytes_processed);
+            std::string ack = "*3\r\n$8\r\nREPLCONF\r\n$3\r\nACK\r\n$" + std::to_string(offset_str.length()) + "\r\n" + offset_str + "\r\n";
+            send(master_fd, ack.c_str(), ack.length(), MSG_NOSIGNAL);
+            last_ack = current_time_ms();
         }
+
+        pollfd pfd = {master_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+
+        if (!receive()) break;
     }
-    close(master_fd);
-}
\ No newline at end of file
+    // master_client owns master_fd and closes it.
+}
@@ -7,6 +7,12 @@ public:
     void run(int port);
     
 private:
+    bool have_master_history = false; // set by the first full sync
+
+    bool load_data();
+    void cron();
     void connect_to_master();
+    void replication_loop();
+    int open_master_link();
     void handle_replication_stream(int master_fd);
 };
\ No newline at end of file
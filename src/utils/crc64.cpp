@@ -0,0 +1,74 @@
+#include "crc64.hpp"
+#include <array>
+
+namespace {
+
+// Bit-reversed form of the Jones polynomial 0xad93d23594c935a9.
+const uint64_t POLY_REFLECTED = 0x95ac9329ac4bc9b5ULL;
+
+std::array<uint64_t, 256> make_table() {
+    std::array<uint64_t, 256> table{};
+    for (uint64_t i = 0; i < 256; ++i) {
+        uint64_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ POLY_REFLECTED : (crc >> 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+// The combine step appends len_b zero bytes to A's CRC by repeated squaring
+// of the one-zero-bit operator, as zlib's crc32_combine does.
+uint64_t gf2_times(const uint64_t* mat, uint64_t vec) {
+    uint64_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+void gf2_square(uint64_t* square, const uint64_t* mat) {
+    for (int n = 0; n < 64; ++n) square[n] = gf2_times(mat, mat[n]);
+}
+
+}
+
+uint64_t CRC64::update(uint64_t crc, const void* data, size_t len) {
+    static const std::array<uint64_t, 256> table = make_table();
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+uint64_t CRC64::combine(uint64_t crc_a, uint64_t crc_b, size_t len_b) {
+    if (len_b == 0) return crc_a;
+
+    uint64_t even[64];
+    uint64_t odd[64];
+    odd[0] = POLY_REFLECTED;
+    uint64_t row = 1;
+    for (int n = 1; n < 64; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2_square(even, odd); // two zero bits
+    gf2_square(odd, even); // four zero bits
+
+    do {
+        gf2_square(even, odd);
+        if (len_b & 1) crc_a = gf2_times(even, crc_a);
+        len_b >>= 1;
+        if (len_b == 0) break;
+        gf2_square(odd, even);
+        if (len_b & 1) crc_a = gf2_times(odd, crc_a);
+        len_b >>= 1;
+    } while (len_b);
+
+    return crc_a ^ crc_b;
+}
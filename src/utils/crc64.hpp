@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// CRC-64/Jones as used by Redis for RDB checksums (reflected, init 0).
+class CRC64 {
+public:
+    static uint64_t update(uint64_t crc, const void* data, size_t len);
+
+    // CRC of A followed by B, given crc_a = CRC of A, crc_b = CRC of B and
+    // len_b. Lets the CRC of a large buffer be computed in pieces.
+    static uint64_t combine(uint64_t crc_a, uint64_t crc_b, size_t len_b);
+};
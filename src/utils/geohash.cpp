@@ -2,14 +2,6 @@
 #include <algorithm>
 #include <cmath>
 
-// Redis Geohash Limits
-const double GEO_LAT_MIN = -85.05112878;
-const double GEO_LAT_MAX = 85.05112878;
-const double GEO_LONG_MIN = -180.0;
-const double GEO_LONG_MAX = 180.0;
-
-// Earth Radius in meters (specified by instructions)
-const double EARTH_RADIUS_M = 6372797.560856;
 const double PI = 3.14159265358979323846;
 
 // Spread bits: xxxxxxxx -> x0x0x0x0x0x0x0x0
@@ -92,13 +84,98 @@ double GeoHash::distance(double lat1, double lon1, double lat2, double lon2) {
     double r_lat2 = lat2 * (PI / 180.0);
     double r_lon2 = lon2 * (PI / 180.0);
 
-    double d_lat = r_lat2 - r_lat1;
-    double d_lon = r_lon2 - r_lon1;
+    double u = std::sin((r_lat2 - r_lat1) / 2);
+    double v = std::sin((r_lon2 - r_lon1) / 2);
+    double a = std::min(1.0, u * u + std::cos(r_lat1) * std::cos(r_lat2) * v * v);
 
-    double a = std::pow(std::sin(d_lat / 2), 2) +
-               std::cos(r_lat1) * std::cos(r_lat2) * std::pow(std::sin(d_lon / 2), 2);
-    
-    double c = 2 * std::atan2(std::sqrt(a), std::sqrt(1 - a));
-    
-    return EARTH_RADIUS_M * c;
-}
\ No newline at end of file
+    return 2.0 * EARTH_RADIUS_M * std::asin(std::sqrt(a));
+}
+
+// Picks the finest step whose cells are at least as large as the search area's
+// half-extent, so the center cell plus its 8 neighbours always cover the area.
+std::vector<std::pair<double, double>> GeoHash::area_ranges(double latitude, double longitude,
+                                                            double lat_delta, double long_delta) {
+    const double full_range = static_cast<double>(1ULL << 52);
+
+    if (lat_delta >= (GEO_LAT_MAX - GEO_LAT_MIN) / 2 || long_delta >= (GEO_LONG_MAX - GEO_LONG_MIN) / 2) {
+        return {{0.0, full_range}};
+    }
+
+    int step = 26;
+    while (step > 0) {
+        double lat_cell = (GEO_LAT_MAX - GEO_LAT_MIN) / (1ULL << step);
+        double long_cell = (GEO_LONG_MAX - GEO_LONG_MIN) / (1ULL << step);
+        if (lat_cell >= lat_delta && long_cell >= long_delta) break;
+        step--;
+    }
+    if (step == 0) return {{0.0, full_range}};
+
+    latitude = std::clamp(latitude, GEO_LAT_MIN, GEO_LAT_MAX);
+    longitude = std::clamp(longitude, GEO_LONG_MIN, GEO_LONG_MAX);
+
+    const int64_t cells = 1LL << step;
+    int64_t lat_idx = static_cast<int64_t>((latitude - GEO_LAT_MIN) / (GEO_LAT_MAX - GEO_LAT_MIN) * cells);
+    int64_t long_idx = static_cast<int64_t>((longitude - GEO_LONG_MIN) / (GEO_LONG_MAX - GEO_LONG_MIN) * cells);
+    lat_idx = std::min(lat_idx, cells - 1);
+    long_idx = std::min(long_idx, cells - 1);
+
+    const int shift = 52 - 2 * step;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+    for (int dlat = -1; dlat <= 1; ++dlat) {
+        int64_t lat_cell = lat_idx + dlat;
+        if (lat_cell < 0 || lat_cell >= cells) continue;
+
+        for (int dlong = -1; dlong <= 1; ++dlong) {
+            // Longitude wraps around the antimeridian.
+            int64_t long_cell = (long_idx + dlong + cells) % cells;
+            uint64_t hash = interleave64(static_cast<uint32_t>(lat_cell), static_cast<uint32_t>(long_cell));
+            ranges.push_back({hash << shift, (hash + 1) << shift});
+        }
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+
+    std::vector<std::pair<double, double>> merged;
+    for (const auto& r : ranges) {
+        if (!merged.empty() && static_cast<double>(r.first) <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, static_cast<double>(r.second));
+        } else {
+            merged.push_back({static_cast<double>(r.first), static_cast<double>(r.second)});
+        }
+    }
+    return merged;
+}
+
+std::vector<std::pair<double, double>> GeoHash::radius_ranges(double latitude, double longitude, double radius_m) {
+    double angular = radius_m / EARTH_RADIUS_M;
+    double lat_delta = angular * (180.0 / PI);
+
+    // Widest longitude extent of a spherical cap centered at this latitude.
+    double ratio = std::sin(std::min(angular, PI / 2)) / std::cos(latitude * (PI / 180.0));
+    double long_delta = (ratio >= 1.0) ? GEO_LONG_MAX : std::asin(ratio) * (180.0 / PI);
+
+    return area_ranges(latitude, longitude, lat_delta, long_delta);
+}
+
+std::vector<std::pair<double, double>> GeoHash::box_ranges(double latitude, double longitude,
+                                                           double width_m, double height_m) {
+    double lat_delta = (height_m / 2) / EARTH_RADIUS_M * (180.0 / PI);
+
+    // The box is measured along each point's own parallel, so the longitude
+    // extent is widest at the edge of the box nearest a pole.
+    double widest_lat = std::min(std::fabs(latitude) + lat_delta, 90.0);
+    double ratio = std::sin(std::min(width_m / (4 * EARTH_RADIUS_M), PI / 2)) / std::cos(widest_lat * (PI / 180.0));
+    double long_delta = (ratio >= 1.0) ? GEO_LONG_MAX : 2 * std::asin(ratio) * (180.0 / PI);
+
+    return area_ranges(latitude, longitude, lat_delta, long_delta);
+}
+
+bool GeoHash::within_box(double center_lat, double center_lon, double lat, double lon,
+                         double width_m, double height_m) {
+    double lat_distance = EARTH_RADIUS_M * std::fabs((lat - center_lat) * (PI / 180.0));
+    if (lat_distance > height_m / 2) return false;
+
+    double long_distance = distance(lat, center_lon, lat, lon);
+    return long_distance <= width_m / 2;
+}
@@ -1,6 +1,17 @@
 #pragma once
 #include <cstdint>
 #include <utility>
+#include <vector>
+#include <cstddef>
+
+// Redis Geohash Limits
+const double GEO_LAT_MIN = -85.05112878;
+const double GEO_LAT_MAX = 85.05112878;
+const double GEO_LONG_MIN = -180.0;
+const double GEO_LONG_MAX = 180.0;
+
+// Earth Radius in meters (specified by instructions)
+const double EARTH_RADIUS_M = 6372797.560856;
 
 class GeoHash {
 public:
@@ -8,7 +19,25 @@ public:
     static std::pair<double, double> decode(double score);
     static double distance(double lat1, double lon1, double lat2, double lon2);
 
+    // Decodes n scores and computes each point's distance in meters from
+    // (latitude, longitude). Uses AVX2 when the CPU supports it.
+    static void distance_batch(double latitude, double longitude, const double* scores, size_t n,
+                               double* lats, double* lons, double* dists);
+    static void distance_batch_scalar(double latitude, double longitude, const double* scores, size_t n,
+                                      double* lats, double* lons, double* dists);
+    static const char* batch_kernel_name();
+
+    // Score ranges [first, second) of the geohash cells covering a circle
+    // around the given center. Candidates still need an exact distance check.
+    static std::vector<std::pair<double, double>> radius_ranges(double latitude, double longitude, double radius_m);
+    static std::vector<std::pair<double, double>> box_ranges(double latitude, double longitude,
+                                                             double width_m, double height_m);
+    static bool within_box(double center_lat, double center_lon, double lat, double lon,
+                           double width_m, double height_m);
+
 private:
     static uint64_t interleave64(uint32_t xlo, uint32_t ylo);
     static uint64_t deinterleave64(uint64_t interleaved);
+    static std::vector<std::pair<double, double>> area_ranges(double latitude, double longitude,
+                                                              double lat_delta, double long_delta);
 };
\ No newline at end of file
@@ -0,0 +1,188 @@
+#include "geohash.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEOHASH_HAVE_AVX2 1
+// The helpers below are inlined even in unoptimised builds; as calls they pass
+// every vector through memory and the AVX2 path ends up slower than scalar.
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX2_INLINE __attribute__((target("avx2"), always_inline)) inline
+#endif
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+const double DEG_TO_RAD = PI / 180.0;
+const double LAT_STEP = (GEO_LAT_MAX - GEO_LAT_MIN) / (1ULL << 26);
+const double LONG_STEP = (GEO_LONG_MAX - GEO_LONG_MIN) / (1ULL << 26);
+
+#ifdef GEOHASH_HAVE_AVX2
+
+// Polynomial coefficients from fdlibm (__kernel_sin, __kernel_cos, asin).
+const double SIN_COEFFS[] = {-1.66666666666666324348e-01, 8.33333333332248946124e-03,
+                             -1.98412698298579493134e-04, 2.75573137070700676789e-06,
+                             -2.50507602534068634195e-08, 1.58969099521155010221e-10};
+const double COS_COEFFS[] = {4.16666666666666019037e-02, -1.38888888888741095749e-03,
+                             2.48015872894767294178e-05, -2.75573143513906633035e-07,
+                             2.08757232129817482790e-09, -1.13596475577881948265e-11};
+const double ASIN_P[] = {1.66666666666666657415e-01, -3.25565818622400915405e-01,
+                         2.01212532134862925881e-01, -4.00555345006794114027e-02,
+                         7.91534994289814532176e-04, 3.47933107596021167570e-05};
+const double ASIN_Q[] = {1.0, -2.40339491173441421878e+00, 2.02094576023350569471e+00,
+                         -6.88283971605453293030e-01, 7.70381505559019352791e-02};
+const double PIO2_1 = 1.57079632673412561417e+00, PIO2_1T = 6.07710050650619224932e-11;
+
+AVX2_INLINE __m256d set(double v) { return _mm256_set1_pd(v); }
+AVX2_INLINE __m256d add(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+AVX2_INLINE __m256d sub(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+AVX2_INLINE __m256d mul(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+
+// c[0] + z * (c[1] + z * (... + z * c[n - 1]))
+template <size_t N>
+AVX2_INLINE __m256d horner(__m256d z, const double (&c)[N]) {
+    __m256d r = set(c[N - 1]);
+    for (size_t i = N - 1; i-- > 0;) r = add(set(c[i]), mul(z, r));
+    return r;
+}
+
+// Compact bits: x0x0x0x0 -> xxxxxxxx, four lanes at a time.
+AVX2_INLINE __m256i deinterleave(__m256i x) {
+    x = _mm256_and_si256(x, _mm256_set1_epi64x(0x5555555555555555LL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 1)), _mm256_set1_epi64x(0x3333333333333333LL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 2)), _mm256_set1_epi64x(0x0F0F0F0F0F0F0F0FLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 4)), _mm256_set1_epi64x(0x00FF00FF00FF00FFLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 8)), _mm256_set1_epi64x(0x0000FFFF0000FFFFLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 16)), _mm256_set1_epi64x(0x00000000FFFFFFFFLL));
+    return x;
+}
+
+// AVX2 has no 64-bit int <-> double conversion; values below 2^52 can be moved
+// in and out of the mantissa of 2^52 instead.
+AVX2_INLINE __m256i to_u64(__m256d v) {
+    __m256d shifted = add(_mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), set(4503599627370496.0));
+    return _mm256_and_si256(_mm256_castpd_si256(shifted), _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL));
+}
+
+AVX2_INLINE __m256d to_double(__m256i v) {
+    __m256i biased = _mm256_or_si256(v, _mm256_castpd_si256(set(4503599627370496.0)));
+    return sub(_mm256_castsi256_pd(biased), set(4503599627370496.0));
+}
+
+AVX2_INLINE __m256d kernel_sin(__m256d x) {
+    __m256d z = mul(x, x);
+    return add(x, mul(mul(z, x), horner(z, SIN_COEFFS)));
+}
+
+AVX2_INLINE __m256d kernel_cos(__m256d x) {
+    __m256d z = mul(x, x);
+    __m256d r = mul(mul(z, z), horner(z, COS_COEFFS));
+    return sub(set(1.0), sub(mul(set(0.5), z), r));
+}
+
+// Reduces x to y in [-pi/4, pi/4]; odd is set for lanes in quadrants 1 and 3,
+// where sin and cos swap roles. Only valid for the small |x| seen here.
+AVX2_INLINE void reduce(__m256d x, __m256d& y, __m256d& odd) {
+    __m256d n = _mm256_round_pd(mul(x, set(2.0 / PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    y = sub(sub(x, mul(n, set(PIO2_1))), mul(n, set(PIO2_1T)));
+    __m256d half = mul(n, set(0.5));
+    odd = _mm256_cmp_pd(sub(half, _mm256_floor_pd(half)), _mm256_setzero_pd(), _CMP_NEQ_OQ);
+}
+
+AVX2_INLINE __m256d sin_squared(__m256d x) {
+    __m256d y, odd;
+    reduce(x, y, odd);
+    __m256d s = _mm256_blendv_pd(kernel_sin(y), kernel_cos(y), odd);
+    return mul(s, s);
+}
+
+// cos(x) for |x| < pi/2, where the result is never negative.
+AVX2_INLINE __m256d cos_positive(__m256d x) {
+    __m256d y, odd;
+    reduce(x, y, odd);
+    __m256d c = _mm256_blendv_pd(kernel_cos(y), kernel_sin(y), odd);
+    return _mm256_andnot_pd(set(-0.0), c);
+}
+
+// asin(x) for x in [0, 1].
+AVX2_INLINE __m256d asin_unit(__m256d x) {
+    __m256d big = _mm256_cmp_pd(x, set(0.5), _CMP_GE_OQ);
+    __m256d t = _mm256_blendv_pd(mul(x, x), mul(sub(set(1.0), x), set(0.5)), big);
+
+    __m256d p = mul(t, horner(t, ASIN_P));
+    __m256d q = horner(t, ASIN_Q);
+    __m256d w = _mm256_div_pd(p, q);
+
+    __m256d s = _mm256_blendv_pd(x, _mm256_sqrt_pd(t), big);
+    __m256d r = add(s, mul(s, w));
+    return _mm256_blendv_pd(r, sub(set(PI / 2), add(r, r)), big);
+}
+
+#endif
+
+}
+
+void GeoHash::distance_batch_scalar(double latitude, double longitude, const double* scores, size_t n,
+                                    double* lats, double* lons, double* dists) {
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t hash = static_cast<uint64_t>(scores[i]);
+        lats[i] = GEO_LAT_MIN + (deinterleave64(hash) * LAT_STEP) + (LAT_STEP / 2);
+        lons[i] = GEO_LONG_MIN + (deinterleave64(hash >> 1) * LONG_STEP) + (LONG_STEP / 2);
+        dists[i] = distance(latitude, longitude, lats[i], lons[i]);
+    }
+}
+
+#ifdef GEOHASH_HAVE_AVX2
+AVX2_TARGET static void distance_batch_avx2(double latitude, double longitude, const double* scores, size_t n,
+                                            double* lats, double* lons, double* dists, size_t& done) {
+    const __m256d r_lat1 = set(latitude * DEG_TO_RAD);
+    const __m256d r_lon1 = set(longitude * DEG_TO_RAD);
+    const __m256d cos_lat1 = set(std::cos(latitude * DEG_TO_RAD));
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i hash = to_u64(_mm256_loadu_pd(scores + i));
+        __m256d lat_bits = to_double(deinterleave(hash));
+        __m256d long_bits = to_double(deinterleave(_mm256_srli_epi64(hash, 1)));
+
+        __m256d lat = add(add(set(GEO_LAT_MIN), mul(lat_bits, set(LAT_STEP))), set(LAT_STEP / 2));
+        __m256d lon = add(add(set(GEO_LONG_MIN), mul(long_bits, set(LONG_STEP))), set(LONG_STEP / 2));
+        _mm256_storeu_pd(lats + i, lat);
+        _mm256_storeu_pd(lons + i, lon);
+
+        __m256d r_lat2 = mul(lat, set(DEG_TO_RAD));
+        __m256d r_lon2 = mul(lon, set(DEG_TO_RAD));
+        __m256d u2 = sin_squared(mul(sub(r_lat2, r_lat1), set(0.5)));
+        __m256d v2 = sin_squared(mul(sub(r_lon2, r_lon1), set(0.5)));
+        __m256d a = add(u2, mul(mul(cos_lat1, cos_positive(r_lat2)), v2));
+        a = _mm256_min_pd(a, set(1.0));
+
+        _mm256_storeu_pd(dists + i, mul(set(2.0 * EARTH_RADIUS_M), asin_unit(_mm256_sqrt_pd(a))));
+    }
+    done = i;
+}
+
+static bool cpu_has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#endif
+
+void GeoHash::distance_batch(double latitude, double longitude, const double* scores, size_t n,
+                             double* lats, double* lons, double* dists) {
+    size_t done = 0;
+#ifdef GEOHASH_HAVE_AVX2
+    if (cpu_has_avx2()) {
+        distance_batch_avx2(latitude, longitude, scores, n, lats, lons, dists, done);
+    }
+#endif
+    distance_batch_scalar(latitude, longitude, scores + done, n - done, lats + done, lons + done, dists + done);
+}
+
+const char* GeoHash::batch_kernel_name() {
+#ifdef GEOHASH_HAVE_AVX2
+    if (cpu_has_avx2()) return "avx2";
+#endif
+    return "scalar";
+}
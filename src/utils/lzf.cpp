@@ -0,0 +1,38 @@
+#include "lzf.hpp"
+
+bool LZF::decompress(const void* in, size_t in_len, void* out, size_t out_len) {
+    const unsigned char* ip = static_cast<const unsigned char*>(in);
+    const unsigned char* in_end = ip + in_len;
+    unsigned char* start = static_cast<unsigned char*>(out);
+    unsigned char* op = start;
+    unsigned char* out_end = op + out_len;
+
+    while (ip < in_end) {
+        unsigned int ctrl = *ip++;
+
+        if (ctrl < 32) {
+            // Literal run of ctrl + 1 bytes.
+            size_t len = ctrl + 1;
+            if (ip + len > in_end || op + len > out_end) return false;
+            for (size_t i = 0; i < len; ++i) *op++ = *ip++;
+            continue;
+        }
+
+        // Back reference: 3 bits of length, 13 bits of distance.
+        size_t len = ctrl >> 5;
+        size_t distance = (ctrl & 0x1f) << 8;
+        if (len == 7) {
+            if (ip >= in_end) return false;
+            len += *ip++;
+        }
+        if (ip >= in_end) return false;
+        distance += *ip++;
+        len += 2;
+
+        if (distance + 1 > static_cast<size_t>(op - start) || op + len > out_end) return false;
+        // Byte by byte: the source may overlap what is being written.
+        const unsigned char* ref = op - distance - 1;
+        for (size_t i = 0; i < len; ++i) *op++ = *ref++;
+    }
+    return op == out_end;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+// LZF decompression, for strings Redis compresses in RDB files.
+class LZF {
+public:
+    // Decompresses in_len bytes into exactly out_len bytes. Returns false if
+    // the input is corrupt or doesn't expand to out_len bytes.
+    static bool decompress(const void* in, size_t in_len, void* out, size_t out_len);
+};
@@ -2,6 +2,8 @@
 #include <chrono>
 #include <algorithm>
 #include <cstdlib>
+#include <random>
+#include <cstdint>
 
 long long current_time_ms() {
     using namespace std::chrono;
@@ -13,6 +15,11 @@ std::string to_upper(std::string str) {
     return str;
 }
 
+std::string to_lower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
 std::string hex_to_bytes(const std::string& hex) {
     std::string bytes;
     for (unsigned int i = 0; i < hex.length(); i += 2) {
@@ -21,4 +28,80 @@ std::string hex_to_bytes(const std::string& hex) {
         bytes.push_back(byte);
     }
     return bytes;
-}
\ No newline at end of file
+}
+
+std::string random_hex(size_t len) {
+    static const char HEX[] = "0123456789abcdef";
+    std::random_device rd;
+    std::mt19937_64 gen((static_cast<uint64_t>(rd()) << 32) ^ rd() ^ static_cast<uint64_t>(current_time_ms()));
+
+    std::string out(len, '0');
+    for (char& c : out) c = HEX[gen() & 0xF];
+    return out;
+}
+
+// Matches the single-character token at pattern[pi] (a literal, '?', an
+// escape or a [...] class) against c, and stores where the next token starts.
+static bool match_token(std::string_view pattern, size_t pi, char c, size_t& next) {
+    if (pattern[pi] == '?') {
+        next = pi + 1;
+        return true;
+    }
+    if (pattern[pi] == '\\' && pi + 1 < pattern.size()) {
+        next = pi + 2;
+        return pattern[pi + 1] == c;
+    }
+    if (pattern[pi] != '[') {
+        next = pi + 1;
+        return pattern[pi] == c;
+    }
+
+    size_t i = pi + 1;
+    bool negate = (i < pattern.size() && pattern[i] == '^');
+    if (negate) i++;
+
+    bool matched = false;
+    while (i < pattern.size() && pattern[i] != ']') {
+        if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+            matched |= (pattern[i + 1] == c);
+            i += 2;
+        } else if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            char lo = std::min(pattern[i], pattern[i + 2]);
+            char hi = std::max(pattern[i], pattern[i + 2]);
+            matched |= (c >= lo && c <= hi);
+            i += 3;
+        } else {
+            matched |= (pattern[i] == c);
+            i++;
+        }
+    }
+    next = (i < pattern.size()) ? i + 1 : i;
+    return matched != negate;
+}
+
+// Glob-style matching with the same syntax as Redis' stringmatchlen: '*',
+// '?', '[...]' classes (with '^' and ranges) and backslash escapes. Every token
+// other than '*' consumes exactly one character, so backtracking to the most
+// recent '*' is enough.
+bool string_match(std::string_view pattern, std::string_view str) {
+    size_t pi = 0, si = 0;
+    size_t star_pi = std::string_view::npos, star_si = 0;
+
+    while (si < str.size()) {
+        size_t next = 0;
+        if (pi < pattern.size() && pattern[pi] == '*') {
+            star_pi = ++pi;
+            star_si = si;
+        } else if (pi < pattern.size() && match_token(pattern, pi, str[si], next)) {
+            pi = next;
+            si++;
+        } else if (star_pi != std::string_view::npos) {
+            pi = star_pi;
+            si = ++star_si;
+        } else {
+            return false;
+        }
+    }
+    while (pi < pattern.size() && pattern[pi] == '*') pi++;
+    return pi == pattern.size();
+}
@@ -1,6 +1,10 @@
 #pragma once
 #include <string>
+#include <string_view>
 
 long long current_time_ms();
 std::string to_upper(std::string str);
-std::string hex_to_bytes(const std::string& hex);
\ No newline at end of file
+std::string to_lower(std::string str);
+std::string hex_to_bytes(const std::string& hex);
+std::string random_hex(size_t len);
+bool string_match(std::string_view pattern, std::string_view str);